@@ -0,0 +1,526 @@
+// Headless offline analysis
+//
+// Runs sound files through the live backend and writes the selected features of every
+// frame. No GUI libraries are linked, so it runs on machines without a display.
+//
+//   bleep-analyze [-f feature,...] [-o output] [-b | -c] [-C cache] [-j threads] [-l] path...
+//
+// Paths may be files or directories, which are searched recursively for .wav files in
+// sorted order. Files are analyzed in parallel, each worker thread running its own backend,
+// and the output is the same for any number of threads. Output is CSV with one row per
+// frame, starting with the file and the time (in seconds) at the end of the frame. With -b
+// the output is binary instead:
+//   "BLEEPFT1"
+//   uint32 file count, then every file path terminated by '\0'
+//   uint32 column count, then every column name terminated by '\0'
+//   one row of doubles per frame: file index, time, then the features
+// All numbers are in native byte order. With -c the output is a columnar feature file (see
+// featfile.h), which can be memory mapped and queried by column and time range.
+//
+// With -C, every feature of every file is kept in a cache (see cache.h), keyed by the file's
+// contents and the parameters the feature depends on. Files whose selected features are all
+// cached are not analyzed again; otherwise the backend runs once, computing only the missing
+// features, and adds them to the cache. Without -C, only the selected features are computed.
+#include "backend.h"
+#include "cache.h"
+#include "corpus.h"
+#include "featfile.h"
+#include "wav.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifndef BACKEND_THREAD_LOCAL
+#error "analyze.c runs a backend per thread, build it with -DBACKEND_THREAD_LOCAL"
+#endif
+
+#define READ_FRAMES      4096
+#define DEFAULT_FEATURES "pitch_lp,ensemble,confidence,centroid"
+#define BINARY_MAGIC     "BLEEPFT1"
+#define OFFLINE_DEADLINE 10000000 // Microseconds; no estimator is ever dropped, so results are reproducible
+#define ANALYSIS_VERSION 2 // Increase to invalidate the cache when the backend changes
+
+// Parameters as "NAME=value" strings, for cache keys
+#define STRING(x) #x
+#define PARAM(x)  " " #x "=" STRING(x)
+#define FRAME_CONFIG   PARAM(ANALYSIS_VERSION) PARAM(SAMPLE_RATE) PARAM(FFT_SIZE) PARAM(FFT_HOP) PARAM(ONSET_FFT_SIZE) \
+                       PARAM(ONSET_THRESHOLD) PARAM(OFFSET_THRESHOLD)
+#define PITCH_CONFIG   PARAM(PITCH_DECIMATION) PARAM(DECIMATOR_TAPS) PARAM(PITCH_MIN_FREQ) PARAM(PITCH_MAX_FREQ)
+#define PEAK_CONFIG    PITCH_CONFIG PARAM(PEAK_MAX_FREQ) PARAM(PEAK_FLOOR)
+#define CQT_CONFIG     PARAM(PITCH_DECIMATION) PARAM(DECIMATOR_TAPS) PARAM(CQT_FFT_SIZE) PARAM(CQT_MIN_FREQ) \
+                       PARAM(CQT_BINS_PER_OCTAVE) PARAM(CQT_BINS)
+#define ENSEMBLE_CONFIG PARAM(PITCH_MIN_FREQ) PARAM(PITCH_MAX_FREQ) PARAM(OFFLINE_DEADLINE)
+#define FORMANT_CONFIG PARAM(PITCH_DECIMATION) PARAM(DECIMATOR_TAPS) PARAM(FORMANT_ORDER) PARAM(FORMANT_FLOOR) PARAM(FORMANT_CEILING) \
+                       PARAM(FORMANT_MAX_BANDWIDTH)
+#define BAND_CONFIG    PARAM(FORMANT_MIN_FREQ) PARAM(FORMANT_MAX_FREQ) PARAM(BAND_RMS_TIME)
+#define MEL_CONFIG     PARAM(NUM_MEL_BANDS) PARAM(MEL_MIN_FREQ) PARAM(MEL_MAX_FREQ)
+
+typedef struct
+{
+    const char* name;
+    double*     values;
+    size_t      count;
+    const char* config; // The parameters the feature depends on, besides FRAME_CONFIG
+} feature;
+
+#define NUM_FEATURES BACKEND_FEATURES
+
+// Every thread has its own backend, so its features live at different addresses
+static __thread feature features[NUM_FEATURES];
+
+static size_t selected[NUM_FEATURES]; // Indices into features
+static size_t num_selected;
+static size_t num_columns;
+
+static manifest       files;
+static bool           binary;
+static bool           columnar;
+static feature_writer columns;
+static bool           caching;
+static cache          feature_cache;
+
+// The parameters the backend's features depend on besides FRAME_CONFIG; a feature not listed
+// depends on FRAME_CONFIG alone
+static const struct
+{
+    const char* name;
+    const char* config;
+} feature_configs[] = {
+    {"pitch_lp",   PITCH_CONFIG},
+    {"cepstral",   PITCH_CONFIG},
+    {"hps",        PITCH_CONFIG PARAM(HPS_HARMONICS)},
+    {"harmonic",   PEAK_CONFIG},
+    {"cqt_pitch",  CQT_CONFIG PARAM(CQT_HARMONICS)},
+    {"ensemble",   ENSEMBLE_CONFIG},
+    {"confidence", ENSEMBLE_CONFIG},
+    {"formants",   FORMANT_CONFIG},
+    {"bandwidths", FORMANT_CONFIG},
+    {"bands",      BAND_CONFIG},
+    {"mel",        MEL_CONFIG},
+    {"mfcc",       MEL_CONFIG PARAM(NUM_MFCC)},
+    {"cqt",        CQT_CONFIG},
+};
+
+// Point the calling thread's feature table at its own backend
+static void bind_features ()
+{
+    backend_feature table[BACKEND_FEATURES];
+    backend_features(table);
+    for (size_t i = 0; i < NUM_FEATURES; ++i)
+    {
+        features[i] = (feature){table[i].name, table[i].values, table[i].count, ""};
+        for (size_t c = 0; c < sizeof(feature_configs)/sizeof(feature_configs[0]); ++c)
+            if (strcmp(feature_configs[c].name, table[i].name) == 0) features[i].config = feature_configs[c].config;
+    }
+}
+
+// Select the features of a comma separated list; return false if a name is unknown
+static bool select_features (const char* list)
+{
+    char* names = strdup(list);
+    bool found_all = true;
+    for (char* name = strtok(names, ","); name; name = strtok(NULL, ","))
+    {
+        size_t i = 0;
+        while (i < NUM_FEATURES && strcmp(features[i].name, name) != 0) ++i;
+        if (i == NUM_FEATURES)
+        {
+            fprintf(stderr, "Unknown feature: %s\n", name);
+            found_all = false;
+            continue;
+        }
+        if (num_selected == NUM_FEATURES) continue;
+        selected[num_selected++] = i;
+        num_columns += features[i].count;
+    }
+    free(names);
+    return found_all;
+}
+
+// Write the name of a feature column, as the backend names it
+static void column_name (char* name, size_t size, feature* f, size_t i)
+{
+    backend_feature named = {f->name, f->values, f->count};
+    backend_column_name(name, size, &named, i);
+}
+
+static void write_header (FILE* out)
+{
+    char name[64];
+    if (!binary)
+    {
+        fprintf(out, "file,time");
+        for (size_t s = 0; s < num_selected; ++s)
+            for (size_t i = 0; i < features[selected[s]].count; ++i)
+            {
+                column_name(name, sizeof(name), &features[selected[s]], i);
+                fprintf(out, ",%s", name);
+            }
+        fprintf(out, "\n");
+        return;
+    }
+
+    uint32_t count = files.count;
+    fwrite(BINARY_MAGIC, 1, strlen(BINARY_MAGIC), out);
+    fwrite(&count, sizeof(count), 1, out);
+    for (size_t f = 0; f < files.count; ++f) fwrite(files.paths[f], 1, strlen(files.paths[f])+1, out);
+    count = num_columns;
+    fwrite(&count, sizeof(count), 1, out);
+    for (size_t s = 0; s < num_selected; ++s)
+        for (size_t i = 0; i < features[selected[s]].count; ++i)
+        {
+            column_name(name, sizeof(name), &features[selected[s]], i);
+            fwrite(name, 1, strlen(name)+1, out);
+        }
+}
+
+// Write a CSV field in quotes, doubling the quotes in it (RFC 4180)
+static void write_quoted (FILE* out, const char* field)
+{
+    fputc('"', out);
+    for (const char* c = field; *c; ++c)
+    {
+        if (*c == '"') fputc('"', out);
+        fputc(*c, out);
+    }
+    fputc('"', out);
+}
+
+// Write a frame
+//   out:    the output
+//   file:   the file index
+//   time:   the time (in seconds) at the end of the frame
+//   values: the selected features, of length num_columns
+static void write_row (FILE* out, size_t file, double time, const double* values)
+{
+    if (!binary)
+    {
+        write_quoted(out, files.paths[file]);
+        fprintf(out, ",%f", time);
+        for (size_t column = 0; column < num_columns; ++column) fprintf(out, ",%g", values[column]);
+        fprintf(out, "\n");
+        return;
+    }
+
+    double row[2 + num_columns];
+    row[0] = file;
+    row[1] = time;
+    memcpy(row + 2, values, sizeof(double) * num_columns);
+    fwrite(row, sizeof(double), 2 + num_columns, out);
+}
+
+// Return the cache key of a feature's configuration
+static uint64_t config_hash (feature* f)
+{
+    uint64_t hash = cache_hash(f->name, strlen(f->name)+1, CACHE_SEED);
+    hash = cache_hash(FRAME_CONFIG, strlen(FRAME_CONFIG), hash);
+    return cache_hash(f->config, strlen(f->config), hash);
+}
+
+// Write the rows of a file from the cache; return false (writing nothing) unless every
+// selected feature is cached
+static bool replay_cached (size_t file, uint64_t content, FILE* out)
+{
+    feature_reader entries[num_selected];
+    size_t num_entries = 0;
+    char path[4096];
+    for (; num_entries < num_selected; ++num_entries)
+    {
+        feature* f = &features[selected[num_entries]];
+        cache_entry_path(&feature_cache, content, config_hash(f), path, sizeof(path));
+        feature_reader* entry = &entries[num_entries];
+        if (!feature_reader_open(entry, path)) break;
+        if (entry->header->num_columns != 2 + f->count || entry->header->num_frames != entries[0].header->num_frames)
+        {
+            feature_reader_close(entry);
+            break;
+        }
+    }
+
+    bool hit = num_entries == num_selected;
+    size_t num_frames = hit && num_entries > 0 ? entries[0].header->num_frames : 0;
+    double values[num_columns];
+    for (size_t frame = 0; frame < num_frames; ++frame)
+    {
+        size_t column = 0;
+        for (size_t s = 0; s < num_selected; ++s)
+            for (size_t i = 0; i < features[selected[s]].count; ++i)
+                values[column++] = feature_reader_value(&entries[s], 2 + i, frame);
+        write_row(out, file, feature_reader_value(&entries[0], FEATURE_TIME, frame), values);
+    }
+    for (size_t s = 0; s < num_entries; ++s) feature_reader_close(&entries[s]);
+    return hit;
+}
+
+// Open the cache entry of every selected feature that is cached, and a new one for every
+// feature that is not
+//   content: the content hash of the file
+//   path:    the file
+//   entries: output readers, one per selected feature, open where hits is true
+//   hits:    output flags, one per selected feature, true if it is cached
+//   writers: output writers, one per selected feature
+//   temps:   output temporary paths, empty for features which are cached already
+static void open_entries (uint64_t content, const char* path, feature_reader* entries, bool* hits,
+                          feature_writer* writers, char (*temps)[4096])
+{
+    char entry[4096];
+    for (size_t s = 0; s < num_selected; ++s)
+    {
+        feature* f = &features[selected[s]];
+        temps[s][0] = '\0';
+        cache_entry_path(&feature_cache, content, config_hash(f), entry, sizeof(entry));
+        hits[s] = feature_reader_open(&entries[s], entry);
+        if (hits[s] && entries[s].header->num_columns == 2 + f->count) continue;
+        if (hits[s]) feature_reader_close(&entries[s]);
+        hits[s] = false;
+        if (!cache_temp_path(&feature_cache, content, temps[s], sizeof(temps[s]))) continue;
+
+        char names[f->count][FEATURE_NAME_SIZE];
+        const char* name_list[f->count];
+        for (size_t i = 0; i < f->count; ++i)
+        {
+            column_name(names[i], FEATURE_NAME_SIZE, f, i);
+            name_list[i] = names[i];
+        }
+        if (feature_writer_open(&writers[s], temps[s], SAMPLE_RATE, FFT_HOP, name_list, f->count))
+            feature_writer_add_source(&writers[s], path);
+        else
+        {
+            unlink(temps[s]);
+            temps[s][0] = '\0';
+        }
+    }
+}
+
+// Where the frames of a file being analyzed go
+typedef struct
+{
+    FILE*           out;
+    size_t          file;
+    size_t          position; // Samples pushed before the current block
+    size_t          frame;    // Frames written before
+    feature_reader* entries;  // Cached features, one per selected feature, open where hits is true
+    bool*           hits;
+    feature_writer* writers;  // New cache entries, one per selected feature
+    char          (*temps)[4096];
+    double*         values;   // A row
+} file_frames;
+
+// Write a frame's row, taking cached features from the cache and the others from the backend,
+// and append the backend's to the cache entries being written. Frames are found the same way
+// whichever features are computed, so the cached frames line up with the backend's.
+static void write_frame (size_t index, void* context)
+{
+    file_frames* f = context;
+    double time = (f->position + index + 1)/SAMPLE_RATE;
+    size_t column = 0;
+    for (size_t s = 0; s < num_selected; ++s)
+    {
+        feature* selected_feature = &features[selected[s]];
+        if (f->hits[s])
+        {
+            bool found = f->frame < f->entries[s].header->num_frames;
+            for (size_t v = 0; v < selected_feature->count; ++v)
+                f->values[column++] = found ? feature_reader_value(&f->entries[s], 2 + v, f->frame) : NAN;
+            continue;
+        }
+        if (f->temps[s][0]) feature_writer_append(&f->writers[s], 0, time, selected_feature->values);
+        for (size_t v = 0; v < selected_feature->count; ++v) f->values[column++] = selected_feature->values[v];
+    }
+    write_row(f->out, f->file, time, f->values);
+    ++f->frame;
+}
+
+// Run a file through this thread's backend, writing a row per frame; return false if it
+// can't be read
+static bool analyze_file (size_t file, const char* path, FILE* out, void* context)
+{
+    uint64_t content;
+    bool cached = caching && cache_file_hash(&feature_cache, path, &content);
+    if (cached && replay_cached(file, content, out)) return true;
+
+    wav_reader r;
+    if (!wav_open(&r, path))
+    {
+        fprintf(stderr, "Failed to open file: %s\n", path);
+        return false;
+    }
+    if (r.sample_rate != SAMPLE_RATE)
+    {
+        fprintf(stderr, "Skipping %s: sample rate is %.0fHz, not %.0fHz\n", path, r.sample_rate, SAMPLE_RATE);
+        wav_close(&r);
+        return false;
+    }
+
+    feature_reader entries[num_selected];
+    bool hits[num_selected];
+    feature_writer writers[num_selected];
+    char temps[num_selected][4096];
+    for (size_t s = 0; s < num_selected; ++s) hits[s] = false, temps[s][0] = '\0';
+    if (cached) open_entries(content, path, entries, hits, writers, temps);
+
+    // Only compute the selected features which aren't cached
+    bool skip[BACKEND_FEATURES];
+    for (size_t i = 0; i < BACKEND_FEATURES; ++i) skip[i] = true;
+    for (size_t s = 0; s < num_selected; ++s) if (!hits[s]) skip[selected[s]] = false;
+    backend_skip(skip);
+    backend_init();
+    float block[READ_FRAMES];
+    double values[num_columns];
+    file_frames frames = {out, file, 0, 0, entries, hits, writers, temps, values};
+    size_t count;
+    while ((count = wav_read(&r, block, READ_FRAMES)) > 0)
+    {
+        backend_push_buffer(block, count, write_frame, &frames);
+        frames.position += count;
+    }
+    wav_close(&r);
+
+    for (size_t s = 0; s < num_selected; ++s)
+    {
+        if (hits[s]) feature_reader_close(&entries[s]);
+        if (!temps[s][0]) continue;
+        if (feature_writer_close(&writers[s])) cache_commit(&feature_cache, temps[s], content, config_hash(&features[selected[s]]));
+        else                                   unlink(temps[s]);
+    }
+    return true;
+}
+
+// Move the binary rows of a file into the columnar feature file
+static void write_columns (size_t file, const char* data, size_t size, void* context)
+{
+    const double* rows = (const double*)data;
+    size_t row_size = 2 + num_columns;
+    for (size_t row = 0; row < size/sizeof(double)/row_size; ++row)
+        feature_writer_append(&columns, file, rows[row*row_size + 1], rows + row*row_size + 2);
+}
+
+// Create the columnar feature file, with every file as a source; return false if it can't be written
+static bool open_columns (const char* path)
+{
+    char names[num_columns][FEATURE_NAME_SIZE];
+    const char* name_list[num_columns];
+    size_t column = 0;
+    for (size_t s = 0; s < num_selected; ++s)
+        for (size_t i = 0; i < features[selected[s]].count; ++i, ++column)
+        {
+            column_name(names[column], FEATURE_NAME_SIZE, &features[selected[s]], i);
+            name_list[column] = names[column];
+        }
+    if (!feature_writer_open(&columns, path, SAMPLE_RATE, FFT_HOP, name_list, num_columns)) return false;
+    for (size_t f = 0; f < files.count; ++f) feature_writer_add_source(&columns, files.paths[f]);
+    return true;
+}
+
+static void start_worker (void* context)
+{
+    bind_features();
+    ensemble_deadline = OFFLINE_DEADLINE;
+}
+
+static void stop_worker (void* context)
+{
+    backend_cleanup();
+}
+
+static void usage ()
+{
+    fprintf(stderr, "Usage: bleep-analyze [-f feature,...] [-o output] [-b | -c] [-C cache] [-j threads] [-l] path...\n");
+    fprintf(stderr, "  -f  features to write (default %s)\n", DEFAULT_FEATURES);
+    fprintf(stderr, "  -o  output file (default stdout)\n");
+    fprintf(stderr, "  -b  write binary instead of CSV\n");
+    fprintf(stderr, "  -c  write a columnar feature file instead of CSV (needs -o)\n");
+    fprintf(stderr, "  -C  cache directory, created if needed (default no cache)\n");
+    fprintf(stderr, "  -j  number of worker threads (default one per processor)\n");
+    fprintf(stderr, "  -l  list the available features\n");
+}
+
+int main (int argc, char** argv)
+{
+    const char* feature_list = DEFAULT_FEATURES;
+    const char* output_path = NULL;
+    size_t num_threads = corpus_threads();
+    bind_features();
+    int option;
+    while ((option = getopt(argc, argv, "f:o:bcC:j:l")) != -1)
+    {
+        switch (option) {
+            case 'f':
+                feature_list = optarg; break;
+            case 'o':
+                output_path = optarg; break;
+            case 'b':
+                binary = true; break;
+            case 'c':
+                columnar = binary = true; break;
+            case 'C':
+                if (!cache_init(&feature_cache, optarg))
+                {
+                    fprintf(stderr, "Failed to create cache: %s\n", optarg);
+                    return 1;
+                }
+                caching = true; break;
+            case 'j':
+                num_threads = atoi(optarg); break;
+            case 'l':
+                for (size_t i = 0; i < NUM_FEATURES; ++i) printf("%s (%zu)\n", features[i].name, features[i].count);
+                return 0;
+            default:
+                usage();
+                return 1;
+        }
+    }
+    if (optind == argc || !select_features(feature_list) || (columnar && output_path == NULL))
+    {
+        usage();
+        return 1;
+    }
+
+    manifest_init(&files);
+    for (int i = optind; i < argc; ++i)
+    {
+        if (!manifest_add(&files, argv[i], ".wav"))
+        {
+            fprintf(stderr, "No such file or directory: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    corpus_job job = {analyze_file, start_worker, stop_worker, NULL, NULL};
+    size_t failures;
+    if (columnar)
+    {
+        if (!open_columns(output_path))
+        {
+            fprintf(stderr, "Failed to open output: %s\n", output_path);
+            return 1;
+        }
+        job.output = write_columns;
+        failures = corpus_run(&files, &job, num_threads, NULL);
+        if (!feature_writer_close(&columns))
+        {
+            fprintf(stderr, "Failed to write output: %s\n", output_path);
+            return 1;
+        }
+    }
+    else
+    {
+        FILE* out = output_path ? fopen(output_path, binary ? "wb" : "w") : stdout;
+        if (out == NULL)
+        {
+            fprintf(stderr, "Failed to open output: %s\n", output_path);
+            return 1;
+        }
+        write_header(out);
+        failures = corpus_run(&files, &job, num_threads, out);
+        if (out != stdout) fclose(out);
+    }
+    manifest_cleanup(&files);
+    if (caching) cache_cleanup(&feature_cache);
+    return failures ? 1 : 0;
+}
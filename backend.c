@@ -1,66 +1,201 @@
 #include "backend.h"
+#include "biquad.h"
+#include "cqt.h"
 #include "dywapitchtrack.h"
+#include "ensemble.h"
 #include "filter.h"
+#include "input.h"
+#include "lpc.h"
+#include "mel.h"
 #include "pitch.h"
+#include "plans.h"
 #include "windowing.h"
 
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
+#include <string.h>
 
 #include <fftw3.h>
 
 // FFT data
-double       fft_buffer[FFT_SIZE];
-int          fft_buffer_loc;
-fftw_complex fft[FFT_SIZE];
-double       fft_mag[FFT_SIZE/2 + 1];
-double       fft_band_mag[FFT_SIZE/2 + 1];
-fftw_complex fft_fft[FFT_SIZE/2 + 1];
-double       fft_fft_mag[(FFT_SIZE/2 + 1)/2 + 1];
-double       harmonics[FFT_SIZE/2+1];
+BACKEND_STATE double       fft_buffer[FFT_SIZE];
+BACKEND_STATE int          fft_buffer_loc;
+BACKEND_STATE fftw_complex fft[FFT_SIZE];
+BACKEND_STATE double       fft_mag[FFT_SIZE/2 + 1];
+BACKEND_STATE double       fft_band_mag[FFT_SIZE/2 + 1];
+
+// Decimated FFT data for pitch estimation
+BACKEND_STATE double       pitch_buffer[PITCH_FFT_SIZE];
+BACKEND_STATE fftw_complex pitch_fft[PITCH_FFT_SIZE/2 + 1];
+BACKEND_STATE double       pitch_fft_mag[PITCH_FFT_SIZE/2 + 1];
+BACKEND_STATE double       cepstrum[PITCH_FFT_SIZE/2 + 1];
+BACKEND_STATE spectral_peak peaks[MAX_HARMONICS];
+BACKEND_STATE size_t       num_peaks;
+static BACKEND_STATE decimator pitch_decimator;
+static BACKEND_STATE double pitch_history[2*PITCH_FFT_SIZE]; // Last PITCH_FFT_SIZE decimated samples, stored twice
+static BACKEND_STATE int    pitch_history_loc;
+
+// Constant-Q transform
+BACKEND_STATE double       cqt_mag[CQT_BINS];
+static BACKEND_STATE cqt   pitch_cqt;
 
 // FFT characteristics
-double       spectral_centroid;
-double       dominant_frequency;
-double       dominant_frequency_lp;
-double       average_amplitude;
-double       spectral_crest;
-double       spectral_flatness;
-double       harmonic_average;
+BACKEND_STATE double       spectral_centroid;
+BACKEND_STATE double       dominant_frequency;
+BACKEND_STATE double       dominant_frequency_lp;
+BACKEND_STATE double       cepstral_frequency;
+BACKEND_STATE double       hps_frequency;
+BACKEND_STATE double       ensemble_frequency;
+BACKEND_STATE double       ensemble_confidence;
+BACKEND_STATE double       average_amplitude;
+BACKEND_STATE double       spectral_crest;
+BACKEND_STATE double       spectral_flatness;
+BACKEND_STATE double       harmonic_frequency;
+BACKEND_STATE double       cqt_frequency;
 
 // Onset detection
-int          window_function;
-bool         note_on;
-double       onset_fft_buffer[ONSET_FFT_SIZE];
-fftw_complex onset_fft[ONSET_FFT_SIZE];
-double       onset_fft_mag[ONSET_FFT_SIZE/2+1];
-double       onset_average_amplitude;
-int          onset_fft_buffer_loc;
-int          onset_triggered;
+BACKEND_STATE int          window_function;
+BACKEND_STATE bool         note_on;
+BACKEND_STATE double       onset_fft_buffer[ONSET_FFT_SIZE];
+BACKEND_STATE fftw_complex onset_fft[ONSET_FFT_SIZE];
+BACKEND_STATE double       onset_fft_mag[ONSET_FFT_SIZE/2+1];
+BACKEND_STATE double       onset_average_amplitude;
+BACKEND_STATE int          onset_fft_buffer_loc;
+BACKEND_STATE int          onset_triggered;
 
 // Hysterisis
-double       prev_spectral_centroid = -INFINITY;
-double       prev_output_pitch = -INFINITY;
+BACKEND_STATE double       prev_spectral_centroid = -INFINITY;
+BACKEND_STATE double       prev_output_pitch = -INFINITY;
 
 // Formants
-double       formant_buffer[FFT_SIZE];
-double       formant_pitch;
+BACKEND_STATE double       formant_freqs[NUM_FORMANTS];
+BACKEND_STATE double       formant_bandwidths[NUM_FORMANTS];
+
+// Band levels
+BACKEND_STATE double       band_levels[NUM_BANDS];
+static BACKEND_STATE biquad_bank band_bank;
+
+// Timbre
+BACKEND_STATE double       mel_bands[NUM_MEL_BANDS];
+BACKEND_STATE double       mfcc[NUM_MFCC];
+static BACKEND_STATE mel_bank timbre_bank;
+
+// Dynamic wavelet pitch tracker
+BACKEND_STATE dywapitchtracker pitch_tracker;
+
+// Pitch estimator ensemble
+static BACKEND_STATE ensemble     pitch_ensemble;
+static BACKEND_STATE bool         ensemble_running;
+BACKEND_STATE long   ensemble_deadline = ENSEMBLE_DEADLINE;
+
+// Conditioning of buffers from the audio callback
+static BACKEND_STATE input_stage  input_conditioning;
+
+// Threads and filters are only set up by the first backend_init
+static BACKEND_STATE bool         initialized;
+
+// Positions in backend_features, and the features backend_skip turned off
+enum {F_PITCH_LP, F_CEPSTRAL, F_HPS, F_HARMONIC, F_CQT_PITCH, F_ENSEMBLE, F_CONFIDENCE, F_CENTROID, F_AMPLITUDE,
+      F_FORMANTS, F_BANDWIDTHS, F_BANDS, F_MEL, F_MFCC, F_CQT, F_COUNT};
+_Static_assert(F_COUNT == BACKEND_FEATURES, "every feature has a position");
+static BACKEND_STATE bool         skipped[BACKEND_FEATURES];
+
+// Add a band pass made of two biquads to the band bank
+static void add_band (double min_freq, double max_freq)
+{
+    double center = sqrt(min_freq*max_freq);
+    biquad stages[2];
+    stages[0] = stages[1] = biquad_bandpass(SAMPLE_RATE, center, center/(max_freq-min_freq));
+    biquad_bank_add(&band_bank, stages, 2);
+}
+
+static void init_bands ()
+{
+    biquad_bank_init(&band_bank, SAMPLE_RATE, BAND_RMS_TIME);
+    biquad low[2];
+    low[0] = low[1] = biquad_lowpass(SAMPLE_RATE, 300, M_SQRT1_2);
+    biquad_bank_add(&band_bank, low, 2);
+    add_band(300, FORMANT_MIN_FREQ);
+    add_band(FORMANT_MIN_FREQ, FORMANT_MAX_FREQ);
+    biquad high[2];
+    high[0] = high[1] = biquad_highpass(SAMPLE_RATE, FORMANT_MAX_FREQ, M_SQRT1_2);
+    biquad_bank_add(&band_bank, high, 2);
+}
 
-// // Dynamic wavelet pitch tracker
-// dywapitchtracker pitch_tracker;
+// Apply the selected window function to a magnitude spectrum
+static void apply_window (double* mag, size_t size)
+{
+    switch (window_function) {
+        case WELCH:
+            welch_window(mag, size, mag); break;
+        case HANNING:
+            hanning_window(mag, size, mag); break;
+        case HAMMING:
+            hamming_window(mag, size, mag); break;
+        case BLACKMAN:
+            blackman_window(mag, size, mag); break;
+        case NUTTAL:
+            nuttal_window(mag, size, mag); break;
+        default:
+            break;
+    }
+}
 
 void backend_init ()
 {
+    if (!initialized)
+    {
+        ensemble_running = ensemble_init(&pitch_ensemble, FFT_SIZE, SAMPLE_RATE, PITCH_MIN_FREQ, PITCH_MAX_FREQ);
+        if (!ensemble_running) fprintf(stderr, "Failed to start the pitch ensemble; ensemble pitch is off\n");
+        init_bands();
+        decimator_init(&pitch_decimator, PITCH_DECIMATION, DECIMATOR_TAPS);
+        cqt_init(&pitch_cqt, CQT_FFT_SIZE, PITCH_RATE, CQT_MIN_FREQ, CQT_BINS, CQT_BINS_PER_OCTAVE);
+        mel_init(&timbre_bank, MEL_SCALE, NUM_MEL_BANDS, NUM_MFCC, FFT_SIZE, SAMPLE_RATE, MEL_MIN_FREQ, MEL_MAX_FREQ);
+        input_init(&input_conditioning, INPUT_FLOAT32, SAMPLE_RATE, DC_CUTOFF);
+        // The frame transforms (and cepstral_pitch's DCT), so the audio thread never plans
+        plan_r2c(ONSET_FFT_SIZE);
+        plan_r2c(FFT_SIZE);
+        plan_r2c(PITCH_FFT_SIZE);
+        plan_r2r(PITCH_FFT_SIZE/2+1, FFTW_REDFT00);
+        initialized = true;
+    }
+
+    // Start every stream from silence, so features never depend on earlier input
     fft_buffer_loc = 0;
     onset_fft_buffer_loc = 0;
     onset_triggered = 0;
+    onset_average_amplitude = 0;
+    for (int i = 0; i < ONSET_FFT_SIZE; ++i) onset_fft_buffer[i] = 0;
+    for (int i = 0; i < 2*PITCH_FFT_SIZE; ++i) pitch_history[i] = 0;
+    pitch_history_loc = 0;
+    biquad_bank_reset(&band_bank);
+    decimator_reset(&pitch_decimator);
+    cqt_reset(&pitch_cqt);
+    if (ensemble_running) ensemble_reset(&pitch_ensemble);
+    input_reset(&input_conditioning);
     dywapitch_inittracking(&pitch_tracker);
 }
 
+void backend_cleanup ()
+{
+    if (!initialized) return;
+    if (ensemble_running) ensemble_cleanup(&pitch_ensemble);
+    decimator_cleanup(&pitch_decimator);
+    cqt_cleanup(&pitch_cqt);
+    mel_cleanup(&timbre_bank);
+    initialized = false;
+}
+
 bool backend_push_sample (float sample)
 {
+    if (!skipped[F_BANDS])
+    {
+        biquad_bank_push(&band_bank, &sample, 1);
+        for (int i = 0; i < NUM_BANDS; ++i) band_levels[i] = band_bank.rms[i];
+    }
+
     onset_fft_buffer[onset_fft_buffer_loc] = sample;
     ++onset_fft_buffer_loc;
     if (onset_fft_buffer_loc==ONSET_FFT_SIZE)
@@ -73,48 +208,151 @@ bool backend_push_sample (float sample)
     //stall calculations of large ffts until onset is detected. This will currently cancel the last 25ms of a transform that with p>.5, should happen. IDC right now. Mechanism is to reset fft_buffer_loc back to the beginning.
     if (onset_average_amplitude<ONSET_THRESHOLD && !note_on) fft_buffer_loc = 0;
     if (onset_average_amplitude<OFFSET_THRESHOLD && note_on) {fft_buffer_loc = 0;}
+    // The decimated stream runs through silence too, so the long constant-Q frame stays continuous
+    double decimated = sample;
+    if (decimator_push(&pitch_decimator, &decimated, &decimated, 1))
+    {
+        pitch_history[pitch_history_loc] = pitch_history[pitch_history_loc + PITCH_FFT_SIZE] = decimated;
+        pitch_history_loc = (pitch_history_loc + 1) % PITCH_FFT_SIZE;
+        cqt_push(&pitch_cqt, &decimated, 1);
+    }
     fft_buffer[fft_buffer_loc] = sample;
     ++fft_buffer_loc;
     if (fft_buffer_loc==FFT_SIZE)
     {
-        fft_buffer_loc=0;
         calc_fft(fft_buffer, fft, FFT_SIZE);
         calc_fft_mag(fft, fft_mag, FFT_SIZE);
-        // double tmp2[FFT_SIZE/2 + 1];
-        switch (window_function) {
-            case WELCH:
-                welch_window(fft_mag, FFT_SIZE/2+1, fft_mag); break;
-            case HANNING:
-                hanning_window(fft_mag, FFT_SIZE/2+1, fft_mag); break;
-            case HAMMING:
-                hamming_window(fft_mag, FFT_SIZE/2+1, fft_mag); break;
-            case BLACKMAN:
-                blackman_window(fft_mag, FFT_SIZE/2+1, fft_mag); break;
-            case NUTTAL:
-                nuttal_window(fft_mag, FFT_SIZE/2+1, fft_mag); break;
-            default:
-                break;
+        apply_window(fft_mag, FFT_SIZE/2+1);
+
+        // Pitch estimators only look below 5kHz, so they use the smaller decimated FFT over
+        // the same span (give or take PITCH_DECIMATION-1 samples)
+        memcpy(pitch_buffer, pitch_history + pitch_history_loc, sizeof(pitch_buffer));
+        calc_fft(pitch_buffer, pitch_fft, PITCH_FFT_SIZE);
+        calc_fft_mag(pitch_fft, pitch_fft_mag, PITCH_FFT_SIZE);
+        apply_window(pitch_fft_mag, PITCH_FFT_SIZE/2+1);
+        if (!skipped[F_CEPSTRAL])
+            cepstral_frequency = cepstral_pitch(pitch_fft_mag, cepstrum, PITCH_FFT_SIZE, PITCH_RATE, PITCH_MIN_FREQ, PITCH_MAX_FREQ);
+        if (!skipped[F_HPS])
+            hps_frequency = hps_pitch(pitch_fft_mag, PITCH_FFT_SIZE, PITCH_RATE, HPS_HARMONICS, PITCH_MIN_FREQ, PITCH_MAX_FREQ);
+        if (!skipped[F_ENSEMBLE] || !skipped[F_CONFIDENCE])
+        {
+            if (!ensemble_running) ensemble_frequency = -INFINITY, ensemble_confidence = 0;
+            else if (ensemble_deadline > 0)
+                ensemble_frequency = ensemble_estimate(&pitch_ensemble, fft_buffer, fft, fft_mag, ensemble_deadline, &ensemble_confidence);
+            else ensemble_frequency = ensemble_post(&pitch_ensemble, fft_buffer, fft, fft_mag, &ensemble_confidence);
         }
-        //calc_fft(fft_mag, fft_fft, tmp2, FFT_SIZE/2 +1);
-        //calc_fft_mag(fft_fft, fft_fft_mag, FFT_SIZE/2 + 1);
         dominant_frequency = 0; //dominant_freq(fft, fft_mag, FFT_SIZE, SAMPLE_RATE);
-        spectral_centroid = calc_spectral_centroid(fft_mag,FFT_SIZE, SAMPLE_RATE);
-        dominant_frequency_lp = dominant_freq_lp(fft, fft_mag, FFT_SIZE, SAMPLE_RATE, 5000);
+        if (!skipped[F_CENTROID]) spectral_centroid = calc_spectral_centroid(fft_mag,FFT_SIZE, SAMPLE_RATE);
+        if (!skipped[F_PITCH_LP]) dominant_frequency_lp = dominant_freq_lp(pitch_fft, pitch_fft_mag, PITCH_FFT_SIZE, PITCH_RATE, 5000);
         // dominant_frequency_lp = dominant_freq_bp(fft, fft_mag, FFT_SIZE, SAMPLE_RATE, 900, 2800);
         // dominant_frequency_lp = dywapitch_computepitch(&pitch_tracker, fft_buffer, 0, FFT_SIZE);
-        average_amplitude = calc_avg_amplitude(fft_mag, FFT_SIZE, SAMPLE_RATE, 0, FFT_SIZE/2);
+        if (!skipped[F_AMPLITUDE]) average_amplitude = calc_avg_amplitude(fft_mag, FFT_SIZE, SAMPLE_RATE, 0, FFT_SIZE/2);
         spectral_crest = 0; //calc_spectral_crest(fft_mag, FFT_SIZE, SAMPLE_RATE);
         spectral_flatness = 0; //calc_spectral_flatness(fft_mag, FFT_SIZE, SAMPLE_RATE, 0, SAMPLE_RATE/2);
-        harmonic_average = 0; //calc_harmonics(fft, fft_mag, FFT_SIZE, SAMPLE_RATE); //useless and computationally intensive
+        if (!skipped[F_HARMONIC])
+        {
+            num_peaks = find_peaks(pitch_fft_mag, PITCH_FFT_SIZE, PITCH_RATE, PITCH_MIN_FREQ, PEAK_MAX_FREQ, PEAK_FLOOR, peaks, MAX_HARMONICS);
+            harmonic_frequency = harmonic_pitch(peaks, num_peaks, PITCH_MIN_FREQ, PITCH_MAX_FREQ);
+        }
+        if (!skipped[F_CQT] || !skipped[F_CQT_PITCH]) cqt_compute(&pitch_cqt, cqt_mag);
+        if (!skipped[F_CQT_PITCH]) cqt_frequency = cqt_pitch(&pitch_cqt, cqt_mag, CQT_HARMONICS, PITCH_MAX_FREQ);
 
         // Formants
-        // band_pass(fft_buffer, formant_buffer, FFT_SIZE, SAMPLE_RATE, FORMANT_MIN_FREQ, FORMANT_MAX_FREQ);
-        // formant_pitch = _dywapitch_computeWaveletPitch(formant_buffer, 0, FFT_SIZE);
-        // printf("%f, %f\n", dominant_frequency_lp, formant_pitch);
+        if (!skipped[F_FORMANTS] || !skipped[F_BANDWIDTHS])
+        {
+            // LPC runs on the decimated stream too, which is already low passed below its Nyquist frequency
+            size_t num_formants = lpc_formants(pitch_history + pitch_history_loc, PITCH_FFT_SIZE, PITCH_RATE, FORMANT_ORDER,
+                                               FORMANT_FLOOR, FORMANT_CEILING, FORMANT_MAX_BANDWIDTH,
+                                               formant_freqs, formant_bandwidths, NUM_FORMANTS);
+            for (size_t i = num_formants; i < NUM_FORMANTS; ++i) formant_freqs[i] = formant_bandwidths[i] = 0;
+        }
+
+        // Timbre
+        if (!skipped[F_MEL] || !skipped[F_MFCC]) mel_energies(&timbre_bank, fft_mag, mel_bands);
+        if (!skipped[F_MFCC]) mel_mfcc(&timbre_bank, mel_bands, mfcc);
 
         // printf("%f\n", spectral_centroid);
 
+        // Keep the overlap with the next frame
+        memmove(fft_buffer, fft_buffer + FFT_HOP, sizeof(double) * (FFT_SIZE - FFT_HOP));
+        fft_buffer_loc = FFT_SIZE - FFT_HOP;
+
         return true;
     }
     return false;
-}
\ No newline at end of file
+}
+
+size_t backend_push_buffer (const float* in, size_t count, backend_frame_callback on_frame, void* context)
+{
+    float conditioned[FRAMES_PER_BUFFER];
+    size_t filled = 0;
+    for (size_t done = 0; done < count; done += FRAMES_PER_BUFFER)
+    {
+        size_t n = count - done < FRAMES_PER_BUFFER ? count - done : FRAMES_PER_BUFFER;
+        input_process(&input_conditioning, in + done, conditioned, n);
+        for (size_t i = 0; i < n; ++i)
+        {
+            if (!backend_push_sample(conditioned[i])) continue;
+            ++filled;
+            if (on_frame) on_frame(done + i, context);
+        }
+    }
+    return filled;
+}
+
+size_t backend_clipped ()
+{
+    return input_clipped(&input_conditioning);
+}
+
+void backend_features (backend_feature* features)
+{
+    features[F_PITCH_LP]    = (backend_feature){"pitch_lp",   &dominant_frequency_lp, 1};
+    features[F_CEPSTRAL]    = (backend_feature){"cepstral",   &cepstral_frequency,    1};
+    features[F_HPS]         = (backend_feature){"hps",        &hps_frequency,         1};
+    features[F_HARMONIC]    = (backend_feature){"harmonic",   &harmonic_frequency,    1};
+    features[F_CQT_PITCH]   = (backend_feature){"cqt_pitch",  &cqt_frequency,         1};
+    features[F_ENSEMBLE]    = (backend_feature){"ensemble",   &ensemble_frequency,    1};
+    features[F_CONFIDENCE]  = (backend_feature){"confidence", &ensemble_confidence,   1};
+    features[F_CENTROID]    = (backend_feature){"centroid",   &spectral_centroid,     1};
+    features[F_AMPLITUDE]   = (backend_feature){"amplitude",  &average_amplitude,     1};
+    features[F_FORMANTS]    = (backend_feature){"formants",   formant_freqs,          NUM_FORMANTS};
+    features[F_BANDWIDTHS]  = (backend_feature){"bandwidths", formant_bandwidths,     NUM_FORMANTS};
+    features[F_BANDS]       = (backend_feature){"bands",      band_levels,            NUM_BANDS};
+    features[F_MEL]         = (backend_feature){"mel",        mel_bands,              NUM_MEL_BANDS};
+    features[F_MFCC]        = (backend_feature){"mfcc",       mfcc,                   NUM_MFCC};
+    features[F_CQT]         = (backend_feature){"cqt",        cqt_mag,                CQT_BINS};
+}
+
+void backend_skip (const bool* skip)
+{
+    for (size_t i = 0; i < BACKEND_FEATURES; ++i) skipped[i] = skip && skip[i];
+}
+
+void backend_column_name (char* name, size_t size, const backend_feature* f, size_t index)
+{
+    if (f->count == 1) snprintf(name, size, "%s", f->name);
+    else               snprintf(name, size, "%s%zu", f->name, index);
+}
+
+void backend_snapshot_names (char (*names)[BACKEND_NAME_SIZE], const char** list)
+{
+    backend_feature features[BACKEND_FEATURES];
+    backend_features(features);
+    size_t i = 0;
+    for (size_t f = 0; f < BACKEND_SNAPSHOT_FEATURES; ++f)
+        for (size_t v = 0; v < features[f].count; ++v, ++i)
+        {
+            backend_column_name(names[i], BACKEND_NAME_SIZE, &features[f], v);
+            list[i] = names[i];
+        }
+}
+
+void backend_snapshot (double* values)
+{
+    backend_feature features[BACKEND_FEATURES];
+    backend_features(features);
+    size_t i = 0;
+    for (size_t f = 0; f < BACKEND_SNAPSHOT_FEATURES; ++f)
+        for (size_t v = 0; v < features[f].count; ++v) values[i++] = features[f].values[v];
+}
@@ -1,9 +1,13 @@
 // Live analysis backend
 //
-// The only input point is backend_push_sample. The data source (either a simulated
-// WAV file or real microphone input) should call this function repeatedly from
-// a single thread. Output is written to globals which can be accessed (with no
-// guarantees of quality of consistency) from any thread.
+// The input point is backend_push_buffer, which conditions the input (input.h) and feeds
+// it to backend_push_sample. The data source (either a simulated WAV file or real
+// microphone input) should call this function repeatedly from a single thread. Output is
+// written to globals which can be accessed (with no guarantees of quality of consistency)
+// from any thread.
+//
+// Built with -DBACKEND_THREAD_LOCAL, every thread gets its own backend instead: all state
+// is thread local, and each thread must call backend_init and backend_cleanup itself.
 #include "dywapitchtrack.h"
 
 #include <fftw3.h>
@@ -11,54 +15,182 @@
 #include <math.h>
 #include <stdbool.h>
 
+#ifdef BACKEND_THREAD_LOCAL
+#define BACKEND_STATE __thread
+#else
+#define BACKEND_STATE
+#endif
+
 #define SAMPLE_RATE       44100.0
 #define FRAMES_PER_BUFFER 64
+#ifndef FFT_SIZE
 #define FFT_SIZE          1024 // 1024 = 23ms delay, 43Hz bins
+#endif
+#ifndef FFT_HOP
+#define FFT_HOP           FFT_SIZE // Samples between frames while a note is on
+#endif
 #define BIN_SIZE          (SAMPLE_RATE/FFT_SIZE)
+#define PITCH_DECIMATION  4 // Pitch estimators run at SAMPLE_RATE/PITCH_DECIMATION
+#define PITCH_RATE        (SAMPLE_RATE/PITCH_DECIMATION)
+#define PITCH_FFT_SIZE    (FFT_SIZE/PITCH_DECIMATION) // Same span and bin size as FFT_SIZE
+#define DECIMATOR_TAPS    128
+#define CQT_FFT_SIZE      4096 // At PITCH_RATE, 371ms
+#define CQT_MIN_FREQ      55.0
+#define CQT_BINS_PER_OCTAVE 12
+#define CQT_BINS          72
+#define CQT_HARMONICS     6
 #define ONSET_FFT_SIZE    64
 #define ONSET_THRESHOLD   0.00003125
 #define OFFSET_THRESHOLD  (ONSET_THRESHOLD/3)
-#define FORMANT_MIN_FREQ  0.0
-#define FORMANT_MAX_FREQ  44100.0
+#define PITCH_MIN_FREQ    50.0
+#define DC_CUTOFF         10.0 // Input high pass, well below PITCH_MIN_FREQ
+#define PITCH_MAX_FREQ    1000.0
+#define HPS_HARMONICS     4
+#define PEAK_MAX_FREQ     5000.0
+#define PEAK_FLOOR        1e-7   // Quietest spectral peak considered a harmonic
+#define ENSEMBLE_DEADLINE 0    // Microseconds the ensemble may wait per frame; 0 never waits (pitch lags a frame)
+#define FORMANT_MIN_FREQ  900.0
+#define FORMANT_MAX_FREQ  2800.0
+#define NUM_FORMANTS      3
+#define FORMANT_ORDER     12    // At PITCH_RATE
+#define FORMANT_FLOOR     90.0  // Range of LPC resonances accepted as formants
+#define FORMANT_CEILING   5000.0
+#define FORMANT_MAX_BANDWIDTH 800.0
+#define BAND_LOW          0 // Biquad band levels: below 300Hz,
+#define BAND_MID          1 // 300Hz to FORMANT_MIN_FREQ,
+#define BAND_FORMANT      2 // FORMANT_MIN_FREQ to FORMANT_MAX_FREQ
+#define BAND_HIGH         3 // and above FORMANT_MAX_FREQ
+#define NUM_BANDS         4
+#define BAND_RMS_TIME     0.005 // Seconds
+#define NUM_MEL_BANDS     26
+#define NUM_MFCC          13
+#define MEL_MIN_FREQ      100.0
+#define MEL_MAX_FREQ      8000.0
 
 // FFT data
-extern double       fft_buffer[FFT_SIZE];
-extern int          fft_buffer_loc;
-extern fftw_complex fft[FFT_SIZE];
-extern double       fft_mag[FFT_SIZE/2 + 1];
-extern fftw_complex fft_fft[FFT_SIZE/2 + 1];
-extern double       fft_fft_mag[(FFT_SIZE/2 + 1)/2 + 1];
-extern double       harmonics[FFT_SIZE/2+1];
+extern BACKEND_STATE double       fft_buffer[FFT_SIZE];
+extern BACKEND_STATE int          fft_buffer_loc;
+extern BACKEND_STATE fftw_complex fft[FFT_SIZE];
+extern BACKEND_STATE double       fft_mag[FFT_SIZE/2 + 1];
+
+// Decimated FFT data for pitch estimation
+extern BACKEND_STATE double       pitch_buffer[PITCH_FFT_SIZE];
+extern BACKEND_STATE fftw_complex pitch_fft[PITCH_FFT_SIZE/2 + 1];
+extern BACKEND_STATE double       pitch_fft_mag[PITCH_FFT_SIZE/2 + 1];
+extern BACKEND_STATE double       cepstrum[PITCH_FFT_SIZE/2 + 1];
+extern BACKEND_STATE size_t       num_peaks;
+
+// Constant-Q transform (semitone bins from CQT_MIN_FREQ)
+extern BACKEND_STATE double       cqt_mag[CQT_BINS];
 
 // FFT characteristics
-extern double       spectral_centroid;
-extern double       dominant_frequency;
-extern double       dominant_frequency_lp;
-extern double       average_amplitude;
-extern double       spectral_crest;
-extern double       spectral_flatness;
-extern double       harmonic_average;
+extern BACKEND_STATE double       spectral_centroid;
+extern BACKEND_STATE double       dominant_frequency;
+extern BACKEND_STATE double       dominant_frequency_lp;
+extern BACKEND_STATE double       cepstral_frequency;
+extern BACKEND_STATE double       hps_frequency;
+extern BACKEND_STATE double       ensemble_frequency;
+extern BACKEND_STATE double       ensemble_confidence;
+extern BACKEND_STATE long         ensemble_deadline; // Microseconds, ENSEMBLE_DEADLINE by default
+extern BACKEND_STATE double       average_amplitude;
+extern BACKEND_STATE double       spectral_crest;
+extern BACKEND_STATE double       spectral_flatness;
+extern BACKEND_STATE double       harmonic_frequency;
+extern BACKEND_STATE double       cqt_frequency;
 
 // Onset detection
-extern int          window_function;
-extern bool         note_on;
-extern double       onset_fft_buffer[ONSET_FFT_SIZE];
-extern fftw_complex onset_fft[ONSET_FFT_SIZE];
-extern double       onset_fft_mag[ONSET_FFT_SIZE/2+1];
-extern double       onset_average_amplitude;
-extern int          onset_fft_buffer_loc;
-extern int          onset_triggered;
+extern BACKEND_STATE int          window_function;
+extern BACKEND_STATE bool         note_on;
+extern BACKEND_STATE double       onset_fft_buffer[ONSET_FFT_SIZE];
+extern BACKEND_STATE fftw_complex onset_fft[ONSET_FFT_SIZE];
+extern BACKEND_STATE double       onset_fft_mag[ONSET_FFT_SIZE/2+1];
+extern BACKEND_STATE double       onset_average_amplitude;
+extern BACKEND_STATE int          onset_fft_buffer_loc;
+extern BACKEND_STATE int          onset_triggered;
+
+// Formants (0 when not found)
+extern BACKEND_STATE double       formant_freqs[NUM_FORMANTS];
+extern BACKEND_STATE double       formant_bandwidths[NUM_FORMANTS];
+
+// Band levels (RMS, updated every sample)
+extern BACKEND_STATE double       band_levels[NUM_BANDS];
+
+// Timbre
+extern BACKEND_STATE double       mel_bands[NUM_MEL_BANDS];
+extern BACKEND_STATE double       mfcc[NUM_MFCC];
 
 // Hysterisis
-extern double       prev_spectral_centroid;
-extern double       prev_output_pitch;
+extern BACKEND_STATE double       prev_spectral_centroid;
+extern BACKEND_STATE double       prev_output_pitch;
 
 // Dynamic wavelet pitch tracker
-dywapitchtracker pitch_tracker;
+extern BACKEND_STATE dywapitchtracker pitch_tracker;
+
+// The features of a frame, as analyze writes them and sessions record them
+typedef struct
+{
+    const char* name;
+    double*     values;
+    size_t      count;
+} backend_feature;
+
+#define BACKEND_FEATURES          15
+#define BACKEND_SNAPSHOT_FEATURES 12 // The features before the spectra (mel, mfcc and cqt)
+#define BACKEND_SNAPSHOT_SIZE     (9 + 2*NUM_FORMANTS + NUM_BANDS) // Values of the snapshot features
+#define BACKEND_NAME_SIZE         32 // Bytes of a column name
 
-// Initialize backend system
+// Initialize backend system, or restart it from silence if it is already running
 void backend_init ();
 
+// Stop the backend's threads and release its buffers
+void backend_cleanup ();
+
 // Advance system state by a single sample
 // Return true if FFT buffer just got filled.
-bool backend_push_sample (float sample);
\ No newline at end of file
+bool backend_push_sample (float sample);
+
+// Called by backend_push_buffer every time the FFT buffer got filled, while the frame's
+// features are current
+//   index:   the position in the buffer of the sample that filled it
+//   context: as given to backend_push_buffer
+typedef void (*backend_frame_callback) (size_t index, void* context);
+
+// Advance system state by a buffer from the audio callback, clipped to [-1, 1] and with DC
+// removed. Clipping is counted for backend_clipped rather than reported; nothing blocks.
+// Return the number of times the FFT buffer got filled.
+//   in:       input array of length count
+//   count:    the number of samples
+//   on_frame: called for every frame, or NULL
+//   context:  passed to on_frame
+size_t backend_push_buffer (const float* in, size_t count, backend_frame_callback on_frame, void* context);
+
+// Return the number of samples backend_push_buffer clipped since the last call; safe to
+// call from any thread (with -DBACKEND_THREAD_LOCAL, counts the calling thread's backend)
+size_t backend_clipped ();
+
+// Fill a table of the features, pointing at the calling thread's backend; the spectra come
+// last
+//   features: output array of length BACKEND_FEATURES
+void backend_features (backend_feature* features);
+
+// Compute only some of the features, or all of them if skip is NULL; skipped features keep
+// stale values, and frames are found the same way either way (with -DBACKEND_THREAD_LOCAL,
+// for the calling thread's backend)
+//   skip: array of BACKEND_FEATURES flags in backend_features order, true for features not needed
+void backend_skip (const bool* skip);
+
+// Write the name of a feature's column: the feature's name, numbered if it has several values
+//   name:  output string
+//   size:  the size of name
+//   f:     the feature
+//   index: the index of the value in the feature
+void backend_column_name (char* name, size_t size, const backend_feature* f, size_t index);
+
+// Name the values of backend_snapshot
+//   names: output array of BACKEND_SNAPSHOT_SIZE names
+//   list:  output array of BACKEND_SNAPSHOT_SIZE pointers to names, as recorder_open takes them
+void backend_snapshot_names (char (*names)[BACKEND_NAME_SIZE], const char** list);
+
+// Copy the values of the first BACKEND_SNAPSHOT_FEATURES features of the latest frame
+//   values: output array of length BACKEND_SNAPSHOT_SIZE
+void backend_snapshot (double* values);
@@ -1,9 +1,8 @@
 #include "backend.h"
 #include "dywapitchtrack.h"
+#include "source.h"
 #include "tinydir.h"
 
-#include <sndfile.h>
-
 #include <math.h>
 #include <stdbool.h>
 #include <stdlib.h>
@@ -101,33 +100,27 @@ static bool gui_should_exit ()
     return glfwWindowShouldClose(pitchAccuracyWindow);
 }
 
-static double* histogram(size_t len_data, double* data, double targetFreq, size_t num_bins)
+// Count a value in a histogram of its log2 distance from targetFreq (num_bins*2+1 bins)
+static void histogram_add(double* out, double value, double targetFreq, int num_bins)
 {
-    double* out = malloc(sizeof(double) * (num_bins*2+1));
     double tolerance =  1.0;
-    double offset;
+    double offset = value - targetFreq;
     int histbin   = -1;
-    for (int i = 0; i < num_bins*2+1; i++) out[i] = 0;
-    for (int i = 0; i < len_data; i++)
+    if      (offset == 0) histbin = num_bins;
+    else if (offset <  0) 
     {
-        offset = data[i] - targetFreq;
-        if      (offset == 0) histbin = num_bins;
-        else if (offset <  0) 
-        {
-            offset *= -1;
-            histbin = num_bins - (log2(offset) * tolerance);
-            if (histbin < 0       ) histbin = 0;
-            if (histbin > num_bins-1) histbin = num_bins - 1;
-        }
-        else
-        {
-            histbin = num_bins + (log2(offset) * tolerance);
-            if (histbin < num_bins    ) histbin =     num_bins;
-            if (histbin > 2 * num_bins) histbin = 2 * num_bins;           
-        }
-        out[(int)histbin] += 1.0 / len_data;
+        offset *= -1;
+        histbin = num_bins - (log2(offset) * tolerance);
+        if (histbin < 0       ) histbin = 0;
+        if (histbin > num_bins-1) histbin = num_bins - 1;
     }
-    return out;
+    else
+    {
+        histbin = num_bins + (log2(offset) * tolerance);
+        if (histbin < num_bins    ) histbin =     num_bins;
+        if (histbin > 2 * num_bins) histbin = 2 * num_bins;           
+    }
+    out[histbin] += 1.0;
 }
 
 static void graph_histograms()
@@ -160,40 +153,39 @@ static void gui_redraw ()
     glfwSwapBuffers(pitchAccuracyWindow);
 }
 
+typedef struct
+{
+    double  freq;
+    double* histogram;
+    size_t  num_values;
+} file_test;
+
+static void on_block (const float* block, size_t count, double time, void* context)
+{
+    file_test* t = context;
+    if (count < 1024) return; // Only whole blocks are measured
+    backend_push_buffer(block, count, NULL, NULL);
+    double pitch = spectral_centroid;
+    histogram_add(t->histogram, pitch, 0, HISTOGRAM_BINS);
+    ++t->num_values;
+    printf("%f\t%f\n", t->freq, pitch);
+}
+
 void test_file (char* file)
 {
-    if (!ends_with(file, ".wav")) return;
+    if (!ends_with(file, ".wav") || counter == NUM_FILES) return;
 
-    SF_INFO info;
-    SNDFILE* f = sf_open(file, SFM_READ, &info);
-    if (f == NULL)
+    source input;
+    if (!source_open_file(&input, file, 1024, false))
     {
         fprintf(stderr, "Failed to open file: %s\n", file);
         return;
     }
-    double freq = atof(after(file, '/'));
-    double* sample = malloc(sizeof(double) * info.frames);
-    double* values = malloc(sizeof(double) * info.frames/1024);
-
-    sf_read_double(f, sample, info.frames);
-    
-    for (int i = 0; i+1024 <= info.frames; i += 1024)
-    {
-        double t = 1.0 * i / info.samplerate;
-
-        for (int j = 0; j < 1024; ++j)
-        {
-            backend_push_sample(sample[i+j]);
-        }
-        double pitch = spectral_centroid;
-        values[i/1024] = pitch;
-        printf("%f\t%f\n", freq, pitch);
-    } 
-    double* out = malloc(sizeof(double) * (HISTOGRAM_BINS*2+1));
-    out = histogram(info.frames/1024, values, 0, HISTOGRAM_BINS);
-    for (int i = 0; i < (HISTOGRAM_BINS*2+1); i++) all_histograms[counter][i] = out[i];
-    counter++;
-    sf_close(f);
+    file_test t = {atof(after(file, '/')), all_histograms[counter++], 0};
+    source_start(&input, on_block, &t);
+    source_wait(&input);
+    source_close(&input);
+    for (int i = 0; i < (HISTOGRAM_BINS*2+1) && t.num_values > 0; i++) t.histogram[i] /= t.num_values;
 }
 
 void test_dir (char* path)
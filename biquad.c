@@ -0,0 +1,115 @@
+#include "biquad.h"
+
+#include <math.h>
+#include <string.h>
+
+#define LANES 4 // Bands are processed in multiples of LANES, the widest common double vector
+
+// Designs from Robert Bristow-Johnson's Audio EQ Cookbook
+static biquad normalize (double b0, double b1, double b2, double a0, double a1, double a2)
+{
+    biquad q = {b0/a0, b1/a0, b2/a0, a1/a0, a2/a0};
+    return q;
+}
+
+biquad biquad_lowpass (double sample_rate, double freq, double q)
+{
+    double w = 2*M_PI*freq/sample_rate;
+    double alpha = sin(w)/(2*q);
+    double c = cos(w);
+    return normalize((1-c)/2, 1-c, (1-c)/2, 1+alpha, -2*c, 1-alpha);
+}
+
+biquad biquad_highpass (double sample_rate, double freq, double q)
+{
+    double w = 2*M_PI*freq/sample_rate;
+    double alpha = sin(w)/(2*q);
+    double c = cos(w);
+    return normalize((1+c)/2, -(1+c), (1+c)/2, 1+alpha, -2*c, 1-alpha);
+}
+
+biquad biquad_bandpass (double sample_rate, double freq, double q)
+{
+    double w = 2*M_PI*freq/sample_rate;
+    double alpha = sin(w)/(2*q);
+    return normalize(alpha, 0, -alpha, 1+alpha, -2*cos(w), 1-alpha);
+}
+
+biquad biquad_peaking (double sample_rate, double freq, double q, double gain_db)
+{
+    double w = 2*M_PI*freq/sample_rate;
+    double alpha = sin(w)/(2*q);
+    double a = pow(10, gain_db/40);
+    return normalize(1+alpha*a, -2*cos(w), 1-alpha*a, 1+alpha/a, -2*cos(w), 1-alpha/a);
+}
+
+void biquad_bank_init (biquad_bank* bank, double sample_rate, double rms_time)
+{
+    memset(bank, 0, sizeof(biquad_bank));
+    bank->rms_coeff = 1 - exp(-1/(rms_time*sample_rate));
+    // Unused slots pass their input through, so every band can run every stage
+    for (size_t s = 0; s < BIQUAD_MAX_STAGES; ++s)
+    {
+        for (size_t b = 0; b < BIQUAD_MAX_BANDS; ++b) bank->b0[s][b] = 1;
+    }
+}
+
+int biquad_bank_add (biquad_bank* bank, biquad* stages, size_t num_stages)
+{
+    if (bank->num_bands == BIQUAD_MAX_BANDS || num_stages > BIQUAD_MAX_STAGES) return -1;
+    size_t b = bank->num_bands++;
+    for (size_t s = 0; s < num_stages; ++s)
+    {
+        bank->b0[s][b] = stages[s].b0;
+        bank->b1[s][b] = stages[s].b1;
+        bank->b2[s][b] = stages[s].b2;
+        bank->a1[s][b] = stages[s].a1;
+        bank->a2[s][b] = stages[s].a2;
+    }
+    if (num_stages > bank->num_stages) bank->num_stages = num_stages;
+    return (int)b;
+}
+
+void biquad_bank_push (biquad_bank* bank, float* in, size_t count)
+{
+    double* restrict y     = bank->output;
+    double* restrict power = bank->power;
+    double* restrict rms   = bank->rms;
+    double c = bank->rms_coeff;
+    size_t num_bands = (bank->num_bands + LANES-1) / LANES * LANES;
+    for (size_t i = 0; i < count; ++i)
+    {
+        for (size_t b = 0; b < num_bands; ++b) y[b] = in[i];
+        for (size_t s = 0; s < bank->num_stages; ++s)
+        {
+            double* restrict b0 = bank->b0[s];
+            double* restrict b1 = bank->b1[s];
+            double* restrict b2 = bank->b2[s];
+            double* restrict a1 = bank->a1[s];
+            double* restrict a2 = bank->a2[s];
+            double* restrict z1 = bank->z1[s];
+            double* restrict z2 = bank->z2[s];
+            for (size_t b = 0; b < num_bands; ++b)
+            {
+                double x = y[b];
+                y[b]  = b0[b]*x + z1[b];
+                z1[b] = b1[b]*x - a1[b]*y[b] + z2[b];
+                z2[b] = b2[b]*x - a2[b]*y[b];
+            }
+        }
+        for (size_t b = 0; b < num_bands; ++b)
+        {
+            power[b] += c*(y[b]*y[b] - power[b]);
+        }
+    }
+    for (size_t b = 0; b < num_bands; ++b) rms[b] = sqrt(power[b]);
+}
+
+void biquad_bank_reset (biquad_bank* bank)
+{
+    memset(bank->z1, 0, sizeof(bank->z1));
+    memset(bank->z2, 0, sizeof(bank->z2));
+    memset(bank->power, 0, sizeof(bank->power));
+    memset(bank->output, 0, sizeof(bank->output));
+    memset(bank->rms, 0, sizeof(bank->rms));
+}
@@ -0,0 +1,79 @@
+// Biquad filter bank
+//
+// Every band is a cascade of biquads run sample by sample, so band levels are available
+// without waiting for an FFT frame. Coefficients and state are stored stage by stage
+// with one slot per band, so a stage of every band is computed by one loop the compiler
+// vectorizes, several bands per SIMD register.
+#include <stdlib.h>
+
+#define BIQUAD_MAX_BANDS  16
+#define BIQUAD_MAX_STAGES 4
+
+// Coefficients of y = b0 x + b1 x' + b2 x'' - a1 y' - a2 y'' (normalized, a0 = 1)
+typedef struct
+{
+    double b0, b1, b2, a1, a2;
+} biquad;
+
+typedef struct
+{
+    size_t num_bands;
+    size_t num_stages;                             // Stages of the longest cascade
+    double rms_coeff;                              // Smoothing of the power estimate
+    double b0[BIQUAD_MAX_STAGES][BIQUAD_MAX_BANDS];
+    double b1[BIQUAD_MAX_STAGES][BIQUAD_MAX_BANDS];
+    double b2[BIQUAD_MAX_STAGES][BIQUAD_MAX_BANDS];
+    double a1[BIQUAD_MAX_STAGES][BIQUAD_MAX_BANDS];
+    double a2[BIQUAD_MAX_STAGES][BIQUAD_MAX_BANDS];
+    double z1[BIQUAD_MAX_STAGES][BIQUAD_MAX_BANDS]; // Transposed direct form II state
+    double z2[BIQUAD_MAX_STAGES][BIQUAD_MAX_BANDS];
+    double power[BIQUAD_MAX_BANDS];
+    double output[BIQUAD_MAX_BANDS];               // Last output sample of each band
+    double rms[BIQUAD_MAX_BANDS];                  // Running RMS of each band
+} biquad_bank;
+
+// Return a low pass biquad
+//   sample_rate: the sampling rate (in Hz) of the input
+//   freq:        cutoff frequency (in Hz)
+//   q:           quality factor (0.7071 for Butterworth)
+biquad biquad_lowpass (double sample_rate, double freq, double q);
+
+// Return a high pass biquad
+//   sample_rate: the sampling rate (in Hz) of the input
+//   freq:        cutoff frequency (in Hz)
+//   q:           quality factor (0.7071 for Butterworth)
+biquad biquad_highpass (double sample_rate, double freq, double q);
+
+// Return a band pass biquad with unity gain at its center
+//   sample_rate: the sampling rate (in Hz) of the input
+//   freq:        center frequency (in Hz)
+//   q:           quality factor, center frequency / bandwidth
+biquad biquad_bandpass (double sample_rate, double freq, double q);
+
+// Return a peaking equalizer biquad
+//   sample_rate: the sampling rate (in Hz) of the input
+//   freq:        center frequency (in Hz)
+//   q:           quality factor, center frequency / bandwidth
+//   gain_db:     gain at the center frequency (in dB)
+biquad biquad_peaking (double sample_rate, double freq, double q, double gain_db);
+
+// Initialize an empty bank
+//   bank:        the bank to be initialized
+//   sample_rate: the sampling rate (in Hz) of the input
+//   rms_time:    time constant (in seconds) of the RMS outputs
+void biquad_bank_init (biquad_bank* bank, double sample_rate, double rms_time);
+
+// Add a band made of a cascade of biquads. Return its index, or -1 if the bank is full.
+//   bank:       an initialized bank
+//   stages:     input array of length num_stages
+//   num_stages: at most BIQUAD_MAX_STAGES
+int biquad_bank_add (biquad_bank* bank, biquad* stages, size_t num_stages);
+
+// Run every band over count input samples, updating output and rms
+//   bank:  an initialized bank
+//   in:    input array of length count
+//   count: the number of samples
+void biquad_bank_push (biquad_bank* bank, float* in, size_t count);
+
+// Clear the filter state and levels of every band, keeping the bands
+void biquad_bank_reset (biquad_bank* bank);
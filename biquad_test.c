@@ -0,0 +1,54 @@
+#include "biquad.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#define SAMPLE_RATE 44100.0
+
+// Test the steady state RMS of every band of a bank fed with a unit sine
+bool bank_test (double freq, double* expected, double tolerance)
+{
+    biquad_bank bank;
+    biquad_bank_init(&bank, SAMPLE_RATE, 0.01);
+    biquad low[]  = {biquad_lowpass(SAMPLE_RATE, 300, M_SQRT1_2), biquad_lowpass(SAMPLE_RATE, 300, M_SQRT1_2)};
+    biquad band[] = {biquad_bandpass(SAMPLE_RATE, 1000, 2)};
+    biquad high[] = {biquad_highpass(SAMPLE_RATE, 5000, M_SQRT1_2)};
+    biquad peak[] = {biquad_peaking(SAMPLE_RATE, 1000, 1, 6)};
+    biquad_bank_add(&bank, low, 2);
+    biquad_bank_add(&bank, band, 1);
+    biquad_bank_add(&bank, high, 1);
+    biquad_bank_add(&bank, peak, 1);
+
+    float block[64];
+    for (size_t i = 0; i < SAMPLE_RATE/2; i += 64)
+    {
+        for (size_t j = 0; j < 64; ++j) block[j] = sin(2*M_PI*freq*(i+j)/SAMPLE_RATE);
+        biquad_bank_push(&bank, block, 64);
+    }
+
+    bool pass = true;
+    for (size_t b = 0; b < bank.num_bands; ++b)
+    {
+        if (fabs(bank.rms[b] - expected[b]) > tolerance)
+        {
+            fprintf(stderr, "FAILED: biquad bank\n");
+            fprintf(stderr, "    Frequency: %.0f\n", freq);
+            fprintf(stderr, "    Band %zu RMS = %f (expected %f)\n\n", b, bank.rms[b], expected[b]);
+            pass = false;
+        }
+    }
+    return pass;
+}
+
+int main (void)
+{
+    double unit = M_SQRT1_2;
+    double at_1000[]  = {0.0,  unit, 0.0,  2*unit};
+    double at_50[]    = {unit, 0.0,  0.0,  unit};
+    double at_15000[] = {0.0,  0.0,  unit, unit};
+    bool pass = bank_test(1000, at_1000, 0.05);
+    pass = bank_test(50, at_50, 0.05) && pass;
+    pass = bank_test(15000, at_15000, 0.05) && pass;
+    return pass ? 0 : 1;
+}
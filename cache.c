@@ -0,0 +1,136 @@
+#include "cache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define FNV_PRIME 0x100000001b3ULL
+
+// Create a directory if it doesn't exist yet; return false if it can't be created
+static bool make_dir (const char* path)
+{
+    return mkdir(path, 0777) == 0 || errno == EEXIST;
+}
+
+bool cache_init (cache* c, const char* dir)
+{
+    c->dir = strdup(dir);
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/paths", dir);
+    return make_dir(dir) && make_dir(path);
+}
+
+uint64_t cache_hash (const void* data, size_t size, uint64_t seed)
+{
+    const unsigned char* bytes = data;
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+// Hash a file's contents through *hash; return false if it can't be read
+static bool hash_contents (const char* path, const struct stat* status, uint64_t* hash)
+{
+    *hash = CACHE_SEED;
+    if (status->st_size == 0) return true;
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) return false;
+    void* map = mmap(NULL, status->st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return false;
+    madvise(map, status->st_size, MADV_SEQUENTIAL);
+    *hash = cache_hash(map, status->st_size, CACHE_SEED);
+    munmap(map, status->st_size);
+    return true;
+}
+
+// Return a file's modification time in nanoseconds
+static long long modified_ns (const struct stat* status)
+{
+#ifdef __APPLE__
+    return status->st_mtimespec.tv_sec*1000000000LL + status->st_mtimespec.tv_nsec;
+#else
+    return status->st_mtim.tv_sec*1000000000LL + status->st_mtim.tv_nsec;
+#endif
+}
+
+bool cache_file_hash (cache* c, const char* path, uint64_t* hash)
+{
+    struct stat status;
+    if (stat(path, &status) == -1) return false;
+
+    // A remembered hash is only trusted if the file hasn't changed since
+    char memo[4096];
+    snprintf(memo, sizeof(memo), "%s/paths/%016" PRIx64, c->dir, cache_hash(path, strlen(path), CACHE_SEED));
+    FILE* f = fopen(memo, "r");
+    if (f)
+    {
+        long long size, mtime;
+        unsigned long long inode;
+        bool found = fscanf(f, "%lld %lld %llu %" SCNx64, &size, &mtime, &inode, hash) == 4 &&
+                     size == status.st_size && mtime == modified_ns(&status) && inode == status.st_ino;
+        fclose(f);
+        if (found) return true;
+    }
+
+    if (!hash_contents(path, &status, hash)) return false;
+    char temp[sizeof(memo) + 8];
+    snprintf(temp, sizeof(temp), "%s.XXXXXX", memo);
+    int fd = mkstemp(temp);
+    if (fd == -1) return true;
+    f = fdopen(fd, "w");
+    if (f == NULL)
+    {
+        close(fd);
+        unlink(temp);
+        return true;
+    }
+    fprintf(f, "%lld %lld %llu %016" PRIx64 "\n", (long long)status.st_size, modified_ns(&status),
+            (unsigned long long)status.st_ino, *hash);
+    if (fclose(f) != 0 || rename(temp, memo) != 0) unlink(temp);
+    return true;
+}
+
+void cache_entry_path (cache* c, uint64_t content, uint64_t config, char* path, size_t size)
+{
+    snprintf(path, size, "%s/%02x/%016" PRIx64 "-%016" PRIx64, c->dir, (unsigned)(content >> 56), content, config);
+}
+
+bool cache_temp_path (cache* c, uint64_t content, char* path, size_t size)
+{
+    snprintf(path, size, "%s/%02x", c->dir, (unsigned)(content >> 56));
+    if (!make_dir(path)) return false;
+    size_t length = strlen(path);
+    snprintf(path + length, size - length, "/tmp.XXXXXX");
+    int fd = mkstemp(path);
+    if (fd == -1) return false;
+    close(fd);
+    return true;
+}
+
+bool cache_commit (cache* c, const char* temp, uint64_t content, uint64_t config)
+{
+    char path[4096];
+    cache_entry_path(c, content, config, path, sizeof(path));
+    if (rename(temp, path) == 0) return true;
+    unlink(temp);
+    return false;
+}
+
+void cache_cleanup (cache* c)
+{
+    free(c->dir);
+    c->dir = NULL;
+}
@@ -0,0 +1,65 @@
+// Content-addressed analysis cache
+//
+// Entries are keyed by a hash of a sound file's contents together with a hash of the
+// configuration that produced them, so renaming or copying a file keeps its entries, and
+// changing a parameter only misses the entries that depend on it. Hashing a whole file is
+// slow, so content hashes are remembered per path, together with the size, modification
+// time in nanoseconds and inode they were computed for. Entries are written to a temporary
+// file and renamed into place, so concurrent writers never expose a partial entry.
+//
+// Layout of a cache directory:
+//   paths/<path hash>                  the content hash of a file path, with its size, mtime and inode
+//   <xx>/<content hash>-<config hash>  entries, in subdirectories by the first byte of the content hash
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define CACHE_SEED 0xcbf29ce484222325ULL // FNV-1a offset basis
+
+typedef struct
+{
+    char* dir;
+} cache;
+
+// Open a cache directory, creating it if needed; return false if it can't be created
+//   c:   the cache to be initialized
+//   dir: the cache directory
+bool cache_init (cache* c, const char* dir);
+
+// Return the FNV-1a hash of some data
+//   data: the data to be hashed
+//   size: the size of data in bytes
+//   seed: CACHE_SEED, or the hash of preceding data to hash both together
+uint64_t cache_hash (const void* data, size_t size, uint64_t seed);
+
+// Return the content hash of a file through *hash; return false if it can't be read
+//   c:    an initialized cache
+//   path: the file
+//   hash: output content hash
+bool cache_file_hash (cache* c, const char* path, uint64_t* hash);
+
+// Write the path of an entry, whether or not it exists
+//   c:       an initialized cache
+//   content: the content hash of the source file
+//   config:  the hash of the configuration
+//   path:    output path
+//   size:    the size of path
+void cache_entry_path (cache* c, uint64_t content, uint64_t config, char* path, size_t size);
+
+// Write the path of a new temporary file next to an entry, to be renamed into place with
+// cache_commit or removed; return false if it can't be created
+//   c:       an initialized cache
+//   content: the content hash of the source file
+//   path:    output path
+//   size:    the size of path
+bool cache_temp_path (cache* c, uint64_t content, char* path, size_t size);
+
+// Move a complete temporary file into place as an entry; return false if it fails
+//   c:       an initialized cache
+//   temp:    a path from cache_temp_path
+//   content: the content hash of the source file
+//   config:  the hash of the configuration
+bool cache_commit (cache* c, const char* temp, uint64_t content, uint64_t config);
+
+// Release the cache
+void cache_cleanup (cache* c);
@@ -0,0 +1,87 @@
+#include "cache.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Test the hash against published FNV-1a values, and chaining
+bool hash_test ()
+{
+    bool pass = cache_hash("", 0, CACHE_SEED) == 0xcbf29ce484222325ULL &&
+                cache_hash("a", 1, CACHE_SEED) == 0xaf63dc4c8601ec8cULL &&
+                cache_hash("foobar", 6, CACHE_SEED) == 0x85944171f73967e8ULL &&
+                cache_hash("bar", 3, cache_hash("foo", 3, CACHE_SEED)) == 0x85944171f73967e8ULL;
+    if (!pass) fprintf(stderr, "FAILED: hash\n    FNV-1a mismatch\n");
+    return pass;
+}
+
+static void write_file (const char* path, const char* contents)
+{
+    FILE* f = fopen(path, "w");
+    fputs(contents, f);
+    fclose(f);
+}
+
+// Test that content hashes follow the contents of a file, not its path
+bool file_hash_test (cache* c, const char* dir)
+{
+    char first[4096], second[4096];
+    snprintf(first, sizeof(first), "%s/first.wav", dir);
+    snprintf(second, sizeof(second), "%s/second.wav", dir);
+    write_file(first, "some audio");
+    write_file(second, "some audio");
+
+    uint64_t a, b, again, changed;
+    bool pass = cache_file_hash(c, first, &a) && cache_file_hash(c, second, &b) && cache_file_hash(c, first, &again);
+    pass = pass && a == b && a == again && a == cache_hash("some audio", 10, CACHE_SEED);
+
+    // A different size invalidates the remembered hash
+    write_file(first, "other audio");
+    pass = pass && cache_file_hash(c, first, &changed) && changed == cache_hash("other audio", 11, CACHE_SEED);
+    // So does a rewrite of the same size within the same second
+    write_file(first, "other video");
+    pass = pass && cache_file_hash(c, first, &changed) && changed == cache_hash("other video", 11, CACHE_SEED);
+    pass = pass && !cache_file_hash(c, "/nonexistent/file.wav", &changed);
+    if (!pass) fprintf(stderr, "FAILED: file hash\n    %016llx %016llx\n", (unsigned long long)a, (unsigned long long)b);
+
+    unlink(first);
+    unlink(second);
+    return pass;
+}
+
+// Test that a committed temporary file becomes the entry, and only that entry
+bool entry_test (cache* c)
+{
+    char temp[4096], entry[4096], other[4096];
+    bool pass = cache_temp_path(c, 0x1234, temp, sizeof(temp));
+    if (pass)
+    {
+        write_file(temp, "features");
+        pass = cache_commit(c, temp, 0x1234, 0x5678);
+    }
+    cache_entry_path(c, 0x1234, 0x5678, entry, sizeof(entry));
+    cache_entry_path(c, 0x1234, 0x5679, other, sizeof(other));
+    pass = pass && access(entry, F_OK) == 0 && access(other, F_OK) != 0 && access(temp, F_OK) != 0;
+    if (!pass) fprintf(stderr, "FAILED: entry\n    %s\n", entry);
+    unlink(entry);
+    return pass;
+}
+
+int main (void)
+{
+    char dir[] = "/tmp/cache_test_XXXXXX";
+    if (!mkdtemp(dir)) return 1;
+    char cache_dir[4096];
+    snprintf(cache_dir, sizeof(cache_dir), "%s/cache", dir);
+    cache c;
+    bool pass = cache_init(&c, cache_dir) && hash_test() && file_hash_test(&c, dir) && entry_test(&c);
+    cache_cleanup(&c);
+
+    char command[4200];
+    snprintf(command, sizeof(command), "rm -rf %s", dir);
+    system(command);
+    return pass ? 0 : 1;
+}
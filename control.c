@@ -0,0 +1,76 @@
+#include "control.h"
+#include "backend.h"
+#include "dywapitchtrack.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+void control_init (control* c, void (*write) (int message, void* context), void* context)
+{
+    c->write      = write;
+    c->context    = context;
+    c->channel    = 0;
+    c->angle      = 0;
+    c->send_angle = false;
+    c->centroid   = 0;
+}
+
+int control_update (control* c)
+{
+    if (onset_average_amplitude>ONSET_THRESHOLD)
+    {
+        if (!note_on)
+        {
+            c->write(CONTROL_MESSAGE(0x90|c->channel, CONTROL_NOTE, 100/*(int)average_amplitude*/), c->context);
+            note_on = 1;
+        }
+        //0x2000 is 185 hz, 0x0000 is 73.416, 0x3fff is 466.16
+        double midiNumber = 12 * log2(dominant_frequency_lp/440) + 69;
+        int outputPitch = (int)((midiNumber-CONTROL_BEND_LOW)/(CONTROL_BEND_HIGH-CONTROL_BEND_LOW)*0x3FFF);
+        if (outputPitch > 0x3FFF) outputPitch = 0x3FFF;
+        if (outputPitch < 0x0000) outputPitch = 0x0000;
+
+        int outputCentroid = (int)((spectral_centroid-500)/300*127);
+        if (outputCentroid > 127) outputCentroid = 127;
+        if (outputCentroid < 000) outputCentroid = 000;
+        if (prev_spectral_centroid != -INFINITY){
+            if (abs(outputCentroid-(int)prev_spectral_centroid)>127){
+                outputCentroid = prev_spectral_centroid;
+            }
+            else prev_spectral_centroid = outputCentroid;
+        }
+        else prev_spectral_centroid = outputCentroid;
+
+        if (prev_output_pitch != -INFINITY){
+            if ((outputPitch == 0) || (outputPitch == 0x3FFF)){
+                outputPitch = prev_output_pitch;
+            }
+            else prev_output_pitch = outputPitch;
+        }
+        else prev_output_pitch = outputPitch;
+        int lsb_7 = outputPitch&0x7F;
+        int msb_7 = (outputPitch>>7)&0x7F;
+
+        if (c->send_angle) c->write(CONTROL_MESSAGE(0xB0/*|c->channel*/, 0, c->angle), c->context);
+        c->write(CONTROL_MESSAGE(0xB0/*|c->channel*/, 1, outputCentroid), c->context);
+        c->write(CONTROL_MESSAGE(0xE0|c->channel, lsb_7, msb_7), c->context);
+        c->centroid = outputCentroid;
+        return CONTROL_UPDATE;
+    }
+    else if (onset_average_amplitude<OFFSET_THRESHOLD && note_on)
+    {
+        c->write(CONTROL_MESSAGE(0x80|c->channel, CONTROL_NOTE, 100), c->context);
+        note_on = 0;
+        dywapitch_inittracking(&pitch_tracker);
+        prev_spectral_centroid = -INFINITY;
+        prev_output_pitch = -INFINITY;
+        return CONTROL_NOTE_OFF;
+    }
+    return CONTROL_IDLE;
+}
+
+double control_bend_frequency (int bend)
+{
+    double midi = CONTROL_BEND_LOW + bend*(CONTROL_BEND_HIGH-CONTROL_BEND_LOW)/0x3FFF;
+    return 440*pow(2, (midi-69)/12);
+}
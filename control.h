@@ -0,0 +1,43 @@
+// Note control
+//
+// Turns the backend's onset detection, pitch and spectral centroid into MIDI: a note on when
+// the onset level rises, then a pitch bend and a centroid controller on every update while
+// it stays up, and a note off once it falls. Messages are written to a sink, so the same
+// logic drives PortMidi on stage and a recording sink in the latency harness.
+#include <stdbool.h>
+
+// A MIDI message, packed like Pm_Message
+#define CONTROL_MESSAGE(status, data1, data2) \
+    ((((data2) << 16) & 0xFF0000) | (((data1) << 8) & 0xFF00) | ((status) & 0xFF))
+#define CONTROL_NOTE      54
+#define CONTROL_BEND_LOW  38.0 // MIDI note of pitch bend 0x0000
+#define CONTROL_BEND_HIGH 70.0 // MIDI note of pitch bend 0x3FFF
+
+// What control_update did
+#define CONTROL_IDLE     0 // Nothing was sent
+#define CONTROL_UPDATE   1 // Pitch bend and centroid were sent, after a note on if the note was off
+#define CONTROL_NOTE_OFF 2 // The note was turned off
+
+typedef struct
+{
+    void  (*write) (int message, void* context); // The MIDI sink
+    void*   context;
+    int     channel;    // MIDI channel of the note and pitch bend
+    int     angle;      // Value of controller 0,
+    bool    send_angle; // sent with every update if set
+    int     centroid;   // The last centroid controller value sent
+} control;
+
+// Initialize note control on channel 0
+//   c:       the control to be initialized
+//   write:   called with every MIDI message
+//   context: passed to write
+void control_init (control* c, void (*write) (int message, void* context), void* context);
+
+// Send whatever the backend's current state calls for; return what was done (CONTROL_*)
+//   c: an initialized control
+int control_update (control* c);
+
+// Return the frequency (in Hz) a pitch bend value stands for
+//   bend: the 14 bit pitch bend value
+double control_bend_frequency (int bend);
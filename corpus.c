@@ -0,0 +1,261 @@
+#include "corpus.h"
+#include "tinydir.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Files [front, back) of items are still to be processed
+typedef struct
+{
+    pthread_mutex_t lock;
+    size_t*         items;
+    size_t          front;
+    size_t          back;
+} deque;
+
+typedef struct
+{
+    manifest*       m;
+    corpus_job*     job;
+    FILE*           out;
+    size_t          num_workers;
+    deque*          deques;
+    pthread_mutex_t output_lock;
+    pthread_cond_t  output_done; // Signalled when next_output advances
+    char**          buffers;     // Output of every finished file not yet written
+    size_t*         sizes;
+    bool*           done;
+    atomic_size_t   next_output; // First file whose output is not written yet; only advanced under output_lock
+    size_t          failures;
+} corpus;
+
+typedef struct
+{
+    corpus*   c;
+    size_t    id;
+    pthread_t thread;
+} corpus_worker;
+
+void manifest_init (manifest* m)
+{
+    m->paths = NULL;
+    m->count = 0;
+}
+
+static void manifest_add_file (manifest* m, const char* path)
+{
+    m->paths = realloc(m->paths, sizeof(char*) * (m->count+1));
+    m->paths[m->count++] = strdup(path);
+}
+
+// Return true iff str ends with suffix
+static bool ends_with (const char* str, const char* suffix)
+{
+    size_t strl = strlen(str);
+    size_t sufl = strlen(suffix);
+    if (sufl > strl) return false;
+    return strcmp(str + strl - sufl, suffix) == 0;
+}
+
+static void manifest_add_dir (manifest* m, const char* path, const char* suffix)
+{
+    tinydir_dir dir;
+    if (tinydir_open_sorted(&dir, path) == -1)
+    {
+        fprintf(stderr, "Failed to open directory: %s\n", path);
+        return;
+    }
+    for (size_t i = 0; i < dir.n_files; ++i)
+    {
+        tinydir_file file;
+        tinydir_readfile_n(&dir, &file, i);
+        if (file.name[0] == '.') continue;
+        if (file.is_dir)                       manifest_add_dir(m, file.path, suffix);
+        else if (ends_with(file.name, suffix)) manifest_add_file(m, file.path);
+    }
+    tinydir_close(&dir);
+}
+
+bool manifest_add (manifest* m, const char* path, const char* suffix)
+{
+    struct stat status;
+    if (stat(path, &status) == -1) return false;
+    if (S_ISDIR(status.st_mode)) manifest_add_dir(m, path, suffix);
+    else                         manifest_add_file(m, path);
+    return true;
+}
+
+void manifest_cleanup (manifest* m)
+{
+    for (size_t i = 0; i < m->count; ++i) free(m->paths[i]);
+    free(m->paths);
+    manifest_init(m);
+}
+
+// Take a file below limit from the front of a deque, or from its back when stealing;
+// return false if there is none
+static bool take_from (deque* d, bool steal, size_t limit, size_t* file)
+{
+    pthread_mutex_lock(&d->lock);
+    bool found = d->front < d->back;
+    if (found)
+    {
+        // Items are in order: steal from the back if it's within the limit, else from the front
+        if      (steal && d->items[d->back-1] < limit) *file = d->items[--d->back];
+        else if (d->items[d->front] < limit)           *file = d->items[d->front++];
+        else                                           found = false;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return found;
+}
+
+// Take the next file from a worker's own deque, or steal one from another, among the files
+// less than CORPUS_FILES_IN_FLIGHT per worker ahead of the next output; wait while none is,
+// and return false once every deque is empty. Only a worker with nothing to take locks
+// output_lock, to wait for the next output to advance. The next output is always the front
+// of its deque until taken, so some file can always be taken or finished.
+static bool take (corpus* c, size_t id, size_t* file)
+{
+    while (true)
+    {
+        size_t next = atomic_load_explicit(&c->next_output, memory_order_acquire);
+        size_t limit = next + CORPUS_FILES_IN_FLIGHT*c->num_workers;
+        for (size_t i = 0; i < c->num_workers; ++i)
+            if (take_from(&c->deques[(id + i) % c->num_workers], i > 0, limit, file)) return true;
+
+        // Deques only shrink, so once they are all empty they stay empty
+        bool empty = true;
+        for (size_t i = 0; i < c->num_workers && empty; ++i)
+        {
+            deque* d = &c->deques[i];
+            pthread_mutex_lock(&d->lock);
+            empty = d->front == d->back;
+            pthread_mutex_unlock(&d->lock);
+        }
+        if (empty) return false;
+
+        pthread_mutex_lock(&c->output_lock);
+        while (atomic_load_explicit(&c->next_output, memory_order_relaxed) == next)
+            pthread_cond_wait(&c->output_done, &c->output_lock);
+        pthread_mutex_unlock(&c->output_lock);
+    }
+}
+
+// Record a finished file and write out every output that is now in order
+static void finish (corpus* c, size_t file, char* buffer, size_t size, bool ok)
+{
+    pthread_mutex_lock(&c->output_lock);
+    c->buffers[file] = buffer;
+    c->sizes[file] = size;
+    c->done[file] = true;
+    if (!ok) ++c->failures;
+    size_t next;
+    while ((next = atomic_load_explicit(&c->next_output, memory_order_relaxed)) < c->m->count && c->done[next])
+    {
+        atomic_store_explicit(&c->next_output, next + 1, memory_order_release);
+        if (c->job->output) c->job->output(next, c->buffers[next], c->sizes[next], c->job->context);
+        else                fwrite(c->buffers[next], 1, c->sizes[next], c->out);
+        free(c->buffers[next]);
+        c->buffers[next] = NULL;
+    }
+    pthread_cond_broadcast(&c->output_done);
+    pthread_mutex_unlock(&c->output_lock);
+}
+
+static void* corpus_work (void* arg)
+{
+    corpus_worker* w = arg;
+    corpus* c = w->c;
+    corpus_job* job = c->job;
+    if (job->worker_init) job->worker_init(job->context);
+    size_t file;
+    while (take(c, w->id, &file))
+    {
+        char* buffer = NULL;
+        size_t size = 0;
+        FILE* out = open_memstream(&buffer, &size);
+        bool ok = out != NULL;
+        if (ok)
+        {
+            ok = job->process(file, c->m->paths[file], out, job->context);
+            if (fclose(out) != 0) ok = false;
+        }
+        else fprintf(stderr, "Failed to buffer the output of: %s\n", c->m->paths[file]);
+        finish(c, file, buffer, size, ok);
+    }
+    if (job->worker_cleanup) job->worker_cleanup(job->context);
+    return NULL;
+}
+
+size_t corpus_run (manifest* m, corpus_job* job, size_t num_threads, FILE* out)
+{
+    if (num_threads < 1) num_threads = 1;
+    if (num_threads > m->count && m->count > 0) num_threads = m->count;
+
+    corpus c;
+    c.m           = m;
+    c.job         = job;
+    c.out         = out;
+    c.num_workers = num_threads;
+    c.deques      = calloc(num_threads, sizeof(deque));
+    c.buffers     = calloc(m->count, sizeof(char*));
+    c.sizes       = calloc(m->count, sizeof(size_t));
+    c.done        = calloc(m->count, sizeof(bool));
+    atomic_init(&c.next_output, 0);
+    c.failures    = 0;
+    pthread_mutex_init(&c.output_lock, NULL);
+    pthread_cond_init(&c.output_done, NULL);
+
+    // Deal files round robin, so the files being worked on stay close to the next output
+    for (size_t w = 0; w < num_threads; ++w)
+    {
+        deque* d = &c.deques[w];
+        pthread_mutex_init(&d->lock, NULL);
+        d->items = malloc(sizeof(size_t) * (m->count/num_threads + 1));
+        d->front = d->back = 0;
+        for (size_t file = w; file < m->count; file += num_threads) d->items[d->back++] = file;
+    }
+
+    // Files dealt to a worker that doesn't start are stolen by the others; with no worker
+    // thread at all, the calling thread does the work
+    corpus_worker workers[num_threads];
+    size_t num_started = 0;
+    for (size_t w = 0; w < num_threads; ++w)
+    {
+        workers[w].c  = &c;
+        workers[w].id = w;
+        if (pthread_create(&workers[w].thread, NULL, corpus_work, &workers[w]) != 0)
+        {
+            fprintf(stderr, "Failed to start worker thread %zu of %zu; running with %zu\n", w+1, num_threads, w > 0 ? w : 1);
+            break;
+        }
+        ++num_started;
+    }
+    if (num_started == 0) corpus_work(&workers[0]);
+    for (size_t w = 0; w < num_started; ++w) pthread_join(workers[w].thread, NULL);
+
+    for (size_t w = 0; w < num_threads; ++w)
+    {
+        pthread_mutex_destroy(&c.deques[w].lock);
+        free(c.deques[w].items);
+    }
+    pthread_mutex_destroy(&c.output_lock);
+    pthread_cond_destroy(&c.output_done);
+    free(c.deques);
+    free(c.buffers);
+    free(c.sizes);
+    free(c.done);
+    return c.failures;
+}
+
+size_t corpus_threads ()
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? count : 1;
+}
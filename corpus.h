@@ -0,0 +1,56 @@
+// Parallel corpus runner
+//
+// A corpus is scanned once into a manifest: every matching file below a set of roots, in
+// sorted order. Files are then processed on a pool of worker threads. Each worker owns a
+// deque of files, dealt round robin; it takes files from the front of its own deque, and
+// once that is empty it steals from the back of the others. Every file writes its output
+// to a private buffer, and buffers are written out in manifest order as soon as all the
+// files before them are done, so the output is the same for any number of threads. To bound
+// the buffered output, no file is started CORPUS_FILES_IN_FLIGHT per worker or more beyond
+// the next one to be written.
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define CORPUS_FILES_IN_FLIGHT 4 // Per worker
+
+typedef struct
+{
+    char** paths;
+    size_t count;
+} manifest;
+
+typedef struct
+{
+    // Process one file, writing its output to out; return false if it failed
+    bool  (*process) (size_t index, const char* path, FILE* out, void* context);
+    // Called on every worker thread before its first file and after its last (may be NULL)
+    void  (*worker_init) (void* context);
+    void  (*worker_cleanup) (void* context);
+    // Called with every file's output in manifest order, instead of writing it to out (may be NULL)
+    void  (*output) (size_t index, const char* data, size_t size, void* context);
+    void*   context;
+} corpus_job;
+
+// Initialize an empty manifest
+void manifest_init (manifest* m);
+
+// Add a file, or every file below a directory whose name ends with suffix, in sorted order.
+// Return false if path does not exist.
+//   m:      an initialized manifest
+//   path:   a file or directory
+//   suffix: the ending of files to be added from directories, e.g. ".wav"
+bool manifest_add (manifest* m, const char* path, const char* suffix);
+
+// Release the manifest's paths
+void manifest_cleanup (manifest* m);
+
+// Return the number of files that failed
+//   m:           the files to be processed
+//   job:         what to do with each file
+//   num_threads: the number of worker threads
+//   out:         every file's output, in manifest order, unless job has an output function
+size_t corpus_run (manifest* m, corpus_job* job, size_t num_threads, FILE* out);
+
+// Return the number of processors online
+size_t corpus_threads ();
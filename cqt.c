@@ -0,0 +1,175 @@
+#include "cqt.h"
+#include "plans.h"
+
+#include <fftw3.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG_FLOOR 1e-3 // Added to powers (relative to the strongest bin) before taking their log
+
+void cqt_init (cqt* c, size_t fft_size, double sample_rate, double min_freq, size_t num_bins, size_t bins_per_octave)
+{
+    c->fft_size        = fft_size;
+    c->num_bins        = num_bins;
+    c->bins_per_octave = bins_per_octave;
+    c->min_freq        = min_freq;
+    c->start           = calloc(num_bins, sizeof(size_t));
+    c->length          = calloc(num_bins, sizeof(size_t));
+    c->offset          = calloc(num_bins, sizeof(size_t));
+    c->kernel          = NULL;
+    c->history_loc     = 0;
+    c->history         = calloc(2*fft_size, sizeof(double));
+    c->spectrum        = fftw_malloc(sizeof(fftw_complex) * (fft_size/2+1));
+
+    size_t num_freqs = fft_size/2+1;
+    double*       real      = calloc(fft_size, sizeof(double));
+    double*       imag      = calloc(fft_size, sizeof(double));
+    fftw_complex* real_spec = fftw_malloc(sizeof(fftw_complex) * num_freqs);
+    fftw_complex* imag_spec = fftw_malloc(sizeof(fftw_complex) * num_freqs);
+    fftw_complex* spec      = fftw_malloc(sizeof(fftw_complex) * num_freqs);
+
+    double q = 1/(pow(2, 1.0/bins_per_octave) - 1);
+    size_t total = 0;
+    for (size_t k = 0; k < num_bins; ++k)
+    {
+        // Hamming windowed complex exponential ending at the last sample of the frame, scaled
+        // so a unit sine has an amplitude of 1
+        double freq = cqt_bin_frequency(c, k);
+        size_t size = ceil(q*sample_rate/freq);
+        if (size > fft_size) size = fft_size;
+        double window_sum = 0;
+        for (size_t n = 0; n < size; ++n) window_sum += 0.54 - 0.46*cos(2*M_PI*n/(size-1));
+        memset(real, 0, sizeof(double) * fft_size);
+        memset(imag, 0, sizeof(double) * fft_size);
+        for (size_t n = 0; n < size; ++n)
+        {
+            double w = 2*(0.54 - 0.46*cos(2*M_PI*n/(size-1)))/window_sum;
+            real[fft_size-size+n] = w*cos(2*M_PI*freq*n/sample_rate);
+            imag[fft_size-size+n] = w*sin(2*M_PI*freq*n/sample_rate);
+        }
+
+        // The transform of real + i*imag, from the transforms of the two real parts
+        fftw_execute_dft_r2c(plan_r2c(fft_size), real, real_spec);
+        fftw_execute_dft_r2c(plan_r2c(fft_size), imag, imag_spec);
+        double peak = 0;
+        for (size_t j = 0; j < num_freqs; ++j)
+        {
+            spec[j][0] = real_spec[j][0] - imag_spec[j][1];
+            spec[j][1] = real_spec[j][1] + imag_spec[j][0];
+            double mag = hypot(spec[j][0], spec[j][1]);
+            if (mag > peak) peak = mag;
+        }
+
+        // Keep the span above the threshold, conjugated and with the 1/N of Parseval's theorem
+        size_t first = 0, last = num_freqs-1;
+        while (first < last && hypot(spec[first][0], spec[first][1]) < CQT_THRESHOLD*peak) ++first;
+        while (last > first && hypot(spec[last][0], spec[last][1]) < CQT_THRESHOLD*peak) --last;
+        c->start[k]  = first;
+        c->length[k] = last - first + 1;
+        c->offset[k] = total;
+        total += c->length[k];
+        c->kernel = realloc(c->kernel, sizeof(fftw_complex) * total);
+        for (size_t j = 0; j < c->length[k]; ++j)
+        {
+            c->kernel[c->offset[k] + j][0] =  spec[first + j][0]/fft_size;
+            c->kernel[c->offset[k] + j][1] = -spec[first + j][1]/fft_size;
+        }
+    }
+
+    free(real);
+    free(imag);
+    fftw_free(real_spec);
+    fftw_free(imag_spec);
+    fftw_free(spec);
+}
+
+void cqt_push (cqt* c, double* in, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        c->history[c->history_loc] = in[i];
+        c->history[c->history_loc + c->fft_size] = in[i];
+        if (++c->history_loc == c->fft_size) c->history_loc = 0;
+    }
+}
+
+void cqt_compute (cqt* c, double* mag)
+{
+    fftw_execute_dft_r2c(plan_r2c(c->fft_size), c->history + c->history_loc, c->spectrum);
+    for (size_t k = 0; k < c->num_bins; ++k)
+    {
+        fftw_complex* x = c->spectrum + c->start[k];
+        fftw_complex* kernel = c->kernel + c->offset[k];
+        double re = 0, im = 0;
+        for (size_t j = 0; j < c->length[k]; ++j)
+        {
+            re += x[j][0]*kernel[j][0] - x[j][1]*kernel[j][1];
+            im += x[j][0]*kernel[j][1] + x[j][1]*kernel[j][0];
+        }
+        mag[k] = re*re + im*im;
+    }
+}
+
+double cqt_bin_frequency (cqt* c, double bin)
+{
+    return c->min_freq*pow(2, bin/c->bins_per_octave);
+}
+
+double cqt_pitch (cqt* c, double* mag, int num_harmonics, double max_freq)
+{
+    size_t num_candidates = c->num_bins;
+    double top = c->bins_per_octave*log2(max_freq/c->min_freq) + 1;
+    if (top < num_candidates) num_candidates = top > 0 ? top : 0;
+    if (num_candidates < 3) return -INFINITY;
+
+    // Harmonic h lies bins_per_octave*log2(h) bins above the fundamental. Candidates score the
+    // mean log power of their harmonics, so a single strong partial cannot outvote a full series.
+    // Weighting harmonic h by 1/h breaks the tie between a pure tone and its octave below.
+    size_t harmonic_offset[num_harmonics];
+    for (int h = 0; h < num_harmonics; ++h)
+        harmonic_offset[h] = floor(c->bins_per_octave*log2(h+1) + 0.5);
+    double peak = 0;
+    for (size_t k = 0; k < c->num_bins; ++k) if (mag[k] > peak) peak = mag[k];
+    if (peak <= 0) return -INFINITY;
+    double score[num_candidates];
+    size_t best = 0;
+    for (size_t k = 0; k < num_candidates; ++k)
+    {
+        double weights = 0;
+        score[k] = 0;
+        for (int h = 0; h < num_harmonics && k + harmonic_offset[h] < c->num_bins; ++h)
+        {
+            score[k] += log(mag[k + harmonic_offset[h]]/peak + LOG_FLOOR)/(h+1);
+            weights += 1.0/(h+1);
+        }
+        score[k] /= weights;
+        if (score[k] > score[best]) best = k;
+    }
+
+    double delta = 0;
+    if (best > 0 && best+1 < num_candidates)
+    {
+        double left = score[best-1], center = score[best], right = score[best+1];
+        double denominator = left - 2*center + right;
+        if (denominator != 0) delta = 0.5*(left - right)/denominator;
+    }
+    return cqt_bin_frequency(c, best + delta);
+}
+
+void cqt_reset (cqt* c)
+{
+    c->history_loc = 0;
+    memset(c->history, 0, sizeof(double) * 2*c->fft_size);
+}
+
+void cqt_cleanup (cqt* c)
+{
+    free(c->start);
+    free(c->length);
+    free(c->offset);
+    free(c->kernel);
+    free(c->history);
+    fftw_free(c->spectrum);
+}
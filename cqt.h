@@ -0,0 +1,68 @@
+// Constant-Q transform
+//
+// Brown and Puckette's method: the spectrum of every bin's windowed complex exponential
+// is precomputed once, and only its significant span is kept. A frame then costs one
+// real FFT plus a short complex dot product per bin. Kernels end at the newest sample
+// of the frame, so high bins, which have short kernels, react as quickly as they can.
+#include <fftw3.h>
+
+#include <stdlib.h>
+
+#define CQT_THRESHOLD 0.01 // Kernel bins below this fraction of the kernel's peak are dropped
+
+typedef struct
+{
+    size_t        fft_size;
+    size_t        num_bins;
+    size_t        bins_per_octave;
+    double        min_freq;
+    size_t*       start;    // First FFT bin of each kernel's span (num_bins)
+    size_t*       length;   // FFT bins in each kernel's span (num_bins)
+    size_t*       offset;   // Index of each kernel's span in kernel (num_bins)
+    fftw_complex* kernel;   // Conjugated kernel spectra, one span after another
+    size_t        history_loc; // Position of the oldest sample in history
+    double*       history;  // Last fft_size samples, stored twice so they can be read in one run
+    fftw_complex* spectrum; // Transform buffer (fft_size/2+1)
+} cqt;
+
+// Compute the kernels of a constant-Q transform and allocate its buffers
+//   c:               the transform to be initialized
+//   fft_size:        the frame length; kernels longer than the frame are shortened (and
+//                    their bins widened) to fit
+//   sample_rate:     the sampling rate (in Hz) of the input
+//   min_freq:        center frequency of the first bin
+//   num_bins:        the number of bins
+//   bins_per_octave: 12 for semitones, 1200 for cents
+void cqt_init (cqt* c, size_t fft_size, double sample_rate, double min_freq, size_t num_bins, size_t bins_per_octave);
+
+// Append samples to the frame, dropping the oldest ones
+//   c:     an initialized transform
+//   in:    input array of length count
+//   count: the number of samples pushed
+void cqt_push (cqt* c, double* in, size_t count);
+
+// Return the power of every bin over the last fft_size samples. A unit sine at the center
+// frequency of a bin gives that bin a power of 1.
+//   c:   an initialized transform
+//   mag: output array of length num_bins
+void cqt_compute (cqt* c, double* mag);
+
+// Return the center frequency of a bin (fractional bins are interpolated)
+//   c:   an initialized transform
+//   bin: the bin index
+double cqt_bin_frequency (cqt* c, double bin);
+
+// Return the pitch whose harmonics are strongest together, or -INFINITY if there is no power.
+// Harmonics of any pitch lie at the same bin offsets, so this is a harmonic product spectrum
+// over shifted copies of the transform.
+//   c:             an initialized transform
+//   mag:           power array of length num_bins, from cqt_compute
+//   num_harmonics: the number of harmonics combined
+//   max_freq:      the highest pitch considered
+double cqt_pitch (cqt* c, double* mag, int num_harmonics, double max_freq);
+
+// Clear the frame, as if the transform had only been fed silence
+void cqt_reset (cqt* c);
+
+// Release the transform's buffers
+void cqt_cleanup (cqt* c);
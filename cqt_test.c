@@ -0,0 +1,84 @@
+#include "cqt.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#define SAMPLE_RATE 11025.0
+#define FFT_SIZE    4096
+#define MIN_FREQ    55.0
+#define NUM_BINS    72
+
+// Fill the transform's frame with a tone, pushed in uneven chunks
+void push_tone (cqt* c, double freq, int num_harmonics)
+{
+    double chunk[100];
+    for (size_t i = 0; i < 2*FFT_SIZE; i += 100)
+    {
+        for (size_t j = 0; j < 100; ++j)
+        {
+            chunk[j] = 0;
+            for (int h = 1; h <= num_harmonics; ++h) chunk[j] += sin(2*M_PI*h*freq*(i+j)/SAMPLE_RATE)/h;
+        }
+        cqt_push(c, chunk, 100);
+    }
+}
+
+// Test that a sine at the center of a bin has unit power there, and leaks at most into
+// the neighbouring bins
+bool bin_test (size_t bin)
+{
+    cqt c;
+    cqt_init(&c, FFT_SIZE, SAMPLE_RATE, MIN_FREQ, NUM_BINS, 12);
+    push_tone(&c, cqt_bin_frequency(&c, bin), 1);
+    double mag[NUM_BINS];
+    cqt_compute(&c, mag);
+    cqt_cleanup(&c);
+
+    bool pass = fabs(mag[bin] - 1) < 0.05;
+    for (size_t k = 0; k < NUM_BINS; ++k)
+        if (k+1 < bin || k > bin+1) pass = pass && mag[k] < 0.01;
+    if (!pass)
+    {
+        fprintf(stderr, "FAILED: constant-Q bin\n");
+        fprintf(stderr, "    Bin: %zu\n", bin);
+        for (size_t k = 0; k < NUM_BINS; ++k) if (mag[k] > 0.001) fprintf(stderr, "    Bin %zu power = %f\n", k, mag[k]);
+        fprintf(stderr, "\n");
+    }
+    return pass;
+}
+
+// Test the pitch of a tone
+bool tone_pitch_test (double freq, int num_harmonics, double tolerance_cents)
+{
+    cqt c;
+    cqt_init(&c, FFT_SIZE, SAMPLE_RATE, MIN_FREQ, NUM_BINS, 12);
+    push_tone(&c, freq, num_harmonics);
+    double mag[NUM_BINS];
+    cqt_compute(&c, mag);
+    double pitch = cqt_pitch(&c, mag, 6, 1000);
+    cqt_cleanup(&c);
+
+    double cents = 1200*log2(pitch/freq);
+    if (!(fabs(cents) < tolerance_cents))
+    {
+        fprintf(stderr, "FAILED: constant-Q pitch\n");
+        fprintf(stderr, "    Harmonics: %d\n", num_harmonics);
+        fprintf(stderr, "    Pitch = %f (expected %f)\n\n", pitch, freq);
+        return false;
+    }
+    return true;
+}
+
+int main (void)
+{
+    bool pass = bin_test(3);
+    pass = bin_test(30) && pass;
+    pass = bin_test(70) && pass;
+    pass = tone_pitch_test(110, 5, 10) && pass;
+    pass = tone_pitch_test(330, 5, 10) && pass;
+    pass = tone_pitch_test(220*pow(2, 0.5/12), 5, 25) && pass;
+    pass = tone_pitch_test(70, 5, 25) && pass;
+    pass = tone_pitch_test(440, 1, 10) && pass;
+    return pass ? 0 : 1;
+}
@@ -28,6 +28,7 @@
 #include <math.h>
 #include <stdlib.h>
 #include <string.h> // for memset
+#include <pthread.h>
 
 
 //**********************
@@ -103,7 +104,31 @@ typedef struct _minmax {
 	struct _minmax *next;
 } minmax;
 
-double _dywapitch_computeWaveletPitch(double * samples, int startsample, int samplecount) {
+// scratch buffers of the wavelet algorithm, for samplecount samples
+typedef struct _dywapitchscratch {
+	double *sam;
+	int *distances;
+	int *mins;
+	int *maxs;
+} dywapitchscratch;
+
+void _dywapitch_allocscratch(dywapitchscratch *scratch, int samplecount) {
+	samplecount = _floor_power2(samplecount);
+	scratch->sam = (double *)malloc(sizeof(double)*samplecount);
+	scratch->distances = (int *)malloc(sizeof(int)*samplecount);
+	scratch->mins = (int *)malloc(sizeof(int)*samplecount);
+	scratch->maxs = (int *)malloc(sizeof(int)*samplecount);
+}
+
+void _dywapitch_freescratch(dywapitchscratch *scratch) {
+	free(scratch->distances);
+	free(scratch->mins);
+	free(scratch->maxs);
+	free(scratch->sam);
+}
+
+// the wavelet algorithm, using preallocated scratch buffers of at least samplecount samples
+double _dywapitch_computeWaveletPitchScratch(dywapitchscratch *scratch, double * samples, int startsample, int samplecount) {
 	double pitchF = 0.0;
 	
 	int i, j;
@@ -112,13 +137,13 @@ double _dywapitch_computeWaveletPitch(double * samples, int startsample, int sam
 	// must be a power of 2
 	samplecount = _floor_power2(samplecount);
 	
-	double *sam = (double *)malloc(sizeof(double)*samplecount);
+	double *sam = scratch->sam;
 	memcpy(sam, samples + startsample, sizeof(double)*samplecount);
 	int curSamNb = samplecount;
 	
-	int *distances = (int *)malloc(sizeof(int)*samplecount);
-	int *mins = (int *)malloc(sizeof(int)*samplecount);
-	int *maxs = (int *)malloc(sizeof(int)*samplecount);
+	int *distances = scratch->distances;
+	int *mins = scratch->mins;
+	int *maxs = scratch->maxs;
 	int nbMins, nbMaxs;
 	
 	// algorithm parameters
@@ -329,11 +354,14 @@ double _dywapitch_computeWaveletPitch(double * samples, int startsample, int sam
 	
 	///
 cleanup:
-	free(distances);
-	free(mins);
-	free(maxs);
-	free(sam);
-	
+	return pitchF;
+}
+
+double _dywapitch_computeWaveletPitch(double * samples, int startsample, int samplecount) {
+	dywapitchscratch scratch;
+	_dywapitch_allocscratch(&scratch, samplecount);
+	double pitchF = _dywapitch_computeWaveletPitchScratch(&scratch, samples, startsample, samplecount);
+	_dywapitch_freescratch(&scratch);
 	return pitchF;
 }
 
@@ -341,6 +369,8 @@ cleanup:
 // the dynamic postprocess
 // ***********************************
 
+#define DYWAPITCH_MAXCONFIDENCE 5
+
 /***
 It states: 
  - a pitch cannot change much all of a sudden (20%) (impossible humanly,
@@ -359,7 +389,7 @@ double _dywapitch_dynamicprocess(dywapitchtracker *pitchtracker, double pitch) {
 	//
 	double estimatedPitch = -1;
 	double acceptedError = 0.2f;
-	int maxConfidence = 5;
+	int maxConfidence = DYWAPITCH_MAXCONFIDENCE;
 	
 	if (pitch != -1) {
 		// I have a pitch here
@@ -445,5 +475,76 @@ double dywapitch_computepitch(dywapitchtracker *pitchtracker, double * samples,
 	return _dywapitch_dynamicprocess(pitchtracker, raw_pitch);
 }
 
+// ************************************
+// the batch entry point
+// ************************************
 
+// a contiguous segment of frames, computed by one thread with its own scratch
+typedef struct _dywapitchsegment {
+	double *samples;
+	int framesize;
+	int hop;
+	int firstframe;
+	int framecount;
+	double *pitches;
+} dywapitchsegment;
 
+void *_dywapitch_computesegment(void *arg) {
+	dywapitchsegment *segment = (dywapitchsegment *)arg;
+	dywapitchscratch scratch;
+	int i;
+	
+	_dywapitch_allocscratch(&scratch, segment->framesize);
+	for (i = segment->firstframe; i < segment->firstframe + segment->framecount; i++) {
+		segment->pitches[i] = _dywapitch_computeWaveletPitchScratch(&scratch, segment->samples, i*segment->hop, segment->framesize);
+	}
+	_dywapitch_freescratch(&scratch);
+	return NULL;
+}
+
+int dywapitch_computepitch_batch(dywapitchtracker *pitchtracker, double * samples, int samplecount, int framesize, int hop, int threadcount, double * pitches, double * confidences) {
+	if (framesize < 2 || hop < 1 || samplecount < framesize) return 0;
+	int framecount = (samplecount - framesize)/hop + 1;
+	int i;
+	
+	// the raw wavelet pitches do not depend on each other : split the frames in segments
+	if (threadcount < 1) threadcount = 1;
+	if (threadcount > framecount) threadcount = framecount;
+	dywapitchsegment *segments = (dywapitchsegment *)malloc(sizeof(dywapitchsegment)*threadcount);
+	pthread_t *threads = (pthread_t *)malloc(sizeof(pthread_t)*threadcount);
+	int firstframe = 0;
+	for (i = 0; i < threadcount; i++) {
+		segments[i].samples = samples;
+		segments[i].framesize = framesize;
+		segments[i].hop = hop;
+		segments[i].firstframe = firstframe;
+		segments[i].framecount = framecount/threadcount + (i < framecount%threadcount ? 1 : 0);
+		segments[i].pitches = pitches;
+		firstframe += segments[i].framecount;
+	}
+	
+	// the calling thread takes the first segment
+	int launched = 1;
+	while (launched < threadcount) {
+		if (pthread_create(&threads[launched], NULL, _dywapitch_computesegment, &segments[launched]) != 0) break;
+		launched++;
+	}
+	_dywapitch_computesegment(&segments[0]);
+	for (i = 1; i < launched; i++) pthread_join(threads[i], NULL);
+	// segments which could not get a thread
+	for (i = launched; i < threadcount; i++) _dywapitch_computesegment(&segments[i]);
+	
+	free(threads);
+	free(segments);
+	
+	// the dynamic postprocess follows the pitch over time : sequential
+	for (i = 0; i < framecount; i++) {
+		pitches[i] = _dywapitch_dynamicprocess(pitchtracker, pitches[i]);
+		if (confidences) {
+			int confidence = max(0, pitchtracker->_pitchConfidence);
+			confidences[i] = confidence/(double)DYWAPITCH_MAXCONFIDENCE;
+		}
+	}
+	
+	return framecount;
+}
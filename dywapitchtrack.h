@@ -72,6 +72,9 @@
  // For each available audio buffer, call 'dywapitch_computepitch'
  double thepitch = dywapitch_computepitch(&pitchtracker, samples, start, count);
  
+ // Or, offline, compute all the frames of a recording at once
+ int nbFrames = dywapitch_computepitch_batch(&pitchtracker, samples, count, 1024, 512, 4, pitches, confidences);
+ 
 */
 
 #ifndef dywapitchtrack__H
@@ -102,6 +105,19 @@ void dywapitch_inittracking(dywapitchtracker *pitchtracker);
 // return 0.0 if no pitch was found (sound too low, noise, etc..)
 double dywapitch_computepitch(dywapitchtracker *pitchtracker, double * samples, int startsample, int samplecount);
 
+// computes the pitch of every frame of an offline buffer, sharing scratch buffers across frames.
+// Pass the inited dywapitchtracker structure
+// samples : a pointer to the sample buffer
+// samplecount : the number of samples in the sample buffer
+// framesize : the number of samples to use to compute each pitch
+// hop : the number of samples between the starts of two consecutive frames
+// threadcount : the number of threads computing the raw pitches (1 for none). The dynamic
+//   postprocess is always applied sequentially, so the result does not depend on threadcount
+// pitches : output, one pitch per frame, 0.0 if no pitch was found
+// confidences : output (or NULL), one tracking confidence per frame, between 0.0 and 1.0
+// returns the number of frames computed, (samplecount - framesize)/hop + 1
+int dywapitch_computepitch_batch(dywapitchtracker *pitchtracker, double * samples, int samplecount, int framesize, int hop, int threadcount, double * pitches, double * confidences);
+
 // exposed for Formant tracking
 double _dywapitch_computeWaveletPitch(double * samples, int startsample, int samplecount);
 
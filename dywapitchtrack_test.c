@@ -0,0 +1,74 @@
+#include "dywapitchtrack.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SAMPLE_RATE 44100.0
+#define FRAME_SIZE  1024
+#define HOP         300
+#define SAMPLES     (2*44100 + 123) // Not a multiple of HOP
+#define MAX_CONFIDENCE 5 // DYWAPITCH_MAXCONFIDENCE, private to dywapitchtrack.c
+
+// A gliding harmonic tone, with a gap of silence so the tracker loses and finds it again
+static void fill (double* samples, size_t count)
+{
+    double phase = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        double t = i/SAMPLE_RATE;
+        double freq = 150*pow(2, t); // One octave per second
+        phase += 2*M_PI*freq/SAMPLE_RATE;
+        bool gap = t > 0.8 && t < 1.0;
+        samples[i] = gap ? 0 : 0.5*sin(phase) + 0.25*sin(2*phase) + 0.1*sin(3*phase);
+    }
+}
+
+// Test that the batch gives the pitches and confidences of frame by frame tracking, with any
+// number of threads
+bool batch_test ()
+{
+    double* samples = malloc(sizeof(double) * SAMPLES);
+    fill(samples, SAMPLES);
+    int frames = (SAMPLES - FRAME_SIZE)/HOP + 1;
+
+    double* expected = malloc(sizeof(double) * frames);
+    double* expected_confidences = malloc(sizeof(double) * frames);
+    dywapitchtracker tracker;
+    dywapitch_inittracking(&tracker);
+    int pitched = 0;
+    for (int i = 0; i < frames; ++i)
+    {
+        expected[i] = dywapitch_computepitch(&tracker, samples, i*HOP, FRAME_SIZE);
+        expected_confidences[i] = (tracker._pitchConfidence > 0 ? tracker._pitchConfidence : 0)/(double)MAX_CONFIDENCE;
+        pitched += expected[i] > 0;
+    }
+
+    bool pass = pitched > frames/2 && pitched < frames;
+    double* pitches = malloc(sizeof(double) * frames);
+    double* confidences = malloc(sizeof(double) * frames);
+    int thread_counts[] = {1, 2, 7, frames + 5};
+    for (size_t t = 0; t < sizeof(thread_counts)/sizeof(thread_counts[0]) && pass; ++t)
+    {
+        dywapitch_inittracking(&tracker);
+        int count = dywapitch_computepitch_batch(&tracker, samples, SAMPLES, FRAME_SIZE, HOP, thread_counts[t], pitches, confidences);
+        pass = count == frames;
+        for (int i = 0; i < frames && pass; ++i) pass = pitches[i] == expected[i] && confidences[i] == expected_confidences[i];
+        if (!pass) fprintf(stderr, "FAILED: batch\n    Threads: %d, frames: %d of %d\n", thread_counts[t], count, frames);
+    }
+    if (pitched <= frames/2 || pitched == frames) fprintf(stderr, "FAILED: batch\n    %d of %d frames pitched\n", pitched, frames);
+
+    free(samples);
+    free(expected);
+    free(expected_confidences);
+    free(pitches);
+    free(confidences);
+    return pass;
+}
+
+int main (void)
+{
+    if (!batch_test()) return 1;
+    return 0;
+}
@@ -0,0 +1,326 @@
+#include "ensemble.h"
+#include "dywapitchtrack.h"
+#include "pitch.h"
+
+#include <fftw3.h>
+
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define FFT_PEAK_CUTOFF 5000 // Lowpass of dominant_freq_lp, as in the backend
+#define TOLERANCE_CENTS 50   // Estimates closer than this agree
+#define OCTAVE_WEIGHT   0.5  // Share of its confidence an estimate lends an octave away
+
+// How much each estimator is trusted on the vowel samples, relative to the others
+static const double reliability[ENSEMBLE_ESTIMATORS] = {0.8, 0.8, 1.0, 0.7};
+
+static void estimate (ensemble_worker* w)
+{
+    ensemble* e = w->owner;
+    double pitch = -INFINITY;
+    double confidence = reliability[w->estimator];
+    switch (w->estimator)
+    {
+        case ENSEMBLE_FFT_PEAK:
+        {
+            pitch = dominant_freq_lp(w->fft, w->fft_mag, e->frame_size, e->sample_rate, FFT_PEAK_CUTOFF);
+            // Confidence: the height of the chosen peak relative to the highest one
+            size_t num_bins = FFT_PEAK_CUTOFF*e->frame_size/e->sample_rate + 1;
+            double max = 0;
+            for (size_t i = 0; i < num_bins; ++i) if (w->fft_mag[i] > max) max = w->fft_mag[i];
+            size_t bin = pitch > 0 ? (size_t)(pitch*e->frame_size/e->sample_rate + 0.5) : 0;
+            if (max > 0 && bin < num_bins) confidence *= w->fft_mag[bin]/max;
+            break;
+        }
+        case ENSEMBLE_WAVELET:
+            pitch = _dywapitch_computeWaveletPitch(w->frame, 0, (int)e->frame_size);
+            break;
+        case ENSEMBLE_MCLEOD:
+        {
+            double clarity;
+            pitch = mcleod_pitch(w->frame, e->frame_size, e->sample_rate, e->min_freq, w->scratch, &clarity);
+            confidence *= clarity;
+            break;
+        }
+        case ENSEMBLE_CEPSTRAL:
+            pitch = cepstral_pitch(w->fft_mag, w->scratch, e->frame_size, e->sample_rate, e->min_freq, e->max_freq);
+            break;
+    }
+    if (!(pitch >= e->min_freq && pitch <= e->max_freq)) pitch = -INFINITY;
+    w->pitch = pitch;
+    w->confidence = pitch > 0 ? confidence : 0;
+}
+
+static void* worker_loop (void* arg)
+{
+    ensemble_worker* w = arg;
+    ensemble* e = w->owner;
+    pthread_mutex_lock(&e->lock);
+    while (true)
+    {
+        while (e->running && w->posted == w->finished) pthread_cond_wait(&w->wake, &e->lock);
+        if (!e->running) break;
+        long sequence = w->posted;
+        pthread_mutex_unlock(&e->lock);
+
+        estimate(w);
+
+        pthread_mutex_lock(&e->lock);
+        w->finished = sequence;
+        pthread_cond_broadcast(&e->done);
+    }
+    pthread_mutex_unlock(&e->lock);
+    return NULL;
+}
+
+// Stop and release the first num_workers workers
+static void stop_workers (ensemble* e, int num_workers)
+{
+    pthread_mutex_lock(&e->lock);
+    e->running = false;
+    for (int i = 0; i < num_workers; ++i) pthread_cond_signal(&e->workers[i].wake);
+    pthread_mutex_unlock(&e->lock);
+
+    for (int i = 0; i < num_workers; ++i)
+    {
+        ensemble_worker* w = &e->workers[i];
+        pthread_join(w->thread, NULL);
+        pthread_cond_destroy(&w->wake);
+        free(w->frame);
+        free(w->fft);
+        free(w->fft_mag);
+        free(w->scratch);
+    }
+    pthread_cond_destroy(&e->done);
+    pthread_mutex_destroy(&e->lock);
+}
+
+bool ensemble_init (ensemble* e, size_t frame_size, double sample_rate, double min_freq, double max_freq)
+{
+    e->frame_size  = frame_size;
+    e->sample_rate = sample_rate;
+    e->min_freq    = min_freq;
+    e->max_freq    = max_freq;
+    e->running     = true;
+    e->sequence    = 0;
+    e->skipped     = 0;
+    e->latest      = -INFINITY;
+    e->latest_confidence = 0;
+    pthread_mutex_init(&e->lock, NULL);
+    // Deadlines are on the monotonic clock, so setting the wall clock doesn't move them
+    pthread_condattr_t attributes;
+    pthread_condattr_init(&attributes);
+#ifndef __APPLE__
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+#endif
+    pthread_cond_init(&e->done, &attributes);
+    pthread_condattr_destroy(&attributes);
+
+    // Plan every transform up front rather than on the first deadline
+    {
+        double        frame[frame_size];
+        fftw_complex  fft[frame_size/2+1];
+        double        fft_mag[frame_size/2+1];
+        double*       scratch = malloc(sizeof(double) * mcleod_scratch_size(frame_size));
+        for (size_t i = 0; i < frame_size; ++i) frame[i] = 0;
+        calc_fft(frame, fft, frame_size);
+        calc_fft_mag(fft, fft_mag, frame_size);
+        mcleod_pitch(frame, frame_size, sample_rate, min_freq, scratch, NULL);
+        cepstral_pitch(fft_mag, scratch, frame_size, sample_rate, min_freq, max_freq);
+        free(scratch);
+    }
+
+    for (int i = 0; i < ENSEMBLE_ESTIMATORS; ++i)
+    {
+        ensemble_worker* w = &e->workers[i];
+        w->owner      = e;
+        w->estimator  = i;
+        w->posted     = 0;
+        w->finished   = 0;
+        w->misses     = 0;
+        w->frame      = malloc(sizeof(double) * frame_size);
+        w->fft        = malloc(sizeof(fftw_complex) * (frame_size/2+1));
+        w->fft_mag    = malloc(sizeof(double) * (frame_size/2+1));
+        w->scratch    = malloc(sizeof(double) * mcleod_scratch_size(frame_size)); // Enough for cepstral_pitch too
+        w->pitch      = -INFINITY;
+        w->confidence = 0;
+        pthread_cond_init(&w->wake, NULL);
+        if (pthread_create(&w->thread, NULL, worker_loop, w) != 0)
+        {
+            pthread_cond_destroy(&w->wake);
+            free(w->frame);
+            free(w->fft);
+            free(w->fft_mag);
+            free(w->scratch);
+            stop_workers(e, i);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Hand a frame to every idle worker, with the lock held; a busy worker misses it
+static void post_frame (ensemble* e, double* frame, fftw_complex* fft, double* fft_mag)
+{
+    long sequence = ++e->sequence;
+    for (int i = 0; i < ENSEMBLE_ESTIMATORS; ++i)
+    {
+        ensemble_worker* w = &e->workers[i];
+        if (w->posted != w->finished)
+        {
+            // Still busy with an earlier frame
+            ++w->misses;
+            continue;
+        }
+        // An idle worker does not touch its buffers
+        memcpy(w->frame, frame, sizeof(double) * e->frame_size);
+        memcpy(w->fft, fft, sizeof(fftw_complex) * (e->frame_size/2+1));
+        memcpy(w->fft_mag, fft_mag, sizeof(double) * (e->frame_size/2+1));
+        w->posted = sequence;
+        pthread_cond_signal(&w->wake);
+    }
+}
+
+// Fuse the results of the last frame posted, with the lock held
+static double fuse_frame (ensemble* e, double* confidence)
+{
+    double pitches[ENSEMBLE_ESTIMATORS];
+    double confidences[ENSEMBLE_ESTIMATORS];
+    for (int i = 0; i < ENSEMBLE_ESTIMATORS; ++i)
+    {
+        ensemble_worker* w = &e->workers[i];
+        bool on_time = w->finished == e->sequence;
+        if (w->posted == e->sequence && !on_time) ++w->misses;
+        pitches[i]     = on_time ? w->pitch : -INFINITY;
+        confidences[i] = on_time ? w->confidence : 0;
+    }
+    return ensemble_fuse(pitches, confidences, ENSEMBLE_ESTIMATORS, confidence);
+}
+
+// Wait for a worker to finish; return false once the deadline (in ns, on the monotonic
+// clock) has passed
+static bool wait_done (ensemble* e, double deadline_ns)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+#ifdef __APPLE__
+    // No pthread_condattr_setclock: wait for the time left instead
+    double left = deadline_ns - (now.tv_sec*1e9 + now.tv_nsec);
+    if (left <= 0) return false;
+    struct timespec relative = {(time_t)(left/1e9), (long)(left - (time_t)(left/1e9)*1e9)};
+    return pthread_cond_timedwait_relative_np(&e->done, &e->lock, &relative) == 0;
+#else
+    struct timespec deadline = {(time_t)(deadline_ns/1e9), (long)(deadline_ns - (time_t)(deadline_ns/1e9)*1e9)};
+    return pthread_cond_timedwait(&e->done, &e->lock, &deadline) == 0;
+#endif
+}
+
+double ensemble_estimate (ensemble* e, double* frame, fftw_complex* fft, double* fft_mag, long deadline_us, double* confidence)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double deadline_ns = now.tv_sec*1e9 + now.tv_nsec + deadline_us*1e3;
+
+    pthread_mutex_lock(&e->lock);
+    post_frame(e, frame, fft, fft_mag);
+    while (true)
+    {
+        bool waiting = false;
+        for (int i = 0; i < ENSEMBLE_ESTIMATORS; ++i)
+        {
+            ensemble_worker* w = &e->workers[i];
+            if (w->posted == e->sequence && w->finished != e->sequence) waiting = true;
+        }
+        if (!waiting || !wait_done(e, deadline_ns)) break;
+    }
+    double pitch = fuse_frame(e, confidence);
+    pthread_mutex_unlock(&e->lock);
+    return pitch;
+}
+
+double ensemble_post (ensemble* e, double* frame, fftw_complex* fft, double* fft_mag, double* confidence)
+{
+    // Workers only hold the lock to pick up or hand in a frame; if one does, skip this frame
+    // rather than wait
+    if (pthread_mutex_trylock(&e->lock) == 0)
+    {
+        if (e->sequence > 0) e->latest = fuse_frame(e, &e->latest_confidence);
+        post_frame(e, frame, fft, fft_mag);
+        pthread_mutex_unlock(&e->lock);
+    }
+    else ++e->skipped;
+    if (confidence) *confidence = e->latest_confidence;
+    return e->latest;
+}
+
+void ensemble_reset (ensemble* e)
+{
+    pthread_mutex_lock(&e->lock);
+    // Results handed in for earlier frames no longer match the sequence
+    ++e->sequence;
+    e->latest = -INFINITY;
+    e->latest_confidence = 0;
+    pthread_mutex_unlock(&e->lock);
+}
+
+// Return the distance in cents between two frequencies
+static double cents (double a, double b)
+{
+    return 1200*log2(a/b);
+}
+
+double ensemble_fuse (double* pitches, double* confidences, size_t n, double* confidence)
+{
+    if (confidence) *confidence = 0;
+
+    // Every estimate is a candidate, backed by the estimates agreeing with it
+    double total = 0;
+    double best_support = 0;
+    size_t winner = n;
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (!(pitches[i] > 0) || confidences[i] <= 0) continue;
+        total += confidences[i];
+        double support = 0;
+        for (size_t j = 0; j < n; ++j)
+        {
+            if (!(pitches[j] > 0) || confidences[j] <= 0) continue;
+            double distance = fabs(cents(pitches[j], pitches[i]));
+            if      (distance < TOLERANCE_CENTS)                                     support += confidences[j];
+            else if (fabs(distance-1200) < TOLERANCE_CENTS || fabs(distance-2400) < TOLERANCE_CENTS) support += OCTAVE_WEIGHT*confidences[j];
+        }
+        if (support > best_support || (support == best_support && winner < n && confidences[i] > confidences[winner]))
+        {
+            best_support = support;
+            winner = i;
+        }
+    }
+    if (winner == n) return -INFINITY;
+
+    // Weighted mean (in cents) of the backing estimates, folded into the winner's octave
+    double weighted_cents = 0;
+    double weights = 0;
+    for (size_t j = 0; j < n; ++j)
+    {
+        if (!(pitches[j] > 0) || confidences[j] <= 0) continue;
+        double distance = cents(pitches[j], pitches[winner]);
+        double octaves  = round(distance/1200);
+        double folded   = distance - 1200*octaves;
+        if (fabs(octaves) > 2 || fabs(folded) >= TOLERANCE_CENTS) continue;
+        double weight = octaves == 0 ? confidences[j] : OCTAVE_WEIGHT*confidences[j];
+        weighted_cents += weight*folded;
+        weights += weight;
+    }
+
+    if (confidence) *confidence = best_support/total;
+    return pitches[winner] * pow(2, weighted_cents/weights/1200);
+}
+
+void ensemble_cleanup (ensemble* e)
+{
+    stop_workers(e, ENSEMBLE_ESTIMATORS);
+}
@@ -0,0 +1,94 @@
+// Pitch estimator ensemble
+//
+// Every estimator runs on its own worker thread. ensemble_estimate hands the same frame
+// to every idle worker, waits for them until a deadline and fuses whatever finished in
+// time. A worker that misses the deadline is dropped for that frame, and stays dropped
+// until it catches up, so a slow estimator never delays the caller past the deadline.
+// ensemble_post is for real time callers: it never waits, and returns the fused result of
+// the frame posted before, so the workers get a whole hop to finish.
+#include <fftw3.h>
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#define ENSEMBLE_FFT_PEAK   0 // dominant_freq_lp
+#define ENSEMBLE_WAVELET    1 // _dywapitch_computeWaveletPitch
+#define ENSEMBLE_MCLEOD     2 // mcleod_pitch
+#define ENSEMBLE_CEPSTRAL   3 // cepstral_pitch
+#define ENSEMBLE_ESTIMATORS 4
+
+typedef struct ensemble ensemble;
+
+typedef struct
+{
+    ensemble*      owner;
+    int            estimator;
+    pthread_t      thread;
+    pthread_cond_t wake;
+    long           posted;     // Sequence number of the last frame handed to the worker
+    long           finished;   // Sequence number of the last frame the worker finished
+    long           misses;     // Number of frames the worker was dropped from
+    double*        frame;      // Private copies of the frame being estimated
+    fftw_complex*  fft;
+    double*        fft_mag;
+    double*        scratch;    // Of the estimator, mcleod_scratch_size(frame_size) long
+    double         pitch;      // Result for frame finished, -INFINITY if none
+    double         confidence; // Confidence of the result, from 0 to 1
+} ensemble_worker;
+
+struct ensemble
+{
+    size_t          frame_size;
+    double          sample_rate;
+    double          min_freq;
+    double          max_freq;
+    bool            running;
+    long            sequence;          // Of the last frame posted
+    long            skipped;           // Frames ensemble_post found the lock taken for
+    double          latest;            // ensemble_post's result, and its confidence
+    double          latest_confidence;
+    pthread_mutex_t lock;
+    pthread_cond_t  done;
+    ensemble_worker workers[ENSEMBLE_ESTIMATORS];
+};
+
+// Start the worker threads; return false if one can't be started
+//   e:           the ensemble to be initialized
+//   frame_size:  the length of the frames to be estimated
+//   sample_rate: the sampling rate (in Hz) of the frames
+//   min_freq:    lowest frequency to be detected
+//   max_freq:    highest frequency to be detected
+bool ensemble_init (ensemble* e, size_t frame_size, double sample_rate, double min_freq, double max_freq);
+
+// Return the fused pitch of a frame, or -INFINITY if no estimator found one in time
+//   e:           an initialized ensemble
+//   frame:       input array of length frame_size
+//   fft:         input array of length frame_size/2+1, the transform of frame
+//   fft_mag:     input array of length frame_size/2+1
+//   deadline_us: how long to wait for the estimators, in microseconds
+//   confidence:  output (or NULL), the share of the estimators' confidence backing the pitch
+double ensemble_estimate (ensemble* e, double* frame, fftw_complex* fft, double* fft_mag, long deadline_us, double* confidence);
+
+// Post a frame without waiting; return the fused pitch of the frame posted before, or
+// -INFINITY. If a worker holds the lock, the frame is skipped and the last result returned.
+//   e:           an initialized ensemble
+//   frame:       input array of length frame_size
+//   fft:         input array of length frame_size/2+1, the transform of frame
+//   fft_mag:     input array of length frame_size/2+1
+//   confidence:  output (or NULL), the share of the estimators' confidence backing the pitch
+double ensemble_post (ensemble* e, double* frame, fftw_complex* fft, double* fft_mag, double* confidence);
+
+// Forget the last result and any frame still being estimated, before a new stream
+void ensemble_reset (ensemble* e);
+
+// Return the confidence-weighted vote of independent pitch estimates, or -INFINITY.
+// Estimates an octave apart from the winner are folded into its octave before averaging.
+//   pitches:     input array of length n, -INFINITY (or 0) for missing estimates
+//   confidences: input array of length n, from 0 to 1
+//   n:           the number of estimates
+//   confidence:  output (or NULL), the share of the total confidence backing the pitch
+double ensemble_fuse (double* pitches, double* confidences, size_t n, double* confidence);
+
+// Stop the worker threads and release their buffers
+void ensemble_cleanup (ensemble* e);
@@ -0,0 +1,177 @@
+#include "ensemble.h"
+#include "pitch.h"
+
+#include <fftw3.h>
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define FRAME_SIZE  1024
+#define SAMPLE_RATE 44100.0
+
+// Test that votes pick the agreeing estimates and fold octave errors back
+bool fuse_test ()
+{
+    bool pass = true;
+
+    double pitches[]     = {220, 221, 440, 110};
+    double confidences[] = {0.8, 0.9, 0.7, 0.4};
+    double confidence;
+    double pitch = ensemble_fuse(pitches, confidences, 4, &confidence);
+    if (fabs(pitch - 220.5) > 1 || confidence <= 0.5)
+    {
+        fprintf(stderr, "FAILED: octave reconciliation\n");
+        fprintf(stderr, "    Fused = %f (confidence %.2f)\n\n", pitch, confidence);
+        pass = false;
+    }
+
+    double outvoted[]    = {440, 220, 220, -INFINITY};
+    double outvoted_c[]  = {1.0, 0.8, 0.8, 0};
+    pitch = ensemble_fuse(outvoted, outvoted_c, 4, NULL);
+    if (fabs(pitch - 220) > 1)
+    {
+        fprintf(stderr, "FAILED: majority over the most confident estimate\n");
+        fprintf(stderr, "    Fused = %f\n\n", pitch);
+        pass = false;
+    }
+
+    double missing[]     = {-INFINITY, 0, -INFINITY, -INFINITY};
+    double missing_c[]   = {0, 0, 0, 0};
+    pitch = ensemble_fuse(missing, missing_c, 4, &confidence);
+    if (pitch != -INFINITY || confidence != 0)
+    {
+        fprintf(stderr, "FAILED: no estimates\n");
+        fprintf(stderr, "    Fused = %f\n\n", pitch);
+        pass = false;
+    }
+
+    return pass;
+}
+
+// Fill frame with a harmonic-rich tone and take its spectrum
+void harmonic_tone (double* frame, fftw_complex* fft, double* fft_mag, double sample_freq)
+{
+    for (size_t i = 0; i < FRAME_SIZE; ++i)
+    {
+        frame[i] = 0;
+        for (int h = 1; h <= 6; ++h) frame[i] += sin(2*M_PI*h*sample_freq*i/SAMPLE_RATE)/h;
+    }
+    calc_fft(frame, fft, FRAME_SIZE);
+    calc_fft_mag(fft, fft_mag, FRAME_SIZE);
+}
+
+// Test the ensemble on a harmonic-rich tone
+bool estimate_test (ensemble* e, double sample_freq)
+{
+    double frame[FRAME_SIZE];
+    fftw_complex fft[FRAME_SIZE/2+1];
+    double fft_mag[FRAME_SIZE/2+1];
+    harmonic_tone(frame, fft, fft_mag, sample_freq);
+
+    double confidence;
+    double pitch = ensemble_estimate(e, frame, fft, fft_mag, 1000000, &confidence);
+    if (!(fabs(1200*log2(pitch/sample_freq)) < 50))
+    {
+        fprintf(stderr, "FAILED: harmonic tone\n");
+        fprintf(stderr, "    Frequency: %.0f\n", sample_freq);
+        fprintf(stderr, "    Ensemble = %f (confidence %.2f)\n\n", pitch, confidence);
+        return false;
+    }
+    return true;
+}
+
+// Test that the ensemble returns on time when no estimator can meet the deadline
+bool deadline_test (ensemble* e)
+{
+    double frame[FRAME_SIZE];
+    fftw_complex fft[FRAME_SIZE/2+1];
+    double fft_mag[FRAME_SIZE/2+1];
+    harmonic_tone(frame, fft, fft_mag, 220);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ensemble_estimate(e, frame, fft, fft_mag, 0, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed_ms = (end.tv_sec - start.tv_sec)*1e3 + (end.tv_nsec - start.tv_nsec)/1e6;
+    if (elapsed_ms > 5)
+    {
+        fprintf(stderr, "FAILED: zero deadline took %.2fms\n\n", elapsed_ms);
+        return false;
+    }
+    return true;
+}
+
+static double now_ms ()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec*1e3 + t.tv_nsec/1e6;
+}
+
+// Wait for every worker to finish the frame it was handed last
+static void wait_workers (ensemble* e)
+{
+    pthread_mutex_lock(&e->lock);
+    for (size_t i = 0; i < ENSEMBLE_ESTIMATORS; ++i)
+        while (e->workers[i].finished != e->workers[i].posted) pthread_cond_wait(&e->done, &e->lock);
+    pthread_mutex_unlock(&e->lock);
+}
+
+// Test that posting never waits, returns the result of the frame posted before, and that a
+// reset forgets it
+bool post_test (ensemble* e)
+{
+    double frame[2][FRAME_SIZE];
+    fftw_complex fft[2][FRAME_SIZE/2+1];
+    double fft_mag[2][FRAME_SIZE/2+1];
+    double freqs[2] = {220, 330};
+    for (int i = 0; i < 2; ++i) harmonic_tone(frame[i], fft[i], fft_mag[i], freqs[i]);
+
+    wait_workers(e);
+    ensemble_reset(e);
+    double pitches[4];
+    double slowest = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        double start = now_ms();
+        pitches[i] = ensemble_post(e, frame[i%2], fft[i%2], fft_mag[i%2], NULL);
+        double elapsed = now_ms() - start;
+        if (elapsed > slowest) slowest = elapsed;
+        wait_workers(e);
+    }
+    ensemble_reset(e);
+    double after_reset = ensemble_post(e, frame[0], fft[0], fft_mag[0], NULL);
+
+    bool pass = pitches[0] == -INFINITY && after_reset == -INFINITY && slowest < 5;
+    for (int i = 1; i < 4; ++i) pass = pass && fabs(1200*log2(pitches[i]/freqs[(i-1)%2])) < 50;
+    if (!pass)
+    {
+        fprintf(stderr, "FAILED: post\n");
+        fprintf(stderr, "    Pitches: %f %f %f %f, after reset %f\n", pitches[0], pitches[1], pitches[2], pitches[3], after_reset);
+        fprintf(stderr, "    Slowest post: %.2fms\n\n", slowest);
+    }
+    return pass;
+}
+
+// Run all tests
+int main (void)
+{
+    if (!fuse_test()) return 1;
+
+    ensemble e;
+    if (!ensemble_init(&e, FRAME_SIZE, SAMPLE_RATE, 50, 1000))
+    {
+        fprintf(stderr, "FAILED: init\n\n");
+        return 1;
+    }
+    bool pass = true;
+    for (double f = 110; f < 900; f *= 1.5) pass = estimate_test(&e, f) && pass;
+    pass = deadline_test(&e) && pass;
+    pass = post_test(&e) && pass;
+    ensemble_cleanup(&e);
+
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,216 @@
+#include "featfile.h"
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool feature_writer_open (feature_writer* w, const char* path, double sample_rate, size_t hop, const char** names, size_t num_names)
+{
+    memset(w, 0, sizeof(feature_writer));
+    w->file = fopen(path, "wb");
+    if (w->file == NULL) return false;
+
+    feature_header* h = &w->header;
+    memcpy(h->magic, FEATURE_MAGIC, sizeof(h->magic));
+    h->sample_rate  = sample_rate;
+    h->hop          = hop;
+    h->num_columns  = num_names + 2;
+    h->block_frames = FEATURE_BLOCK_FRAMES;
+    h->data_offset  = sizeof(feature_header) + (uint64_t)h->num_columns*FEATURE_NAME_SIZE;
+    w->block        = calloc((size_t)h->block_frames*h->num_columns, sizeof(double));
+
+    // The header is written again once the offsets are known
+    fwrite(h, sizeof(feature_header), 1, w->file);
+    char name[FEATURE_NAME_SIZE];
+    for (size_t c = 0; c < h->num_columns; ++c)
+    {
+        memset(name, 0, sizeof(name));
+        const char* column = c == FEATURE_SOURCE ? "source" : c == FEATURE_TIME ? "time" : names[c-2];
+        strncpy(name, column, sizeof(name)-1);
+        fwrite(name, 1, sizeof(name), w->file);
+    }
+    return true;
+}
+
+size_t feature_writer_add_source (feature_writer* w, const char* path)
+{
+    w->sources = realloc(w->sources, sizeof(char*) * (w->header.num_sources+1));
+    w->sources[w->header.num_sources] = strdup(path);
+    return w->header.num_sources++;
+}
+
+static void write_block (feature_writer* w)
+{
+    fwrite(w->block, sizeof(double), (size_t)w->header.block_frames*w->header.num_columns, w->file);
+    memset(w->block, 0, sizeof(double) * w->header.block_frames*w->header.num_columns);
+    w->block_loc = 0;
+}
+
+void feature_writer_append (feature_writer* w, size_t source, double time, const double* values)
+{
+    size_t frames = w->header.block_frames;
+    if (w->block_loc == 0)
+    {
+        w->index = realloc(w->index, sizeof(feature_key) * (w->num_blocks+1));
+        w->index[w->num_blocks++] = (feature_key){source, time};
+    }
+    w->block[FEATURE_SOURCE*frames + w->block_loc] = source;
+    w->block[FEATURE_TIME*frames + w->block_loc] = time;
+    for (size_t c = 2; c < w->header.num_columns; ++c) w->block[c*frames + w->block_loc] = values[c-2];
+    ++w->header.num_frames;
+    if (++w->block_loc == frames) write_block(w);
+}
+
+bool feature_writer_close (feature_writer* w)
+{
+    feature_header* h = &w->header;
+    if (w->block_loc > 0) write_block(w);
+    h->index_offset = h->data_offset + (uint64_t)w->num_blocks*h->block_frames*h->num_columns*sizeof(double);
+    fwrite(w->index, sizeof(feature_key), w->num_blocks, w->file);
+    h->sources_offset = h->index_offset + w->num_blocks*sizeof(feature_key);
+    for (size_t s = 0; s < h->num_sources; ++s) fwrite(w->sources[s], 1, strlen(w->sources[s])+1, w->file);
+
+    fseek(w->file, 0, SEEK_SET);
+    fwrite(h, sizeof(feature_header), 1, w->file);
+    bool ok = !ferror(w->file);
+    ok = fclose(w->file) == 0 && ok;
+
+    for (size_t s = 0; s < h->num_sources; ++s) free(w->sources[s]);
+    free(w->sources);
+    free(w->index);
+    free(w->block);
+    memset(w, 0, sizeof(feature_writer));
+    return ok;
+}
+
+// Return true iff the header describes a feature file whose names, data, index and sources
+// follow each other in that order within size bytes, and set num_blocks. Every offset and
+// length is checked for overflow, so a corrupt header can't wrap around to look consistent.
+static bool valid_header (const feature_header* h, size_t size, size_t* num_blocks)
+{
+    if (memcmp(h->magic, FEATURE_MAGIC, sizeof(h->magic)) != 0 || h->block_frames == 0 || h->num_columns < 2)
+        return false;
+    *num_blocks = h->num_frames/h->block_frames + (h->num_frames % h->block_frames != 0);
+    uint64_t names_end, data_size, index_size, index_offset, sources_offset;
+    return !__builtin_mul_overflow((uint64_t)h->num_columns, FEATURE_NAME_SIZE, &names_end) &&
+           !__builtin_add_overflow(names_end, sizeof(feature_header), &names_end) &&
+           h->data_offset >= names_end && h->data_offset <= size && h->data_offset % sizeof(double) == 0 &&
+           !__builtin_mul_overflow((uint64_t)*num_blocks, h->block_frames, &data_size) &&
+           !__builtin_mul_overflow(data_size, h->num_columns, &data_size) &&
+           !__builtin_mul_overflow(data_size, sizeof(double), &data_size) &&
+           !__builtin_add_overflow(h->data_offset, data_size, &index_offset) && index_offset == h->index_offset &&
+           !__builtin_mul_overflow((uint64_t)*num_blocks, sizeof(feature_key), &index_size) &&
+           !__builtin_add_overflow(index_offset, index_size, &sources_offset) && sources_offset == h->sources_offset &&
+           h->sources_offset <= size;
+}
+
+bool feature_reader_open (feature_reader* r, const char* path)
+{
+    memset(r, 0, sizeof(feature_reader));
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) return false;
+    struct stat status;
+    if (fstat(fd, &status) == -1 || (size_t)status.st_size < sizeof(feature_header))
+    {
+        close(fd);
+        return false;
+    }
+    void* map = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return false;
+
+    const feature_header* h = map;
+    size_t size = status.st_size;
+    size_t num_blocks;
+    if (!valid_header(h, size, &num_blocks))
+    {
+        munmap(map, size);
+        return false;
+    }
+    r->map        = map;
+    r->map_size   = size;
+    r->header     = h;
+    r->names      = (const char*)map + sizeof(feature_header);
+    r->data       = (const double*)((const char*)map + h->data_offset);
+    r->index      = (const feature_key*)((const char*)map + h->index_offset);
+    r->num_blocks = num_blocks;
+
+    // Every source name must end within the mapping
+    r->sources = malloc(sizeof(char*) * h->num_sources);
+    const char* source = (const char*)map + h->sources_offset;
+    const char* end = (const char*)map + size;
+    for (size_t s = 0; s < h->num_sources; ++s)
+    {
+        size_t length = source < end ? strnlen(source, end - source) : 0;
+        if (source + length == end)
+        {
+            feature_reader_close(r);
+            return false;
+        }
+        r->sources[s] = source;
+        source += length + 1;
+    }
+    return true;
+}
+
+int feature_reader_column (feature_reader* r, const char* name)
+{
+    for (size_t c = 0; c < r->header->num_columns; ++c)
+        if (strncmp(r->names + c*FEATURE_NAME_SIZE, name, FEATURE_NAME_SIZE) == 0) return c;
+    return -1;
+}
+
+// Return true iff (source, time) comes before key
+static bool before (double source, double time, feature_key key)
+{
+    return source < key.source || (source == key.source && time < key.time);
+}
+
+size_t feature_reader_find (feature_reader* r, size_t source, double time)
+{
+    // Find the last block starting before the key in the index, then the frame within it
+    feature_key key = {source, time};
+    size_t low = 0, high = r->num_blocks;
+    while (low < high)
+    {
+        size_t mid = (low + high)/2;
+        if (before(r->index[mid].source, r->index[mid].time, key)) low = mid+1;
+        else                                                       high = mid;
+    }
+    if (low == 0) return 0;
+    size_t frame = (low-1)*r->header->block_frames;
+    size_t end = low*r->header->block_frames;
+    if (end > r->header->num_frames) end = r->header->num_frames;
+    while (frame < end && before(feature_reader_value(r, FEATURE_SOURCE, frame), feature_reader_value(r, FEATURE_TIME, frame), key))
+        ++frame;
+    return frame;
+}
+
+const double* feature_reader_values (feature_reader* r, size_t column, size_t frame, size_t* count)
+{
+    size_t frames = r->header->block_frames;
+    size_t block = frame/frames;
+    size_t end = (block+1)*frames;
+    if (end > r->header->num_frames) end = r->header->num_frames;
+    *count = frame < end ? end - frame : 0;
+    return r->data + (block*r->header->num_columns + column)*frames + frame%frames;
+}
+
+double feature_reader_value (feature_reader* r, size_t column, size_t frame)
+{
+    size_t frames = r->header->block_frames;
+    return r->data[(frame/frames*r->header->num_columns + column)*frames + frame%frames];
+}
+
+void feature_reader_close (feature_reader* r)
+{
+    free(r->sources);
+    if (r->map) munmap(r->map, r->map_size);
+    memset(r, 0, sizeof(feature_reader));
+}
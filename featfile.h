@@ -0,0 +1,123 @@
+// Columnar feature files
+//
+// Per-frame features of one or more sources (e.g. the files of a session), stored so they
+// can be memory mapped and read without parsing. All numbers are in native byte order.
+//   header:  feature_header
+//   schema:  num_columns names, each FEATURE_NAME_SIZE bytes padded with '\0'
+//   data:    blocks of block_frames frames; each block holds every column in turn as
+//            block_frames doubles, so a column is contiguous within a block. The last block
+//            is padded to full size.
+//   index:   one feature_key per block, the source and time of its first frame
+//   sources: num_sources paths, each terminated by '\0'
+// Columns 0 and 1 are always "source" (an index into the sources) and "time" (in seconds,
+// at the end of the frame). Frames are sorted by source, then by time.
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define FEATURE_MAGIC        "BLEEPCF1"
+#define FEATURE_NAME_SIZE    32
+#define FEATURE_BLOCK_FRAMES 1024
+#define FEATURE_SOURCE       0 // Column of the source index
+#define FEATURE_TIME         1 // Column of the time
+
+typedef struct
+{
+    char     magic[8];
+    double   sample_rate;
+    uint32_t hop;            // Nominal samples between frames; frames are skipped through silence
+    uint32_t num_columns;    // Including source and time
+    uint32_t block_frames;
+    uint32_t num_sources;
+    uint64_t num_frames;
+    uint64_t data_offset;
+    uint64_t index_offset;
+    uint64_t sources_offset;
+} feature_header;
+
+typedef struct
+{
+    double source;
+    double time;
+} feature_key;
+
+typedef struct
+{
+    FILE*          file;
+    feature_header header;
+    double*        block;      // The block being filled (block_frames*num_columns)
+    size_t         block_loc;  // Frames in block
+    feature_key*   index;
+    size_t         num_blocks;
+    char**         sources;
+} feature_writer;
+
+typedef struct
+{
+    void*                 map;
+    size_t                map_size;
+    const feature_header* header;
+    const char*           names;   // Column names, FEATURE_NAME_SIZE bytes apart
+    const double*         data;
+    const feature_key*    index;
+    size_t                num_blocks;
+    const char**          sources;
+} feature_reader;
+
+// Create a feature file; return false if it can't be written
+//   w:           the writer to be initialized
+//   path:        the output file, which must be seekable
+//   sample_rate: the sampling rate (in Hz) of the sources
+//   hop:         the nominal number of samples between frames
+//   names:       the names of the feature columns, after source and time
+//   num_names:   the number of feature columns
+bool feature_writer_open (feature_writer* w, const char* path, double sample_rate, size_t hop, const char** names, size_t num_names);
+
+// Return the index of a new source
+//   w:    an open writer
+//   path: the name of the source
+size_t feature_writer_add_source (feature_writer* w, const char* path);
+
+// Append a frame; frames must be appended in order of source, then time
+//   w:      an open writer
+//   source: an index from feature_writer_add_source
+//   time:   the time (in seconds) at the end of the frame
+//   values: the features, of length num_names
+void feature_writer_append (feature_writer* w, size_t source, double time, const double* values);
+
+// Write the index and the header and close the file; return false if writing failed
+bool feature_writer_close (feature_writer* w);
+
+// Map a feature file; return false if it can't be read or isn't a feature file
+//   r:    the reader to be initialized
+//   path: the feature file
+bool feature_reader_open (feature_reader* r, const char* path);
+
+// Return the index of a column, or -1 if there is no column with that name
+//   r:    an open reader
+//   name: the column name
+int feature_reader_column (feature_reader* r, const char* name);
+
+// Return the first frame of a source at or after a time, or the first frame of a later source
+// if there is none (num_frames at the end of the file)
+//   r:      an open reader
+//   source: the source index
+//   time:   the time (in seconds)
+size_t feature_reader_find (feature_reader* r, size_t source, double time);
+
+// Return a column's values from a frame to the end of its block, in place
+//   r:      an open reader
+//   column: the column index
+//   frame:  the first frame
+//   count:  set to the number of values returned
+const double* feature_reader_values (feature_reader* r, size_t column, size_t frame, size_t* count);
+
+// Return one value
+//   r:      an open reader
+//   column: the column index
+//   frame:  the frame index
+double feature_reader_value (feature_reader* r, size_t column, size_t frame);
+
+// Unmap the file
+void feature_reader_close (feature_reader* r);
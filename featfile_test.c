@@ -0,0 +1,198 @@
+#include "featfile.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TEST_SOURCES 3
+#define TEST_FRAMES  1500 // Per source, so sources straddle blocks
+#define TEST_HOP     1024
+#define TEST_RATE    44100.0
+
+static double test_time (size_t frame)
+{
+    return (frame+1)*TEST_HOP/TEST_RATE;
+}
+
+static double test_value (size_t source, size_t frame, size_t column)
+{
+    return source*1e6 + frame*10 + column;
+}
+
+// Test that a written file reads back, by column, by value and by time
+bool round_trip_test ()
+{
+    char path[] = "/tmp/featfile_test_XXXXXX";
+    close(mkstemp(path));
+    const char* names[] = {"pitch", "centroid"};
+    feature_writer w;
+    if (!feature_writer_open(&w, path, TEST_RATE, TEST_HOP, names, 2))
+    {
+        fprintf(stderr, "FAILED: round trip\n    Could not create %s.\n", path);
+        return false;
+    }
+    char source_path[64];
+    for (size_t s = 0; s < TEST_SOURCES; ++s)
+    {
+        snprintf(source_path, sizeof(source_path), "take%zu.wav", s);
+        feature_writer_add_source(&w, source_path);
+        for (size_t f = 0; f < TEST_FRAMES; ++f)
+        {
+            double values[2] = {test_value(s, f, 0), test_value(s, f, 1)};
+            feature_writer_append(&w, s, test_time(f), values);
+        }
+    }
+    bool pass = feature_writer_close(&w);
+
+    feature_reader r;
+    if (!pass || !feature_reader_open(&r, path))
+    {
+        fprintf(stderr, "FAILED: round trip\n    Could not read %s.\n", path);
+        unlink(path);
+        return false;
+    }
+    const feature_header* h = r.header;
+    if (h->num_frames != TEST_SOURCES*TEST_FRAMES || h->num_columns != 4 || h->num_sources != TEST_SOURCES ||
+        h->hop != TEST_HOP || h->sample_rate != TEST_RATE || strcmp(r.sources[2], "take2.wav") != 0)
+    {
+        fprintf(stderr, "FAILED: round trip\n    Header: %llu frames, %u columns, %u sources\n",
+                (unsigned long long)h->num_frames, h->num_columns, h->num_sources);
+        pass = false;
+    }
+
+    int centroid = feature_reader_column(&r, "centroid");
+    if (centroid != 3 || feature_reader_column(&r, "time") != FEATURE_TIME || feature_reader_column(&r, "mfcc") != -1)
+    {
+        fprintf(stderr, "FAILED: round trip\n    Column lookup: centroid is %d\n", centroid);
+        pass = false;
+    }
+
+    // A whole column, a block at a time
+    size_t frame = 0, count;
+    while (pass && frame < h->num_frames)
+    {
+        const double* values = feature_reader_values(&r, centroid, frame, &count);
+        for (size_t i = 0; i < count && pass; ++i, ++frame)
+        {
+            double expected = test_value(frame/TEST_FRAMES, frame%TEST_FRAMES, 1);
+            if (values[i] != expected)
+            {
+                fprintf(stderr, "FAILED: round trip\n    Frame %zu: centroid %f, expected %f\n", frame, values[i], expected);
+                pass = false;
+            }
+        }
+    }
+
+    // Time ranges, including ones before, between and after the frames of a source
+    size_t sources[] = {0, 1, 2, 1, 0, 2};
+    double times[]   = {0, test_time(700), test_time(1499), test_time(1023) + 1e-9, 1000, -1};
+    size_t expected[] = {0, TEST_FRAMES + 700, 2*TEST_FRAMES + 1499, TEST_FRAMES + 1024, TEST_FRAMES, 2*TEST_FRAMES};
+    for (size_t i = 0; i < sizeof(times)/sizeof(times[0]) && pass; ++i)
+    {
+        size_t found = feature_reader_find(&r, sources[i], times[i]);
+        if (found != expected[i])
+        {
+            fprintf(stderr, "FAILED: round trip\n    Source %zu at %fs: frame %zu, expected %zu\n", sources[i], times[i], found, expected[i]);
+            pass = false;
+        }
+    }
+    if (pass && feature_reader_find(&r, TEST_SOURCES, 0) != h->num_frames)
+    {
+        fprintf(stderr, "FAILED: round trip\n    Found a frame past the last source\n");
+        pass = false;
+    }
+
+    feature_reader_close(&r);
+    unlink(path);
+    return pass;
+}
+
+// Overwrite the header of the feature file at path; return true iff it then fails to open
+static bool rejected_with (const char* path, const feature_header* h)
+{
+    FILE* f = fopen(path, "r+b");
+    if (f == NULL) return false;
+    bool written = fwrite(h, sizeof(feature_header), 1, f) == 1;
+    if (fclose(f) != 0) written = false;
+    feature_reader r;
+    if (!written || !feature_reader_open(&r, path)) return written;
+    feature_reader_close(&r);
+    return false;
+}
+
+// Test that files which aren't feature files are rejected
+bool reject_test ()
+{
+    char path[] = "/tmp/featfile_test_XXXXXX";
+    close(mkstemp(path));
+    FILE* f = fopen(path, "wb");
+    char junk[256] = "BLEEPCF1";
+    fwrite(junk, 1, sizeof(junk), f);
+    fclose(f);
+    feature_reader r;
+    bool pass = !feature_reader_open(&r, path) && !feature_reader_open(&r, "/tmp/featfile_test_missing");
+    if (!pass) fprintf(stderr, "FAILED: reject\n    Opened a file that isn't a feature file\n");
+
+    // A file cut off in the middle of its last source name
+    const char* names[] = {"pitch"};
+    feature_writer w;
+    double value = 0;
+    feature_writer_open(&w, path, TEST_RATE, TEST_HOP, names, 1);
+    feature_writer_add_source(&w, "take.wav");
+    feature_writer_append(&w, 0, test_time(0), &value);
+    feature_writer_close(&w);
+    bool opened = feature_reader_open(&r, path);
+    feature_header h;
+    if (opened)
+    {
+        h = *r.header;
+        feature_reader_close(&r);
+    }
+
+    // Headers whose regions overlap, or only line up once their offsets and sizes wrap around
+    if (opened)
+    {
+        feature_header overlap = h;
+        overlap.data_offset -= sizeof(double);
+        overlap.index_offset -= sizeof(double);
+        overlap.sources_offset -= sizeof(double);
+        feature_header wrapped_offset = h;
+        wrapped_offset.data_offset = UINT64_MAX - 7;
+        wrapped_offset.index_offset = h.index_offset - h.data_offset - 8;
+        wrapped_offset.sources_offset = wrapped_offset.index_offset + sizeof(feature_key);
+        feature_header wrapped_size = h; // 2^61+1 blocks of a frame of 3 columns wrap to 24 bytes of data
+        wrapped_size.block_frames = 1;
+        wrapped_size.num_frames = ((uint64_t)1 << 61) + 1;
+        wrapped_size.index_offset = h.data_offset + wrapped_size.num_columns*sizeof(double);
+        wrapped_size.sources_offset = wrapped_size.index_offset + sizeof(feature_key);
+        const char* failed = !rejected_with(path, &overlap)        ? "overlapping regions" :
+                             !rejected_with(path, &wrapped_offset) ? "a data offset past the end" :
+                             !rejected_with(path, &wrapped_size)   ? "a data size that wraps around" : NULL;
+        if (failed)
+        {
+            fprintf(stderr, "FAILED: reject\n    Opened a file with %s\n", failed);
+            pass = false;
+        }
+        opened = !rejected_with(path, &h); // The original header opens again
+    }
+    struct stat status;
+    opened = opened && stat(path, &status) == 0 && truncate(path, status.st_size - 1) == 0;
+    if (!opened || feature_reader_open(&r, path))
+    {
+        fprintf(stderr, "FAILED: reject\n    %s a truncated file\n", opened ? "Opened" : "Could not open the whole of");
+        pass = false;
+    }
+    unlink(path);
+    return pass;
+}
+
+int main (void)
+{
+    if (!round_trip_test()) return 1;
+    if (!reject_test()) return 1;
+    return 0;
+}
@@ -1,14 +1,22 @@
+#include "filter.h"
+#include "plans.h"
+#include "windowing.h"
+
 #include <fftw3.h>
 
+#include <math.h>
+#include <string.h>
+
+#define DECIMATOR_CUTOFF 0.9 // Decimator cutoff, as a fraction of the output Nyquist frequency
+
 void band_pass (double* sample, double* output, size_t sample_size, double sample_rate, double min_freq, double max_freq)
 {
     // Take FFT
-    fftw_complex* fft = fftw_malloc(sizeof(fftw_complex) * sample_size);
-    fftw_plan plan_forward = fftw_plan_dft_r2c_1d((int)sample_size, sample, fft, FFTW_ESTIMATE);
-    fftw_execute(plan_forward);
+    fftw_complex fft[sample_size/2+1];
+    fftw_execute_dft_r2c(plan_r2c(sample_size), sample, fft);
 
     // Normalize FFT
-    for (int i = 0; i < sample_size; ++i)
+    for (int i = 0; i < sample_size/2+1; ++i)
     {
         fft[i][0] /= sample_size;
         fft[i][1] /= sample_size;
@@ -17,7 +25,7 @@ void band_pass (double* sample, double* output, size_t sample_size, double sampl
     // Apply band pass
     int min_bin = min_freq * sample_size / sample_rate;
     int max_bin = max_freq * sample_size / sample_rate;
-    for (int i = 0; i < sample_size; ++i)
+    for (int i = 0; i < sample_size/2+1; ++i)
     {
         if (i < min_bin || max_bin < i)
         {
@@ -27,11 +35,155 @@ void band_pass (double* sample, double* output, size_t sample_size, double sampl
     }
 
     // Take inverse
-    fftw_plan plan_inverse = fftw_plan_dft_c2r_1d((int)sample_size, fft, output, FFTW_ESTIMATE);
-    fftw_execute(plan_inverse);
-
-    // Clean up
-    fftw_destroy_plan(plan_inverse);
-    fftw_destroy_plan(plan_forward);
-    fftw_free(fft);
-}
\ No newline at end of file
+    fftw_execute_dft_c2r(plan_c2r(sample_size), fft, output);
+}
+
+// Return sin(pi x)/(pi x)
+static double sinc (double x)
+{
+    return x == 0 ? 1 : sin(M_PI*x)/(M_PI*x);
+}
+
+void band_pass_init (band_pass_filter* f, size_t block_size, size_t num_taps, double sample_rate, double min_freq, double max_freq)
+{
+    if (num_taps % 2 == 0) ++num_taps;
+    f->block_size = block_size;
+    f->num_taps   = num_taps;
+    f->fft_size   = 1;
+    while (f->fft_size < block_size + num_taps - 1) f->fft_size *= 2;
+    f->input_loc  = 0;
+    f->input      = calloc(block_size, sizeof(double));
+    f->output     = calloc(block_size, sizeof(double));
+    f->overlap    = calloc(num_taps, sizeof(double));
+    f->padded     = fftw_malloc(sizeof(double) * f->fft_size);
+    f->spectrum   = fftw_malloc(sizeof(fftw_complex) * (f->fft_size/2+1));
+    f->response   = fftw_malloc(sizeof(fftw_complex) * (f->fft_size/2+1));
+
+    // Windowed sinc: the difference of two low passes
+    double low  = min_freq/sample_rate;
+    double high = max_freq/sample_rate < 0.5 ? max_freq/sample_rate : 0.5;
+    double center = (num_taps-1)/2.0;
+    for (size_t i = 0; i < num_taps; ++i)
+    {
+        double m = i - center;
+        f->padded[i] = 2*high*sinc(2*high*m) - 2*low*sinc(2*low*m);
+    }
+    blackman_window(f->padded, num_taps, f->padded);
+    for (size_t i = num_taps; i < f->fft_size; ++i) f->padded[i] = 0;
+
+    // Fold the inverse transform's scaling into the response
+    fftw_execute_dft_r2c(plan_r2c(f->fft_size), f->padded, f->response);
+    plan_c2r(f->fft_size); // band_pass_block's inverse, planned here so it is only looked up
+    for (size_t i = 0; i < f->fft_size/2+1; ++i)
+    {
+        f->response[i][0] /= f->fft_size;
+        f->response[i][1] /= f->fft_size;
+    }
+}
+
+// Convolve the complete input block, moving the result to output and the tail to overlap
+static void band_pass_block (band_pass_filter* f)
+{
+    memcpy(f->padded, f->input, sizeof(double) * f->block_size);
+    memset(f->padded + f->block_size, 0, sizeof(double) * (f->fft_size - f->block_size));
+    fftw_execute_dft_r2c(plan_r2c(f->fft_size), f->padded, f->spectrum);
+    for (size_t i = 0; i < f->fft_size/2+1; ++i)
+    {
+        double re = f->spectrum[i][0]*f->response[i][0] - f->spectrum[i][1]*f->response[i][1];
+        double im = f->spectrum[i][0]*f->response[i][1] + f->spectrum[i][1]*f->response[i][0];
+        f->spectrum[i][0] = re;
+        f->spectrum[i][1] = im;
+    }
+    fftw_execute_dft_c2r(plan_c2r(f->fft_size), f->spectrum, f->padded);
+
+    size_t tail = f->num_taps - 1;
+    for (size_t i = 0; i < f->block_size; ++i)
+    {
+        f->output[i] = f->padded[i] + (i < tail ? f->overlap[i] : 0);
+    }
+    for (size_t i = 0; i < tail; ++i)
+    {
+        // The old overlap beyond this block is read before it is overwritten
+        double carried = f->block_size + i < tail ? f->overlap[f->block_size + i] : 0;
+        f->overlap[i] = f->padded[f->block_size + i] + carried;
+    }
+}
+
+void band_pass_push (band_pass_filter* f, double* in, double* out, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        double sample = in[i];
+        out[i] = f->output[f->input_loc];
+        f->input[f->input_loc] = sample;
+        if (++f->input_loc == f->block_size)
+        {
+            band_pass_block(f);
+            f->input_loc = 0;
+        }
+    }
+}
+
+void band_pass_cleanup (band_pass_filter* f)
+{
+    free(f->input);
+    free(f->output);
+    free(f->overlap);
+    fftw_free(f->padded);
+    fftw_free(f->spectrum);
+    fftw_free(f->response);
+}
+
+void decimator_init (decimator* d, size_t factor, size_t num_taps)
+{
+    d->factor      = factor;
+    d->num_taps    = num_taps;
+    d->phase       = 0;
+    d->history_loc = 0;
+    d->taps        = calloc(num_taps, sizeof(double));
+    d->history     = calloc(2*num_taps, sizeof(double));
+
+    // Windowed sinc low pass with unity DC gain. It is symmetric, so it is its own time reversal.
+    double cutoff = DECIMATOR_CUTOFF/(2*factor);
+    double center = (num_taps-1)/2.0;
+    for (size_t i = 0; i < num_taps; ++i)
+        d->taps[i] = 2*cutoff*sinc(2*cutoff*(i - center));
+    blackman_window(d->taps, num_taps, d->taps);
+    double sum = 0;
+    for (size_t i = 0; i < num_taps; ++i) sum += d->taps[i];
+    for (size_t i = 0; i < num_taps; ++i) d->taps[i] /= sum;
+}
+
+size_t decimator_push (decimator* d, double* in, double* out, size_t count)
+{
+    size_t produced = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        double sample = in[i];
+        d->history[d->history_loc] = sample;
+        d->history[d->history_loc + d->num_taps] = sample;
+        if (++d->history_loc == d->num_taps) d->history_loc = 0;
+        if (++d->phase < d->factor) continue;
+        d->phase = 0;
+
+        // history[history_loc...] runs from the oldest input to the newest
+        double* window = d->history + d->history_loc;
+        double sum = 0;
+        for (size_t k = 0; k < d->num_taps; ++k) sum += d->taps[k]*window[k];
+        out[produced++] = sum;
+    }
+    return produced;
+}
+
+void decimator_reset (decimator* d)
+{
+    d->phase = 0;
+    d->history_loc = 0;
+    memset(d->history, 0, sizeof(double) * 2*d->num_taps);
+}
+
+void decimator_cleanup (decimator* d)
+{
+    free(d->taps);
+    free(d->history);
+}
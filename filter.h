@@ -1,10 +1,81 @@
+#include <fftw3.h>
+
 #include <stdlib.h>
 
+// Streaming FFT band pass filter (overlap-add convolution with a windowed sinc)
+typedef struct
+{
+    size_t        block_size; // Samples filtered per FFT
+    size_t        fft_size;   // Power of 2 >= block_size + num_taps - 1
+    size_t        num_taps;   // Length of the FIR kernel
+    size_t        input_loc;  // Position in the current block
+    double*       input;      // Block being accumulated (block_size)
+    double*       output;     // Filtered previous block, being read out (block_size)
+    double*       overlap;    // Convolution tail carried into the next block (num_taps-1)
+    double*       padded;     // Transform buffer (fft_size)
+    fftw_complex* spectrum;   // Transform buffer (fft_size/2+1)
+    fftw_complex* response;   // Frequency response of the kernel, normalized (fft_size/2+1)
+} band_pass_filter;
+
+// Streaming anti-aliased decimator. Only every factor-th output of the low pass is computed,
+// which costs num_taps/factor multiplies per input sample, like a polyphase filter bank.
+typedef struct
+{
+    size_t  factor;      // Input samples per output sample
+    size_t  num_taps;    // Length of the FIR kernel
+    size_t  phase;       // Inputs since the last output
+    size_t  history_loc; // Position of the oldest input in history
+    double* taps;        // Low pass kernel (num_taps)
+    double* history;     // Last num_taps inputs, stored twice so they can be read in one run (2*num_taps)
+} decimator;
+
 // Using an FFT, remove all frequencies below min_freq and above max_freq
 //   sample:      input array of length sample_size
-//   output:      output array of length sample_size/2+1
+//   output:      output array of length sample_size
 //   sample_size: the length of the sample array
 //   sample_rate: the sampling rate (in Hz) of the original sample
 //   min_freq:    
 //   max_freq:
-void band_pass (double* sample, double* output, size_t sample_size, double sample_rate, double min_freq, double max_freq);
\ No newline at end of file
+void band_pass (double* sample, double* output, size_t sample_size, double sample_rate, double min_freq, double max_freq);
+
+// Design a linear phase band pass filter and allocate its buffers
+//   f:           the filter to be initialized
+//   block_size:  the number of samples filtered at once, which is also the added latency
+//   num_taps:    the length of the FIR kernel (rounded up to an odd number); the filter
+//                delays its output by (num_taps-1)/2 samples on top of block_size
+//   sample_rate: the sampling rate (in Hz) of the input
+//   min_freq:    lower cutoff (0 for a low pass)
+//   max_freq:    upper cutoff (sample_rate/2 or more for a high pass)
+void band_pass_init (band_pass_filter* f, size_t block_size, size_t num_taps, double sample_rate, double min_freq, double max_freq);
+
+// Filter the next count samples of a stream. Any count may be pushed at a time; the output
+// lags the input by block_size samples, and is zero until the first block is complete.
+//   f:     an initialized filter
+//   in:    input array of length count
+//   out:   output array of length count (may be the same array as in)
+//   count: the number of samples pushed
+void band_pass_push (band_pass_filter* f, double* in, double* out, size_t count);
+
+// Release the filter's buffers
+void band_pass_cleanup (band_pass_filter* f);
+
+// Design the anti-aliasing low pass of a decimator and allocate its buffers. The passband
+// ends a little below the output Nyquist frequency, sample_rate/factor/2.
+//   d:        the decimator to be initialized
+//   factor:   the decimation factor, e.g. 2 or 4
+//   num_taps: the length of the FIR kernel; the output is delayed by (num_taps-1)/2 input
+//             samples, and the transition band narrows as num_taps grows
+void decimator_init (decimator* d, size_t factor, size_t num_taps);
+
+// Return the number of output samples produced from the next count input samples
+//   d:     an initialized decimator
+//   in:    input array of length count
+//   out:   output array of length count/factor + 1 (may be the same array as in)
+//   count: the number of samples pushed
+size_t decimator_push (decimator* d, double* in, double* out, size_t count);
+
+// Clear the decimator's history, as if it had only been fed silence
+void decimator_reset (decimator* d);
+
+// Release the decimator's buffers
+void decimator_cleanup (decimator* d);
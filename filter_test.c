@@ -1,9 +1,119 @@
 #include "filter.h"
 
+#include <math.h>
+#include <stdbool.h>
 #include <stdio.h>
 
+#define SAMPLE_RATE 44100.0
+
+// Return the RMS of the steady state of a sine filtered by a streaming band pass
+double streaming_gain (double freq, double min_freq, double max_freq)
+{
+    size_t size = 8192;
+    double sample[size];
+    for (size_t i = 0; i < size; ++i) sample[i] = sin(2*M_PI*freq*i/SAMPLE_RATE);
+
+    band_pass_filter f;
+    band_pass_init(&f, 256, 255, SAMPLE_RATE, min_freq, max_freq);
+    // Push in uneven chunks to exercise the block accumulation
+    for (size_t i = 0; i < size; i += 100)
+        band_pass_push(&f, sample + i, sample + i, i + 100 < size ? 100 : size - i);
+    band_pass_cleanup(&f);
+
+    double power = 0;
+    for (size_t i = size/2; i < size; ++i) power += sample[i]*sample[i];
+    return sqrt(2*power/(size/2));
+}
+
+// Test that streamed blocks join without edge artifacts: the output must be the direct
+// convolution of the input with the filter's impulse response
+bool continuity_test ()
+{
+    size_t size = 2048, block = 64, taps = 101;
+    double impulse[size], response[size], sample[size], output[size];
+    for (size_t i = 0; i < size; ++i) impulse[i] = i == 0;
+    for (size_t i = 0; i < size; ++i) sample[i] = sin(i*0.05) + (i%37)/37.0;
+
+    band_pass_filter f;
+    band_pass_init(&f, block, taps, SAMPLE_RATE, 300, 3000);
+    band_pass_push(&f, impulse, response, size);
+    band_pass_cleanup(&f);
+    band_pass_init(&f, block, taps, SAMPLE_RATE, 300, 3000);
+    band_pass_push(&f, sample, output, size);
+    band_pass_cleanup(&f);
+
+    double worst = 0;
+    for (size_t n = block; n < size; ++n)
+    {
+        double expected = 0;
+        for (size_t k = block; k <= n && k < block + taps; ++k) expected += response[k]*sample[n-k];
+        if (fabs(expected - output[n]) > worst) worst = fabs(expected - output[n]);
+    }
+    if (worst > 1e-9)
+    {
+        fprintf(stderr, "FAILED: streaming band pass continuity\n");
+        fprintf(stderr, "    Largest error: %g\n\n", worst);
+        return false;
+    }
+    return true;
+}
+
+// Test that the band pass keeps its passband and rejects the rest
+bool gain_test (double freq, double min_gain, double max_gain)
+{
+    double gain = streaming_gain(freq, 900, 2800);
+    if (gain < min_gain || gain > max_gain)
+    {
+        fprintf(stderr, "FAILED: streaming band pass gain\n");
+        fprintf(stderr, "    Frequency: %.0f\n", freq);
+        fprintf(stderr, "    Gain = %f (expected %.3f to %.3f)\n\n", gain, min_gain, max_gain);
+        return false;
+    }
+    return true;
+}
+
+// Test that the decimator keeps the output band and rejects what would alias into it
+bool decimator_test (size_t factor, double freq, double min_gain, double max_gain)
+{
+    size_t size = 8192;
+    double sample[size];
+    for (size_t i = 0; i < size; ++i) sample[i] = sin(2*M_PI*freq*i/SAMPLE_RATE);
+
+    decimator d;
+    decimator_init(&d, factor, 128);
+    size_t count = 0;
+    // Push in uneven chunks to exercise the output phase
+    for (size_t i = 0; i < size; i += 100)
+        count += decimator_push(&d, sample + i, sample + count, i + 100 < size ? 100 : size - i);
+    decimator_cleanup(&d);
+
+    double power = 0;
+    for (size_t i = count/2; i < count; ++i) power += sample[i]*sample[i];
+    double gain = sqrt(2*power/(count - count/2));
+    if (count != size/factor || gain < min_gain || gain > max_gain)
+    {
+        fprintf(stderr, "FAILED: decimator\n");
+        fprintf(stderr, "    Factor: %zu, frequency: %.0f\n", factor, freq);
+        fprintf(stderr, "    Outputs = %zu (expected %zu)\n", count, size/factor);
+        fprintf(stderr, "    Gain = %f (expected %.3f to %.3f)\n\n", gain, min_gain, max_gain);
+        return false;
+    }
+    return true;
+}
+
 int main ()
 {
+    bool pass = continuity_test();
+    pass = gain_test(1800, 0.98, 1.02) && pass;
+    pass = gain_test(200, 0, 0.01) && pass;
+    pass = gain_test(8000, 0, 0.01) && pass;
+    pass = decimator_test(4, 1000, 0.98, 1.02) && pass;
+    pass = decimator_test(4, 3500, 0.98, 1.02) && pass;
+    pass = decimator_test(4, 8000, 0, 0.01) && pass;
+    pass = decimator_test(2, 7000, 0.98, 1.02) && pass;
+    pass = decimator_test(2, 15000, 0, 0.01) && pass;
+    if (!pass) return 1;
+
     size_t size = 1024;
     double sample[size], output[size];
     for (int i = 0; i < size; ++i) sample[i] = i%128;
@@ -12,4 +122,4 @@ int main ()
     // band_pass(sample, output, size, 44100, 100, 1000);
     band_pass(sample, output, size, 44100, 0, 44100);
     for (int i = 0; i < size; ++i) printf("%f, %f\n", sample[i], output[i]);
-}
\ No newline at end of file
+}
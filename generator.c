@@ -0,0 +1,233 @@
+#include "generator.h"
+
+#include <complex.h>
+#include <math.h>
+#include <string.h>
+
+#define MAX_HARMONIC_FREQ 0.45 // Of the sampling rate
+
+// Formant frequencies and bandwidths (in Hz) of an adult male voice, from Peterson & Barney
+static const double formant_freqs[GENERATOR_VOWELS][GENERATOR_FORMANTS] = {
+    {730, 1090, 2440}, // a
+    {530, 1840, 2480}, // e
+    {270, 2290, 3010}, // i
+    {570,  840, 2410}, // o
+    {300,  870, 2240}, // u
+};
+static const double formant_bandwidths[GENERATOR_FORMANTS] = {80, 90, 120};
+
+// xorshift64*
+static uint64_t next_random (generator* g)
+{
+    g->random ^= g->random >> 12;
+    g->random ^= g->random << 25;
+    g->random ^= g->random >> 27;
+    return g->random * 0x2545F4914F6CDD1DULL;
+}
+
+static double uniform (generator* g, double low, double high)
+{
+    return low + (high-low)*((next_random(g) >> 11) * 0x1.0p-53);
+}
+
+static double gaussian (generator* g)
+{
+    double u = uniform(g, 0x1.0p-53, 1);
+    return sqrt(-2*log(u))*cos(2*M_PI*uniform(g, 0, 1));
+}
+
+// Return a two pole resonator with unity gain at DC, as in Klatt's cascade formant synthesizer
+static biquad resonator (double sample_rate, double freq, double bandwidth)
+{
+    double r = exp(-M_PI*bandwidth/sample_rate);
+    double c = 2*r*cos(2*M_PI*freq/sample_rate);
+    biquad q = {1 - c + r*r, 0, 0, -c, r*r};
+    return q;
+}
+
+void generator_default (generator_config* config)
+{
+    config->waveform      = GENERATOR_VOWEL;
+    config->vowel         = GENERATOR_ANY_VOWEL;
+    config->min_freq      = 100;
+    config->max_freq      = 400;
+    config->min_level     = 0.02;
+    config->max_level     = 0.2;
+    config->min_duration  = 0.3;
+    config->max_duration  = 1.0;
+    config->min_gap       = 0.2;
+    config->max_gap       = 0.6;
+    config->attack        = 0.005;
+    config->release       = 0.005;
+    config->sweep         = 0;
+    config->vibrato_rate  = 0;
+    config->vibrato_depth = 0;
+    config->snr           = 60;
+}
+
+// Draw the note after the current one
+static void draw_note (generator* g)
+{
+    generator_config* c = &g->config;
+    generator_note* n = &g->note;
+    n->onset   = g->num_notes ? n->end + (long)(uniform(g, c->min_gap, c->max_gap)*g->sample_rate) : 0;
+    n->release = n->onset + (long)(uniform(g, c->min_duration, c->max_duration)*g->sample_rate);
+    n->end     = n->release + (long)(c->release*g->sample_rate);
+    n->freq    = c->min_freq*pow(c->max_freq/c->min_freq, uniform(g, 0, 1));
+    n->level   = uniform(g, c->min_level, c->max_level);
+    n->vowel   = c->vowel == GENERATOR_ANY_VOWEL ? (int)(next_random(g) % GENERATOR_VOWELS) : c->vowel;
+    ++g->num_notes;
+}
+
+void generator_init (generator* g, const generator_config* config, double sample_rate, uint64_t seed)
+{
+    g->config      = *config;
+    g->sample_rate = sample_rate;
+    g->random      = seed ^ 0x9E3779B97F4A7C15ULL;
+    if (g->random == 0) g->random = 1;
+    g->position    = 0;
+    g->num_notes   = 0;
+    g->phase       = 0;
+    g->noise       = isfinite(config->snr) ? config->max_level*pow(10, -config->snr/20) : 0;
+    for (int v = 0; v < GENERATOR_VOWELS; ++v)
+        for (int f = 0; f < GENERATOR_FORMANTS; ++f)
+            g->formants[v][f] = resonator(sample_rate, formant_freqs[v][f], formant_bandwidths[f]);
+    g->weights_block = -1; // No harmonic amplitudes yet
+    draw_note(g);
+}
+
+// Return the gain of a vowel's formant resonators, in cascade, at a frequency
+static double formant_gain (generator* g, int vowel, double freq)
+{
+    double complex z = cexp(-I*2*M_PI*freq/g->sample_rate); // z^-1
+    double gain = 1;
+    for (int f = 0; f < GENERATOR_FORMANTS; ++f)
+    {
+        biquad* q = &g->formants[vowel][f];
+        gain *= cabs((q->b0 + q->b1*z + q->b2*z*z)/(1 + q->a1*z + q->a2*z*z));
+    }
+    return gain;
+}
+
+// Fill the harmonic amplitudes of the note at a fundamental, scaled to the note's RMS level;
+// return the number of harmonics
+static int harmonic_weights (generator* g, double freq, double max_freq, double* weights)
+{
+    int count = 1;
+    if (g->config.waveform != GENERATOR_SINE)
+        while (count < GENERATOR_MAX_HARMONICS && (count+1)*max_freq < MAX_HARMONIC_FREQ*g->sample_rate) ++count;
+    double power = 0;
+    for (int h = 1; h <= count; ++h)
+    {
+        weights[h-1] = 1.0/h;
+        if (g->config.waveform == GENERATOR_VOWEL) weights[h-1] *= formant_gain(g, g->note.vowel, h*freq);
+        power += weights[h-1]*weights[h-1]/2;
+    }
+    double scale = power > 0 ? g->note.level/sqrt(power) : 0;
+    for (int h = 0; h < count; ++h) weights[h] *= scale;
+    return count;
+}
+
+// Return the fundamental of the current note at a position within it
+static double note_freq (generator* g, long position)
+{
+    generator_config* c = &g->config;
+    double t = (position - g->note.onset)/g->sample_rate;
+    double cents = 1200*c->sweep*t + c->vibrato_depth*sin(2*M_PI*c->vibrato_rate*t);
+    return g->note.freq*exp2(cents/1200);
+}
+
+// Generate the samples of the current note (or the gap before it) up to the end of a block
+// of the GENERATOR_BLOCK grid
+static void generate_block (generator* g, float* out, float* labels, size_t count)
+{
+    generator_config* c = &g->config;
+    generator_note* n = &g->note;
+    double phase[GENERATOR_BLOCK], envelope[GENERATOR_BLOCK];
+    for (size_t i = 0; i < count; ++i)
+    {
+        long position = g->position + i;
+        double freq = 0, level = 0;
+        if (position >= n->onset && position < n->end)
+        {
+            double t = (position - n->onset)/g->sample_rate;
+            freq = note_freq(g, position);
+            level = c->attack > 0 ? fmin(1, t/c->attack) : 1;
+            if (position >= n->release) level = fmin(level, (n->end - position)/(c->release*g->sample_rate));
+        }
+        g->phase += freq/g->sample_rate;
+        g->phase -= floor(g->phase);
+        phase[i] = 2*M_PI*g->phase;
+        envelope[i] = level;
+        if (labels) labels[i] = level > 0 ? freq : 0;
+    }
+
+    // The harmonic amplitudes follow the note over its part of the whole grid block, even
+    // when this read covers less of it, so they don't depend on how the signal is read
+    long block_start = g->position - g->position % GENERATOR_BLOCK;
+    long first = block_start > n->onset ? block_start : n->onset;
+    long last = block_start + GENERATOR_BLOCK < n->end ? block_start + GENERATOR_BLOCK : n->end;
+    double mix[GENERATOR_BLOCK] = {0};
+    if (first < last && g->position + (long)count > n->onset)
+    {
+        if (g->weights_block != block_start || g->weights_note != g->num_notes)
+        {
+            double sum = 0, max_freq = 0;
+            for (long position = first; position < last; ++position)
+            {
+                double freq = note_freq(g, position);
+                sum += freq;
+                if (freq > max_freq) max_freq = freq;
+            }
+            g->num_harmonics = harmonic_weights(g, sum/(last - first), max_freq, g->weights);
+            g->weights_block = block_start;
+            g->weights_note  = g->num_notes;
+        }
+        const double* weights = g->weights;
+        int num_harmonics = g->num_harmonics;
+        double s0[GENERATOR_BLOCK], s1[GENERATOR_BLOCK], c2[GENERATOR_BLOCK];
+        double* prev = s0;
+        double* current = s1;
+        for (size_t i = 0; i < count; ++i)
+        {
+            prev[i] = 0;
+            current[i] = sin(phase[i]);
+            c2[i] = 2*cos(phase[i]);
+            mix[i] = weights[0]*current[i];
+        }
+        for (int h = 1; h < num_harmonics; ++h)
+        {
+            double w = weights[h];
+            for (size_t i = 0; i < count; ++i)
+            {
+                prev[i] = c2[i]*current[i] - prev[i];
+                mix[i] += w*prev[i];
+            }
+            double* swap = prev;
+            prev = current;
+            current = swap;
+        }
+    }
+
+    for (size_t i = 0; i < count; ++i) out[i] = mix[i]*envelope[i];
+    if (g->noise > 0)
+        for (size_t i = 0; i < count; ++i) out[i] += g->noise*gaussian(g);
+}
+
+void generator_read (generator* g, float* out, float* labels, size_t count)
+{
+    size_t done = 0;
+    while (done < count)
+    {
+        if (g->position >= g->note.end) draw_note(g);
+        // Blocks end on the grid and with the note, so a block's harmonic amplitudes belong to
+        // a single note
+        size_t block = count - done;
+        size_t to_grid = GENERATOR_BLOCK - g->position % GENERATOR_BLOCK;
+        if (block > to_grid) block = to_grid;
+        if ((long)block > g->note.end - g->position) block = g->note.end - g->position;
+        generate_block(g, out + done, labels ? labels + done : NULL, block);
+        g->position += block;
+        done += block;
+    }
+}
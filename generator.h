@@ -0,0 +1,95 @@
+// Signal generator
+//
+// Endless labeled test signals: a sequence of notes with random pitch, level, length and
+// spacing, over background noise. A note is a sine, a harmonic series, or a harmonic series
+// shaped by the formants of a vowel, and may glide (a log sweep) and carry vibrato. The
+// generator keeps its own random state, so a seed and a configuration always produce the
+// same samples, on any machine.
+//
+// Samples are generated a block at a time. Harmonics come from the Chebyshev recurrence
+// sin((h+1)x) = 2cos(x)sin(hx) - sin((h-1)x), one loop over the block per harmonic, which
+// the compiler vectorizes; formants are applied to the harmonic amplitudes once per block.
+// Blocks lie on a fixed grid of positions, so the signal is the same however it is read.
+#include "biquad.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define GENERATOR_BLOCK         256 // Samples generated with one set of harmonic amplitudes
+#define GENERATOR_MAX_HARMONICS 40
+#define GENERATOR_FORMANTS      3
+
+// Waveforms
+#define GENERATOR_SINE     0 // The fundamental alone
+#define GENERATOR_HARMONIC 1 // Harmonics falling 6dB per octave, up to 0.45 of the sampling rate
+#define GENERATOR_VOWEL    2 // Harmonics through the formants of a vowel
+
+// Vowels
+#define GENERATOR_ANY_VOWEL -1 // A random vowel for every note
+#define GENERATOR_A         0
+#define GENERATOR_E         1
+#define GENERATOR_I         2
+#define GENERATOR_O         3
+#define GENERATOR_U         4
+#define GENERATOR_VOWELS    5
+
+typedef struct
+{
+    int    waveform;
+    int    vowel;                      // GENERATOR_VOWEL formants, or GENERATOR_ANY_VOWEL
+    double min_freq, max_freq;         // Fundamentals (in Hz) are drawn log-uniformly from this range
+    double min_level, max_level;       // RMS amplitudes are drawn uniformly from this range
+    double min_duration, max_duration; // Seconds from onset to release
+    double min_gap, max_gap;           // Seconds of silence after every release
+    double attack, release;            // Seconds of the linear onset and offset ramps
+    double sweep;                      // Octaves per second every note glides
+    double vibrato_rate;               // Hz
+    double vibrato_depth;              // Cents
+    double snr;                        // Level of max_level over the noise (in dB), INFINITY for none
+} generator_config;
+
+typedef struct
+{
+    long   onset;   // Sample position of the start of the attack
+    long   release; // Sample position of the start of the release
+    long   end;     // Sample position of the end of the release
+    double freq;    // Fundamental (in Hz) at the onset
+    double level;   // RMS amplitude
+    int    vowel;
+} generator_note;
+
+typedef struct
+{
+    generator_config config;
+    double           sample_rate;
+    uint64_t         random;
+    long             position;  // Samples generated so far
+    size_t           num_notes; // Notes drawn so far
+    generator_note   note;      // The note being played, or the next one during a gap
+    double           phase;     // Of the fundamental, in cycles
+    double           noise;     // RMS of the background noise
+    long             weights_block; // Grid block and note the harmonic amplitudes were computed for
+    size_t           weights_note;
+    int              num_harmonics;
+    double           weights[GENERATOR_MAX_HARMONICS];
+    biquad           formants[GENERATOR_VOWELS][GENERATOR_FORMANTS];
+} generator;
+
+// Fill a configuration with voice-like defaults: random vowels from 100Hz to 400Hz with gaps
+//   config: the configuration to be filled
+void generator_default (generator_config* config);
+
+// Initialize a generator and draw its first note
+//   g:           the generator to be initialized
+//   config:      copied into the generator
+//   sample_rate: the sampling rate (in Hz) of the output
+//   seed:        any value; equal seeds give equal signals
+void generator_init (generator* g, const generator_config* config, double sample_rate, uint64_t seed);
+
+// Generate the next samples
+//   g:      an initialized generator
+//   out:    output array of length count
+//   labels: output array of length count, the fundamental (in Hz) of every sample, 0 where no
+//           note sounds; or NULL
+//   count:  the number of samples
+void generator_read (generator* g, float* out, float* labels, size_t count);
@@ -0,0 +1,213 @@
+#include "generator.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SAMPLE_RATE 44100.0
+
+// A single note held for the whole test, without noise
+static void steady_config (generator_config* config, int waveform, double freq, double level)
+{
+    generator_default(config);
+    config->waveform     = waveform;
+    config->min_freq     = config->max_freq     = freq;
+    config->min_level    = config->max_level    = level;
+    config->min_duration = config->max_duration = 1000;
+    config->snr          = INFINITY;
+}
+
+// Test that equal seeds give equal signals and different seeds different ones, with notes
+// gliding at sweep octaves per second and carrying vibrato
+bool seed_test (double sweep, double vibrato_rate, double vibrato_depth)
+{
+    generator_config config;
+    generator_default(&config);
+    config.sweep         = sweep;
+    config.vibrato_rate  = vibrato_rate;
+    config.vibrato_depth = vibrato_depth;
+    size_t size = SAMPLE_RATE*3;
+    float* a = malloc(sizeof(float) * size);
+    float* b = malloc(sizeof(float) * size);
+    float* c = malloc(sizeof(float) * size);
+    generator g;
+    generator_init(&g, &config, SAMPLE_RATE, 42);
+    generator_read(&g, a, NULL, size);
+    // Reading in odd sized pieces gives the same signal
+    generator_init(&g, &config, SAMPLE_RATE, 42);
+    for (size_t done = 0; done < size; done += 777)
+        generator_read(&g, b + done, NULL, done + 777 < size ? 777 : size - done);
+    generator_init(&g, &config, SAMPLE_RATE, 43);
+    generator_read(&g, c, NULL, size);
+    bool pass = memcmp(a, b, sizeof(float) * size) == 0 && memcmp(a, c, sizeof(float) * size) != 0;
+    if (!pass) fprintf(stderr, "FAILED: seed\n    Sweep: %g, vibrato: %gHz, %g cents\n", sweep, vibrato_rate, vibrato_depth);
+    free(a);
+    free(b);
+    free(c);
+    return pass;
+}
+
+// Test the RMS level of every waveform and vowel, and the pitch by counting upward zero
+// crossings of the fundamental (harmonics falling 6dB per octave cross zero once per period)
+bool level_test (int waveform, int vowel, double freq, double level)
+{
+    generator_config config;
+    steady_config(&config, waveform, freq, level);
+    config.vowel = vowel;
+    size_t size = SAMPLE_RATE;
+    float* sample = malloc(sizeof(float) * size);
+    generator g;
+    generator_init(&g, &config, SAMPLE_RATE, 1);
+    generator_read(&g, sample, NULL, size);
+
+    double power = 0;
+    size_t crossings = 0;
+    for (size_t i = 0; i < size; ++i)
+    {
+        power += sample[i]*sample[i];
+        if (i > 0 && sample[i-1] < 0 && sample[i] >= 0) ++crossings;
+    }
+    double rms = sqrt(power/size);
+    bool pass = fabs(rms/level - 1) < 0.01;
+    if (waveform != GENERATOR_VOWEL) pass = pass && fabs(crossings - freq) <= 1;
+    if (!pass) fprintf(stderr, "FAILED: level\n    Waveform: %d, vowel: %d, rms: %f, expected: %f, crossings: %zu\n",
+                       waveform, vowel, rms, level, crossings);
+    free(sample);
+    return pass;
+}
+
+// Return the power of a harmonic of a signal holding a whole number of periods
+static double harmonic_power (float* sample, size_t size, double freq)
+{
+    double re = 0, im = 0;
+    for (size_t i = 0; i < size; ++i)
+    {
+        re += sample[i]*cos(2*M_PI*freq*i/SAMPLE_RATE);
+        im += sample[i]*sin(2*M_PI*freq*i/SAMPLE_RATE);
+    }
+    return (re*re + im*im)/(size*size);
+}
+
+// Test that the formants of an i put more of its energy above 1.5kHz than those of a u
+bool vowel_test ()
+{
+    double high[2];
+    int vowels[2] = {GENERATOR_I, GENERATOR_U};
+    size_t size = 7350; // 20 periods of 120Hz
+    float sample[size];
+    for (int v = 0; v < 2; ++v)
+    {
+        generator_config config;
+        steady_config(&config, GENERATOR_VOWEL, 120, 0.1);
+        config.vowel = vowels[v];
+        config.attack = 0;
+        generator g;
+        generator_init(&g, &config, SAMPLE_RATE, 1);
+        generator_read(&g, sample, NULL, size);
+        double above = 0, total = 0;
+        for (int h = 1; h <= GENERATOR_MAX_HARMONICS; ++h)
+        {
+            double power = harmonic_power(sample, size, 120*h);
+            if (120*h > 1500) above += power;
+            total += power;
+        }
+        high[v] = above/total;
+    }
+    bool pass = high[0] > 10*high[1];
+    if (!pass) fprintf(stderr, "FAILED: vowel\n    i: %f, u: %f\n", high[0], high[1]);
+    return pass;
+}
+
+// Test that the labels of a sweep with vibrato follow the expected fundamental, and are 0
+// outside the note
+bool label_test ()
+{
+    generator_config config;
+    steady_config(&config, GENERATOR_SINE, 200, 0.1);
+    config.min_duration  = config.max_duration = 2;
+    config.min_gap       = config.max_gap      = 1;
+    config.sweep         = 0.5;
+    config.vibrato_rate  = 5;
+    config.vibrato_depth = 20;
+    size_t size = SAMPLE_RATE*3.5;
+    float* sample = malloc(sizeof(float) * size);
+    float* labels = malloc(sizeof(float) * size);
+    generator g;
+    generator_init(&g, &config, SAMPLE_RATE, 1);
+    generator_read(&g, sample, labels, size);
+
+    long end = 2*SAMPLE_RATE + (long)(config.release*SAMPLE_RATE);
+    bool pass = true;
+    for (size_t i = 1; i < size && pass; ++i)
+    {
+        double t = i/SAMPLE_RATE;
+        double expected = 0;
+        if ((long)i < end)
+            expected = 200*exp2(0.5*t + 20*sin(2*M_PI*5*t)/1200);
+        else if (i >= end + SAMPLE_RATE)
+            expected = labels[i]; // The next note
+        pass = fabs(labels[i] - expected) < 0.01*expected + 1e-6;
+        if (!pass) fprintf(stderr, "FAILED: label\n    Sample: %zu, label: %f, expected: %f\n", i, labels[i], expected);
+    }
+    pass = pass && g.num_notes == 2 && g.note.onset == end + SAMPLE_RATE;
+    if (!pass) fprintf(stderr, "FAILED: label\n    Notes: %zu, onset: %ld\n", g.num_notes, g.note.onset);
+    free(sample);
+    free(labels);
+    return pass;
+}
+
+// Test the RMS of the noise between notes against the SNR
+bool noise_test ()
+{
+    generator_config config;
+    steady_config(&config, GENERATOR_SINE, 200, 0.1);
+    config.min_duration = config.max_duration = 0.01;
+    config.min_gap      = config.max_gap      = 10;
+    config.snr          = 40;
+    size_t size = SAMPLE_RATE*2;
+    float* sample = malloc(sizeof(float) * size);
+    generator g;
+    generator_init(&g, &config, SAMPLE_RATE, 1);
+    generator_read(&g, sample, NULL, size);
+    double power = 0;
+    for (size_t i = SAMPLE_RATE; i < size; ++i) power += sample[i]*sample[i];
+    double rms = sqrt(power/SAMPLE_RATE);
+    bool pass = fabs(rms/0.001 - 1) < 0.02;
+    if (!pass) fprintf(stderr, "FAILED: noise\n    RMS: %f, expected: 0.001\n", rms);
+    free(sample);
+    return pass;
+}
+
+// Print how much faster than real time the default signal is generated
+void speed_bench ()
+{
+    generator_config config;
+    generator_default(&config);
+    generator g;
+    generator_init(&g, &config, SAMPLE_RATE, 1);
+    float sample[4096];
+    size_t seconds = 60;
+    clock_t start = clock();
+    for (size_t i = 0; i < seconds*SAMPLE_RATE/4096; ++i) generator_read(&g, sample, NULL, 4096);
+    double elapsed = (double)(clock() - start)/CLOCKS_PER_SEC;
+    printf("Generated %zus of audio in %.2fs (%.0fx real time)\n", seconds, elapsed, seconds/elapsed);
+}
+
+int main (void)
+{
+    if (!seed_test(0, 0, 0)) return 1;
+    if (!seed_test(0.5, 5, 30)) return 1;
+    for (int waveform = GENERATOR_SINE; waveform <= GENERATOR_HARMONIC; ++waveform)
+        for (double freq = 100; freq <= 800; freq *= 2)
+            if (!level_test(waveform, GENERATOR_A, freq, 0.1)) return 1;
+    for (int vowel = 0; vowel < GENERATOR_VOWELS; ++vowel)
+        if (!level_test(GENERATOR_VOWEL, vowel, 150, 0.05)) return 1;
+    if (!vowel_test()) return 1;
+    if (!label_test()) return 1;
+    if (!noise_test()) return 1;
+    speed_bench();
+    return 0;
+}
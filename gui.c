@@ -25,6 +25,7 @@ static pthread_mutex_t spectrogram_lock;
 
 static int spectrogram_buffer_loc;
 static double spectrogram_buffer[SPECTROGRAM_LENGTH][FFT_SIZE/2+1];
+static double cqt_buffer[SPECTROGRAM_LENGTH][CQT_BINS];
 static double pitch_lp_buffer[SPECTROGRAM_LENGTH];
 
 static float g_rotate = 0;
@@ -116,7 +117,9 @@ static void graph_dominant_pitch_lp ()
 
 static void graph_spectrogram (int dbRange)
 {
-    double logMax = log10(SAMPLE_RATE/2);
+    //constant-Q spectrogram, a semitone per row from CQT_MIN_FREQ (bins are already log spaced)
+    glLoadIdentity();
+    glTranslatef(0.0,0.0,-1.0); //fills the view at a 90 degree field of view
     for (int i = 0; i<SPECTROGRAM_LENGTH; ++i)
     {
         double curXLeft  = aspectRatio * (2 * (double)i/SPECTROGRAM_LENGTH - 1);
@@ -124,12 +127,10 @@ static void graph_spectrogram (int dbRange)
         glBegin(GL_QUAD_STRIP);
         glVertex3f(curXLeft , -1, 0);
         glVertex3f(curXRight, -1, 0);
-        for (int j = 1; j<FFT_SIZE/2+1; ++j)
+        for (int j = 0; j<CQT_BINS; ++j)
         {
-            //draw QUAD for each bin?
-            double logJ  = x_log_normalize(j*BIN_SIZE, logMax);
-            double curYTop = 2*logJ-1;
-            double scaledMag = spectrogram_buffer[(i+spectrogram_buffer_loc)%SPECTROGRAM_LENGTH][j];
+            double curYTop = 2*(double)(j+1)/CQT_BINS-1;
+            double scaledMag = cqt_buffer[(i+spectrogram_buffer_loc)%SPECTROGRAM_LENGTH][j];
             glColor3f(scaledMag, scaledMag, scaledMag);
             glVertex3f(curXLeft, curYTop, 0.f);
             glVertex3f(curXRight, curYTop, 0.f);
@@ -460,6 +461,8 @@ void gui_fft_filled ()
         spectrogram_buffer[spectrogram_buffer_loc][i] = db_normalize(fft_mag[i], 1, 96);
         pitch_lp_buffer[spectrogram_buffer_loc] = dominant_frequency_lp;
     }
+    for (int i = 0; i < CQT_BINS; ++i)
+        cqt_buffer[spectrogram_buffer_loc][i] = db_normalize(cqt_mag[i], 1, dbRange); //a unit sine is 0dB
     spectrogram_buffer_loc = (spectrogram_buffer_loc+1)%SPECTROGRAM_LENGTH;
     pthread_mutex_unlock(&spectrogram_lock);
 }
@@ -476,7 +479,10 @@ void gui_redraw ()
     // pthread_mutex_lock(&spectrogram_lock);
     // graph_spectrogram_3d_poly(dbRange);
     // pthread_mutex_unlock(&spectrogram_lock);
-    draw_cube(1);
+    // draw_cube(1);
+    pthread_mutex_lock(&spectrogram_lock);
+    graph_spectrogram(dbRange);
+    pthread_mutex_unlock(&spectrogram_lock);
 
     glfwSwapBuffers(mainWindow);
 
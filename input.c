@@ -0,0 +1,112 @@
+#include "input.h"
+
+#include <math.h>
+#include <stdint.h>
+
+#define CHUNK 256 // Samples converted at a time, on the stack
+
+size_t input_sample_size (int format)
+{
+    return format == INPUT_INT16 ? 2 : format == INPUT_INT24 ? 3 : 4;
+}
+
+void input_convert (int format, const void* in, float* out, size_t count)
+{
+    if (format == INPUT_INT16)
+    {
+        const int16_t* samples = in;
+        for (size_t i = 0; i < count; ++i) out[i] = samples[i]*(1.0f/32768);
+    }
+    else if (format == INPUT_INT24)
+    {
+        const uint8_t* bytes = in;
+        for (size_t i = 0; i < count; ++i)
+        {
+            // Assemble the sample in the top of an int32, and shift it down to sign extend
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            int32_t value = (uint32_t)bytes[3*i] << 8 | (uint32_t)bytes[3*i+1] << 16 | (uint32_t)bytes[3*i+2] << 24;
+#else
+            int32_t value = (uint32_t)bytes[3*i+2] << 8 | (uint32_t)bytes[3*i+1] << 16 | (uint32_t)bytes[3*i] << 24;
+#endif
+            out[i] = (value >> 8)*(1.0f/8388608);
+        }
+    }
+    else
+    {
+        const float* samples = in;
+        for (size_t i = 0; i < count; ++i) out[i] = samples[i];
+    }
+}
+
+// Flag the samples at or beyond full scale
+static void mark_clipped (int format, const void* in, const float* converted, uint8_t* clipped, size_t count)
+{
+    if (format == INPUT_INT16)
+    {
+        const int16_t* samples = in;
+        for (size_t i = 0; i < count; ++i) clipped[i] = (samples[i] == INT16_MAX) | (samples[i] == INT16_MIN);
+    }
+    else if (format == INPUT_INT24)
+    {
+        for (size_t i = 0; i < count; ++i) clipped[i] = (converted[i] >= 8388607.0f/8388608) | (converted[i] <= -1);
+    }
+    else
+    {
+        for (size_t i = 0; i < count; ++i) clipped[i] = (converted[i] > 1) | (converted[i] < -1);
+    }
+}
+
+void input_init (input_stage* s, int format, double sample_rate, double dc_cutoff)
+{
+    s->format = format;
+    s->pole   = exp(-2*M_PI*dc_cutoff/sample_rate);
+    atomic_init(&s->clipped, 0);
+    input_reset(s);
+}
+
+void input_process (input_stage* s, const void* in, float* out, size_t count)
+{
+    size_t sample_size = input_sample_size(s->format);
+    size_t clipped = 0;
+    uint8_t full_scale[CHUNK];
+    for (size_t done = 0; done < count; done += CHUNK)
+    {
+        size_t n = count - done < CHUNK ? count - done : CHUNK;
+        const char* raw = (const char*)in + done*sample_size;
+        float* x = out + done;
+        input_convert(s->format, raw, x, n);
+        mark_clipped(s->format, raw, x, full_scale, n);
+
+        // y[n] = x[n] - x[n-1] + pole*y[n-1]
+        double x1 = s->x1, y1 = s->y1, pole = s->pole;
+        for (size_t i = 0; i < n; ++i)
+        {
+            double y = x[i] - x1 + pole*y1;
+            x1 = x[i];
+            y1 = y;
+            x[i] = y;
+        }
+        s->x1 = x1;
+        s->y1 = y1;
+
+        // A sample counts once, whether it was clipped on the way in or the DC blocker
+        // pushed it past full scale
+        for (size_t i = 0; i < n; ++i)
+        {
+            clipped += full_scale[i] | (x[i] > 1) | (x[i] < -1);
+            x[i] = x[i] > 1 ? 1 : x[i] < -1 ? -1 : x[i];
+        }
+    }
+    if (clipped) atomic_fetch_add_explicit(&s->clipped, clipped, memory_order_relaxed);
+}
+
+size_t input_clipped (input_stage* s)
+{
+    return atomic_exchange_explicit(&s->clipped, 0, memory_order_relaxed);
+}
+
+void input_reset (input_stage* s)
+{
+    s->x1 = 0;
+    s->y1 = 0;
+}
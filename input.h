@@ -0,0 +1,55 @@
+// Input conditioning
+//
+// Turns raw input buffers into the samples the backend takes, inside the audio callback:
+// samples are converted to float, high passed by a one pole DC blocker and clipped to
+// [-1, 1]. Samples at full scale on the way in, or pushed past it by the DC blocker, are
+// counted into an atomic counter, which another thread reads and reports; nothing here
+// blocks, allocates or does I/O. Conversion, clip counting and
+// clamping are loops the compiler vectorizes; only the DC blocker's recursion is scalar.
+#include <stdatomic.h>
+#include <stdlib.h>
+
+// Sample formats, in native byte order
+#define INPUT_FLOAT32 0
+#define INPUT_INT16   1
+#define INPUT_INT24   2 // Packed, 3 bytes per sample
+
+typedef struct
+{
+    int           format;
+    double        pole;     // Of the DC blocker, just inside the unit circle
+    double        x1, y1;   // DC blocker state
+    atomic_size_t clipped;  // Samples clipped since the last input_clipped
+} input_stage;
+
+// Return the size (in bytes) of a sample of a format
+//   format: INPUT_FLOAT32, INPUT_INT16 or INPUT_INT24
+size_t input_sample_size (int format);
+
+// Convert samples to float in [-1, 1); a clipping float sample may be outside
+//   format: INPUT_FLOAT32, INPUT_INT16 or INPUT_INT24
+//   in:     input array of count samples
+//   out:    output array of length count; may overlap the end of in, as long as out starts
+//           no later than in
+//   count:  the number of samples
+void input_convert (int format, const void* in, float* out, size_t count);
+
+// Initialize an input stage
+//   s:           the stage to be initialized
+//   format:      the format of the input
+//   sample_rate: the sampling rate (in Hz) of the input
+//   dc_cutoff:   the -3dB frequency (in Hz) of the DC blocker
+void input_init (input_stage* s, int format, double sample_rate, double dc_cutoff);
+
+// Condition a buffer of input
+//   s:     an initialized stage
+//   in:    input array of count samples in the stage's format
+//   out:   output array of length count
+//   count: the number of samples
+void input_process (input_stage* s, const void* in, float* out, size_t count);
+
+// Return the number of samples clipped since the last call; safe from any thread
+size_t input_clipped (input_stage* s);
+
+// Clear the DC blocker, keeping the clip count
+void input_reset (input_stage* s);
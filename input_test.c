@@ -0,0 +1,168 @@
+#include "input.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SAMPLE_RATE 44100.0
+#define DC_CUTOFF   10.0
+
+// Write a sample as packed 24 bit PCM
+static void put_int24 (uint8_t* out, int32_t value)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    out[0] = value; out[1] = value >> 8; out[2] = value >> 16;
+#else
+    out[2] = value; out[1] = value >> 8; out[0] = value >> 16;
+#endif
+}
+
+// Test that every format converts exactly, and that full scale samples count as clipped
+bool convert_test ()
+{
+    int32_t values[] = {-8388608, -4194304, -256, 0, 256, 4194304, 8388607};
+    size_t count = sizeof(values)/sizeof(values[0]);
+    int16_t int16[count];
+    uint8_t int24[3*count];
+    float float32[count];
+    for (size_t i = 0; i < count; ++i)
+    {
+        int16[i] = values[i] >> 8;
+        put_int24(int24 + 3*i, values[i]);
+        float32[i] = values[i]/8388608.0f;
+    }
+
+    bool pass = true;
+    float out[count];
+    input_convert(INPUT_INT16, int16, out, count);
+    for (size_t i = 0; i < count; ++i) pass = pass && out[i] == (values[i] >> 8)/32768.0f;
+    input_convert(INPUT_INT24, int24, out, count);
+    for (size_t i = 0; i < count; ++i) pass = pass && out[i] == values[i]/8388608.0f;
+    input_convert(INPUT_FLOAT32, float32, out, count);
+    pass = pass && memcmp(out, float32, sizeof(out)) == 0;
+    if (!pass)
+    {
+        fprintf(stderr, "FAILED: convert\n");
+        return false;
+    }
+
+    // Only the ends of the integer ranges clip, and floats clip beyond them. The -1 after
+    // -1.5 is pushed past full scale by the DC blocker, so it counts too.
+    input_stage s;
+    float big[] = {-1.5f, -1, 0, 1, 1.0001f, 100};
+    size_t clipped[3];
+    input_init(&s, INPUT_INT16, SAMPLE_RATE, DC_CUTOFF);
+    input_process(&s, int16, out, count);
+    clipped[0] = input_clipped(&s);
+    input_init(&s, INPUT_INT24, SAMPLE_RATE, DC_CUTOFF);
+    input_process(&s, int24, out, count);
+    clipped[1] = input_clipped(&s);
+    input_init(&s, INPUT_FLOAT32, SAMPLE_RATE, DC_CUTOFF);
+    input_process(&s, big, out, 6);
+    clipped[2] = input_clipped(&s);
+    for (size_t i = 0; i < 6; ++i) pass = pass && out[i] >= -1 && out[i] <= 1;
+    pass = pass && clipped[0] == 2 && clipped[1] == 2 && clipped[2] == 4 && input_clipped(&s) == 0;
+    if (!pass) fprintf(stderr, "FAILED: clipping\n    Clipped: %zu, %zu, %zu\n", clipped[0], clipped[1], clipped[2]);
+
+    // Once an offset is removed, a swing to the other side overshoots without clipping on the way in
+    size_t size = SAMPLE_RATE;
+    float* swing = malloc(sizeof(float) * size);
+    for (size_t i = 0; i < size; ++i) swing[i] = i < size - 10 ? 0.9f : -0.9f;
+    input_init(&s, INPUT_FLOAT32, SAMPLE_RATE, DC_CUTOFF);
+    input_process(&s, swing, swing, size);
+    size_t overshoot = input_clipped(&s);
+    bool clamped = true;
+    for (size_t i = 0; i < size; ++i) clamped = clamped && swing[i] >= -1 && swing[i] <= 1;
+    free(swing);
+    if (overshoot == 0 || !clamped)
+    {
+        fprintf(stderr, "FAILED: clipping\n    Clamped after the DC blocker without counting (%zu)\n", overshoot);
+        pass = false;
+    }
+    return pass;
+}
+
+// Test that an offset is removed within a few time constants while a tone passes unchanged
+bool dc_test ()
+{
+    size_t size = SAMPLE_RATE;
+    float* in = malloc(sizeof(float) * size);
+    float* out = malloc(sizeof(float) * size);
+    double amplitude = 0.5;
+    for (size_t i = 0; i < size; ++i) in[i] = 0.3 + amplitude*sin(2*M_PI*440*i/SAMPLE_RATE);
+    input_stage s;
+    input_init(&s, INPUT_FLOAT32, SAMPLE_RATE, DC_CUTOFF);
+    // In odd sized pieces, which must be seamless
+    for (size_t done = 0; done < size; done += 333)
+        input_process(&s, in + done, out + done, done + 333 < size ? 333 : size - done);
+
+    // The last half second: 220 whole periods
+    double mean = 0, power = 0;
+    for (size_t i = size/2; i < size; ++i)
+    {
+        mean += out[i];
+        power += out[i]*out[i];
+    }
+    mean /= size - size/2;
+    double rms = sqrt(power/(size - size/2));
+    bool pass = fabs(mean) < 1e-3 && fabs(rms/(amplitude/sqrt(2)) - 1) < 0.01;
+    if (!pass) fprintf(stderr, "FAILED: dc\n    Mean: %f, RMS: %f\n", mean, rms);
+    free(in);
+    free(out);
+    return pass;
+}
+
+// Test that an int24 buffer can be widened in place from the end of a float buffer
+bool in_place_test ()
+{
+    size_t count = 1000;
+    float* block = malloc(sizeof(float) * count);
+    uint8_t* raw = (uint8_t*)(block + count) - 3*count;
+    for (size_t i = 0; i < count; ++i) put_int24(raw + 3*i, (int32_t)(i*8000) - 4000000);
+    input_convert(INPUT_INT24, raw, block, count);
+    bool pass = true;
+    for (size_t i = 0; i < count; ++i) pass = pass && block[i] == ((int32_t)(i*8000) - 4000000)/8388608.0f;
+    if (!pass) fprintf(stderr, "FAILED: in place\n");
+    free(block);
+    return pass;
+}
+
+#define BUFFERS 20000
+
+static void* clip_buffers (void* arg)
+{
+    input_stage* s = arg;
+    float in[64], out[64];
+    for (size_t i = 0; i < 64; ++i) in[i] = i % 8 == 0 ? 2 : 0.1f;
+    for (size_t i = 0; i < BUFFERS; ++i) input_process(s, in, out, 64);
+    return NULL;
+}
+
+// Test that counts taken while another thread clips add up to every clipped sample
+bool concurrent_test ()
+{
+    input_stage s;
+    input_init(&s, INPUT_FLOAT32, SAMPLE_RATE, DC_CUTOFF);
+    pthread_t thread;
+    pthread_create(&thread, NULL, clip_buffers, &s);
+    size_t total = 0, takes = 0;
+    for (; takes < 1000; ++takes) total += input_clipped(&s);
+    pthread_join(thread, NULL);
+    total += input_clipped(&s);
+    bool pass = total == BUFFERS*8;
+    if (!pass) fprintf(stderr, "FAILED: concurrent\n    Clipped: %zu, expected %d\n", total, BUFFERS*8);
+    return pass;
+}
+
+int main (void)
+{
+    if (!convert_test()) return 1;
+    if (!dc_test()) return 1;
+    if (!in_place_test()) return 1;
+    if (!concurrent_test()) return 1;
+    return 0;
+}
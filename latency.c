@@ -0,0 +1,217 @@
+// End-to-end latency harness
+//
+// Drives the live path without audio or MIDI devices. Generated vowels are pushed through the
+// backend in FRAMES_PER_BUFFER blocks, as on_audio_sync receives them; control_update runs
+// once per poll period, as the main loop does between redraws; and MIDI goes to a sink that
+// stamps every message with the sample position it was sent at. Each note's onset, pitch and
+// release are known, so latencies are measured in samples, however fast the harness runs.
+// Driver buffering on either side is not included.
+//
+//   latency [-n notes] [-p poll_ms] [-s seed]
+//
+// Reports the distribution over notes of:
+//   note on:  onset to the note on
+//   bend:     onset to the first pitch bend within TOLERANCE cents of the note
+//   settle:   onset to the pitch bend after which every bend of the note is within TOLERANCE
+//   note off: release to the note off
+#include "backend.h"
+#include "control.h"
+#include "generator.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEFAULT_NOTES   200
+#define DEFAULT_POLL_MS (1000/60.0) // The main loop waits for a 60Hz display between polls
+#define TOLERANCE       50.0        // Cents
+#define SNR             100.0       // dB; noise stays below the onset threshold
+
+typedef struct
+{
+    long position;
+    int  message;
+} midi_event;
+
+typedef struct
+{
+    midi_event* events;
+    size_t      count;
+    long        position; // The position of the poll in progress
+} midi_sink;
+
+static void record (int message, void* context)
+{
+    midi_sink* sink = context;
+    sink->events = realloc(sink->events, sizeof(midi_event) * (sink->count+1));
+    sink->events[sink->count++] = (midi_event){sink->position, message};
+}
+
+static int compare_doubles (const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Print the distribution of latencies (in samples; NAN for notes where it never happened)
+static void report (const char* name, double* latencies, size_t count)
+{
+    double* ms = malloc(sizeof(double) * count);
+    size_t found = 0;
+    double sum = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (isnan(latencies[i])) continue;
+        ms[found] = latencies[i]/SAMPLE_RATE*1000;
+        sum += ms[found++];
+    }
+    if (found == 0)
+    {
+        printf("%-10s %6zu %6zu\n", name, found, count - found);
+        free(ms);
+        return;
+    }
+    qsort(ms, found, sizeof(double), compare_doubles);
+    printf("%-10s %6zu %6zu %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f\n", name, found, count - found,
+           sum/found, ms[0], ms[found/2], ms[(size_t)(0.9*(found-1))], ms[(size_t)(0.99*(found-1))], ms[found-1]);
+    free(ms);
+}
+
+// Return the cents between a pitch bend message and a frequency
+static double bend_cents (int message, double freq)
+{
+    int bend = ((message >> 8) & 0x7F) | ((message >> 16) & 0x7F) << 7;
+    return 1200*log2(control_bend_frequency(bend)/freq);
+}
+
+static void usage ()
+{
+    fprintf(stderr, "Usage: latency [-n notes] [-p poll_ms] [-s seed]\n");
+    fprintf(stderr, "  -n  number of notes (default %d)\n", DEFAULT_NOTES);
+    fprintf(stderr, "  -p  main loop poll period in milliseconds (default %.1f)\n", DEFAULT_POLL_MS);
+    fprintf(stderr, "  -s  random seed (default 1)\n");
+}
+
+int main (int argc, char** argv)
+{
+    size_t num_notes = DEFAULT_NOTES;
+    double poll_ms = DEFAULT_POLL_MS;
+    unsigned seed = 1;
+    int option;
+    while ((option = getopt(argc, argv, "n:p:s:")) != -1)
+    {
+        switch (option) {
+            case 'n':
+                num_notes = atoi(optarg); break;
+            case 'p':
+                poll_ms = atof(optarg); break;
+            case 's':
+                seed = atoi(optarg); break;
+            default:
+                usage();
+                return 1;
+        }
+    }
+    if (num_notes == 0 || poll_ms <= 0)
+    {
+        usage();
+        return 1;
+    }
+
+    // The generator's range of fundamentals is within the pitch bend range
+    generator_config config;
+    generator_default(&config);
+    config.snr = SNR;
+    generator g;
+    generator_init(&g, &config, SAMPLE_RATE, seed);
+    generator_note* notes = malloc(sizeof(generator_note) * num_notes);
+    size_t count = 0;
+
+    backend_init();
+    midi_sink sink = {NULL, 0, 0};
+    control note_control;
+    control_init(&note_control, record, &sink);
+
+    // The main loop polls at its own pace, seeing every audio block delivered before the poll
+    double poll_period = poll_ms/1000*SAMPLE_RATE;
+    double next_poll = 0;
+    long end = 0;
+    for (long block = 0; count < num_notes || block < end; block += FRAMES_PER_BUFFER)
+    {
+        float samples[FRAMES_PER_BUFFER];
+        generator_read(&g, samples, NULL, FRAMES_PER_BUFFER);
+        backend_push_buffer(samples, FRAMES_PER_BUFFER, NULL, NULL);
+        if (count < num_notes && (count == 0 || g.note.onset != notes[count-1].onset))
+        {
+            // Run for a second past the release of the last note
+            notes[count++] = g.note;
+            if (count == num_notes) end = g.note.end + SAMPLE_RATE;
+        }
+        for (; next_poll < block + 2*FRAMES_PER_BUFFER; next_poll += poll_period)
+        {
+            sink.position = next_poll;
+            control_update(&note_control);
+        }
+    }
+
+    // Match the MIDI to the notes: everything sent from one onset to the next belongs to the first
+    double* note_ons  = malloc(sizeof(double) * num_notes);
+    double* bends     = malloc(sizeof(double) * num_notes);
+    double* settles   = malloc(sizeof(double) * num_notes);
+    double* note_offs = malloc(sizeof(double) * num_notes);
+    size_t spurious = 0, event = 0;
+    while (event < sink.count && sink.events[event].position < notes[0].onset)
+        if ((sink.events[event++].message & 0xF0) == 0x90) ++spurious;
+    for (size_t i = 0; i < num_notes; ++i)
+    {
+        generator_note* n = &notes[i];
+        long next_onset = i+1 < num_notes ? notes[i+1].onset : end;
+        note_ons[i] = bends[i] = settles[i] = note_offs[i] = NAN;
+        bool settled = false;
+        for (; event < sink.count && sink.events[event].position < next_onset; ++event)
+        {
+            midi_event* e = &sink.events[event];
+            long latency = e->position - n->onset;
+            switch (e->message & 0xF0)
+            {
+                case 0x90:
+                    if (isnan(note_ons[i]) && e->position < n->release) note_ons[i] = latency;
+                    else ++spurious;
+                    break;
+                case 0xE0:
+                    if (e->position >= n->release) break;
+                    if (fabs(bend_cents(e->message, n->freq)) < TOLERANCE)
+                    {
+                        if (isnan(bends[i])) bends[i] = latency;
+                        if (!settled) settles[i] = latency;
+                        settled = true;
+                    }
+                    else settled = false;
+                    break;
+                case 0x80:
+                    if (isnan(note_offs[i]) && e->position >= n->release) note_offs[i] = e->position - n->release;
+                    break;
+            }
+        }
+        if (!settled) settles[i] = NAN;
+    }
+
+    printf("%.1fms poll period, %zu notes, %zu spurious note ons\n", poll_ms, num_notes, spurious);
+    printf("%-10s %6s %6s %8s %8s %8s %8s %8s %8s\n", "ms", "found", "missed", "mean", "min", "p50", "p90", "p99", "max");
+    report("note on", note_ons, num_notes);
+    report("bend", bends, num_notes);
+    report("settle", settles, num_notes);
+    report("note off", note_offs, num_notes);
+
+    free(note_ons);
+    free(bends);
+    free(settles);
+    free(note_offs);
+    free(sink.events);
+    free(notes);
+    backend_cleanup();
+    return 0;
+}
@@ -0,0 +1,134 @@
+#include "lpc.h"
+#include "windowing.h"
+
+#include <complex.h>
+#include <math.h>
+#include <stdlib.h>
+
+#define LPC_EMPHASIS 0.97 // Pre-emphasis of the frame
+#define LPC_NOISE_FLOOR 1e-9 // White noise correction added to r[0], keeps the recursion stable
+#define ROOT_ITERATIONS 100
+#define ROOT_TOLERANCE 1e-10
+
+
+void pre_emphasis (double* sample, double* output, size_t sample_size, double coeff)
+{
+    double prev = 0;
+    for (size_t i = 0; i < sample_size; ++i)
+    {
+        double x = sample[i];
+        output[i] = x - coeff*prev;
+        prev = x;
+    }
+}
+
+void lpc_autocorrelation (double* sample, size_t sample_size, double* r, int order)
+{
+    for (int lag = 0; lag <= order; ++lag)
+    {
+        double sum = 0;
+        for (size_t i = lag; i < sample_size; ++i)
+            sum += sample[i]*sample[i-lag];
+        r[lag] = sum;
+    }
+}
+
+double levinson_durbin (double* r, double* a, int order)
+{
+    double prev[LPC_MAX_ORDER+1];
+    double error = r[0];
+    a[0] = 1;
+    for (int i = 1; i <= order; ++i) a[i] = 0;
+    if (error <= 0) return 0;
+    for (int i = 1; i <= order; ++i)
+    {
+        double acc = r[i];
+        for (int j = 1; j < i; ++j) acc += a[j]*r[i-j];
+        double k = -acc/error;
+        for (int j = 0; j < i; ++j) prev[j] = a[j];
+        for (int j = 1; j < i; ++j) a[j] = prev[j] + k*prev[i-j];
+        a[i] = k;
+        error *= 1 - k*k;
+        if (error <= 0) return 0;
+    }
+    return error;
+}
+
+// Find every root of z^order + a[1]z^(order-1) + ... + a[order] with Durand-Kerner iteration
+static void find_roots (double* a, int order, double complex* roots)
+{
+    // Prediction polynomial roots lie inside the unit circle, so start on a circle just inside it,
+    // rotated off the real axis so no guess is a conjugate of another
+    for (int k = 0; k < order; ++k)
+        roots[k] = 0.9*cexp(I*(2*M_PI*k/order + 0.4));
+    for (int iteration = 0; iteration < ROOT_ITERATIONS; ++iteration)
+    {
+        double largest_step = 0;
+        for (int k = 0; k < order; ++k)
+        {
+            double complex z = roots[k];
+            double complex value = 1;
+            for (int j = 1; j <= order; ++j) value = value*z + a[j];
+            double complex denominator = 1;
+            for (int j = 0; j < order; ++j)
+                if (j != k) denominator *= z - roots[j];
+            if (denominator == 0) continue;
+            double complex step = value/denominator;
+            roots[k] = z - step;
+            if (cabs(step) > largest_step) largest_step = cabs(step);
+        }
+        if (largest_step < ROOT_TOLERANCE) break;
+    }
+}
+
+size_t lpc_roots (double* a, int order, double sample_rate, double min_freq, double max_freq, double max_bandwidth,
+                  double* freqs, double* bandwidths, size_t max_formants)
+{
+    double complex roots[LPC_MAX_ORDER];
+    find_roots(a, order, roots);
+
+    // Each resonance is a conjugate pair; keep the root in the upper half plane, in frequency order
+    size_t num_formants = 0;
+    double candidate_freqs[LPC_MAX_ORDER];
+    double candidate_bandwidths[LPC_MAX_ORDER];
+    for (int k = 0; k < order; ++k)
+    {
+        if (cimag(roots[k]) <= 0) continue;
+        double freq = carg(roots[k])*sample_rate/(2*M_PI);
+        double bandwidth = -log(cabs(roots[k]))*sample_rate/M_PI;
+        if (freq < min_freq || freq > max_freq || bandwidth > max_bandwidth) continue;
+        size_t i = num_formants++;
+        for (; i > 0 && candidate_freqs[i-1] > freq; --i)
+        {
+            candidate_freqs[i] = candidate_freqs[i-1];
+            candidate_bandwidths[i] = candidate_bandwidths[i-1];
+        }
+        candidate_freqs[i] = freq;
+        candidate_bandwidths[i] = bandwidth;
+    }
+    if (num_formants > max_formants) num_formants = max_formants;
+    for (size_t i = 0; i < num_formants; ++i)
+    {
+        freqs[i] = candidate_freqs[i];
+        bandwidths[i] = candidate_bandwidths[i];
+    }
+    return num_formants;
+}
+
+size_t lpc_formants (double* sample, size_t sample_size, double sample_rate, int order,
+                     double min_freq, double max_freq, double max_bandwidth,
+                     double* freqs, double* bandwidths, size_t max_formants)
+{
+    if (order > LPC_MAX_ORDER || sample_size <= (size_t)order) return 0;
+
+    double frame[sample_size];
+    pre_emphasis(sample, frame, sample_size, LPC_EMPHASIS);
+    hamming_window(frame, sample_size, frame);
+
+    double r[LPC_MAX_ORDER+1];
+    double a[LPC_MAX_ORDER+1];
+    lpc_autocorrelation(frame, sample_size, r, order);
+    r[0] *= 1 + LPC_NOISE_FLOOR;
+    if (levinson_durbin(r, a, order) <= 0) return 0;
+    return lpc_roots(a, order, sample_rate, min_freq, max_freq, max_bandwidth, freqs, bandwidths, max_formants);
+}
@@ -0,0 +1,61 @@
+// Linear predictive coding formant tracker
+//
+// A frame, already decimated so the model order stays low, is pre-emphasized and windowed,
+// then an all-pole model of the vocal tract is fitted with the autocorrelation method and
+// the Levinson-Durbin recursion. Formants are the resonances of that model: the roots of the
+// prediction polynomial, found with Durand-Kerner iteration. Everything runs in the time
+// domain; no FFTs are needed.
+#include <stdlib.h>
+
+#define LPC_MAX_ORDER 32
+
+// Apply the first order pre-emphasis filter y[n] = x[n] - coeff*x[n-1]
+//   sample:      input array of length sample_size
+//   output:      output array of length sample_size (may be the same array as sample)
+//   sample_size: the length of the sample array
+//   coeff:       emphasis coefficient, typically 0.9 to 0.97
+void pre_emphasis (double* sample, double* output, size_t sample_size, double coeff);
+
+// Compute the autocorrelation of sample for lags 0 to order
+//   sample:      input array of length sample_size
+//   sample_size: the length of the sample array
+//   r:           output array of length order+1
+//   order:       the highest lag computed
+void lpc_autocorrelation (double* sample, size_t sample_size, double* r, int order);
+
+// Return the prediction error power of the order-th order linear predictor, found with the
+// Levinson-Durbin recursion. The prediction polynomial is A(z) = 1 + a[1]z^-1 + ... + a[order]z^-order.
+//   r:     autocorrelation array of length order+1
+//   a:     output array of length order+1 (a[0] is always 1)
+//   order: the predictor order, at most LPC_MAX_ORDER
+double levinson_durbin (double* r, double* a, int order);
+
+// Return the number of formants found among the roots of a prediction polynomial.
+// Formants are sorted by frequency.
+//   a:             prediction polynomial of length order+1, from levinson_durbin
+//   order:         the predictor order
+//   sample_rate:   the sampling rate (in Hz) the predictor was fitted at
+//   min_freq:      lowest formant frequency accepted
+//   max_freq:      highest formant frequency accepted
+//   max_bandwidth: widest formant bandwidth (in Hz) accepted
+//   freqs:         output array of length max_formants
+//   bandwidths:    output array of length max_formants
+//   max_formants:  the number of formants wanted
+size_t lpc_roots (double* a, int order, double sample_rate, double min_freq, double max_freq, double max_bandwidth,
+                  double* freqs, double* bandwidths, size_t max_formants);
+
+// Return the number of formants found in a frame of audio
+//   sample:        input array of length sample_size, decimated (e.g. by a decimator from
+//                  filter.h) to a rate whose Nyquist frequency is a little above max_freq
+//   sample_size:   the length of the sample array
+//   sample_rate:   the sampling rate (in Hz) of the sample
+//   order:         the predictor order, at most LPC_MAX_ORDER
+//   min_freq:      lowest formant frequency accepted
+//   max_freq:      highest formant frequency accepted
+//   max_bandwidth: widest formant bandwidth (in Hz) accepted
+//   freqs:         output array of length max_formants
+//   bandwidths:    output array of length max_formants
+//   max_formants:  the number of formants wanted
+size_t lpc_formants (double* sample, size_t sample_size, double sample_rate, int order,
+                     double min_freq, double max_freq, double max_bandwidth,
+                     double* freqs, double* bandwidths, size_t max_formants);
@@ -0,0 +1,107 @@
+#include "filter.h"
+#include "lpc.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#define SAMPLE_RATE 44100.0
+#define FRAME_SIZE  1024
+#define DECIMATION  4
+#define TAPS        128
+
+// Test that formants are recovered from a polynomial built out of known resonances
+bool roots_test (double* freqs, double* bandwidths, size_t count, double sample_rate)
+{
+    // Multiply out (1 - 2|z|cos(w)x + |z|^2 x^2) for every resonance
+    double a[LPC_MAX_ORDER+1] = {1};
+    int order = 0;
+    for (size_t f = 0; f < count; ++f)
+    {
+        double radius = exp(-M_PI*bandwidths[f]/sample_rate);
+        double c1 = -2*radius*cos(2*M_PI*freqs[f]/sample_rate);
+        double c2 = radius*radius;
+        order += 2;
+        for (int i = order; i >= 2; --i) a[i] += c1*a[i-1] + c2*a[i-2];
+        a[1] += c1;
+    }
+
+    double found_freqs[LPC_MAX_ORDER];
+    double found_bandwidths[LPC_MAX_ORDER];
+    size_t found = lpc_roots(a, order, sample_rate, 0, sample_rate/2, sample_rate, found_freqs, found_bandwidths, count);
+    bool pass = found == count;
+    for (size_t f = 0; pass && f < count; ++f)
+        pass = fabs(found_freqs[f] - freqs[f]) < 1 && fabs(found_bandwidths[f] - bandwidths[f]) < 1;
+    if (!pass)
+    {
+        fprintf(stderr, "FAILED: lpc roots\n");
+        for (size_t f = 0; f < found; ++f)
+            fprintf(stderr, "    Formant %zu = %.1fHz, bandwidth %.1fHz\n", f+1, found_freqs[f], found_bandwidths[f]);
+        fprintf(stderr, "\n");
+    }
+    return pass;
+}
+
+// Test formants of a glottal pulse train filtered by the resonances of a vowel
+bool vowel_test (double pitch, double* freqs, double* bandwidths, double tolerance)
+{
+    // Decimated as the backend does; the decimator's delay is played past the frame, so the
+    // frame covers the last FRAME_SIZE samples before it
+    size_t length = 4*FRAME_SIZE + TAPS/2;
+    double sample[length];
+    double state[3][2] = {{0}};
+    double source = 0;
+    size_t period = SAMPLE_RATE/pitch;
+    for (size_t i = 0; i < length; ++i)
+    {
+        // Pulses rolling off at 6dB per octave, like a glottal source after lip radiation
+        source = 0.99*source + (i%period == 0);
+        double x = source;
+        for (int f = 0; f < 3; ++f)
+        {
+            double radius = exp(-M_PI*bandwidths[f]/SAMPLE_RATE);
+            double y = x + 2*radius*cos(2*M_PI*freqs[f]/SAMPLE_RATE)*state[f][0] - radius*radius*state[f][1];
+            state[f][1] = state[f][0];
+            state[f][0] = y;
+            x = y;
+        }
+        sample[i] = x;
+    }
+    decimator d;
+    decimator_init(&d, DECIMATION, TAPS);
+    size_t count = decimator_push(&d, sample, sample, length);
+    decimator_cleanup(&d);
+
+    double found_freqs[3];
+    double found_bandwidths[3];
+    size_t size = FRAME_SIZE/DECIMATION;
+    size_t found = lpc_formants(sample + count - size, size, SAMPLE_RATE/DECIMATION, 12, 90, 5000, 800,
+                                found_freqs, found_bandwidths, 3);
+    bool pass = found == 3;
+    for (size_t f = 0; pass && f < 3; ++f)
+        pass = fabs(found_freqs[f] - freqs[f]) < tolerance*freqs[f];
+    if (!pass)
+    {
+        fprintf(stderr, "FAILED: lpc formants\n");
+        fprintf(stderr, "    Pitch: %.0fHz\n", pitch);
+        for (size_t f = 0; f < found; ++f)
+            fprintf(stderr, "    F%zu = %.1fHz (expected %.1fHz), bandwidth %.1fHz\n", f+1, found_freqs[f], freqs[f], found_bandwidths[f]);
+        fprintf(stderr, "\n");
+    }
+    return pass;
+}
+
+int main (void)
+{
+    double freqs[] = {700, 1220, 2600};
+    double bandwidths[] = {80, 90, 120};
+    bool pass = roots_test(freqs, bandwidths, 3, SAMPLE_RATE/DECIMATION);
+
+    double ah_freqs[] = {730, 1090, 2440};
+    double ee_freqs[] = {270, 2290, 3010};
+    double oo_freqs[] = {300, 870, 2240};
+    pass = vowel_test(110, ah_freqs, bandwidths, 0.1) && pass;
+    pass = vowel_test(160, ee_freqs, bandwidths, 0.1) && pass;
+    pass = vowel_test(130, oo_freqs, bandwidths, 0.1) && pass;
+    return pass ? 0 : 1;
+}
@@ -1,9 +1,12 @@
 #include "backend.h"
+#include "control.h"
 #include "dywapitchtrack.h"
 #include "gui.h"
 #include "pitch.h"
 #include "midi.h"
+#include "recorder.h"
 #include "serial.h"
+#include "source.h"
 #include "windowing.h"
 
 // #define GLFW_INCLUDE_GLCOREARB
@@ -12,43 +15,58 @@
 #include <math.h> //math comes before fftw so that fftw_complex is not overriden
 
 #include <GLFW/glfw3.h>
-#include <portaudio.h>
 #include <fftw3.h>
 #include <portmidi.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #define NO_BLUETOOTH 1
 
-static void pa_check_error (PaError error)
+// The context is the session recorder, or NULL
+static void on_audio_block (const float* block, size_t count, double time, void* context)
 {
-    if (error == paNoError) return;
+    recorder_block b = {context, block, 0, backend_snapshot};
+    size_t filled = backend_push_buffer(block, count, b.session ? recorder_frame_callback : NULL, &b);
+    for (size_t i = 0; i < filled; ++i) gui_fft_filled();
+    if (b.session) recorder_finish_block(&b, count);
+}
 
-    Pa_Terminate();
-    fprintf( stderr, "An error occured while using the portaudio stream\n" );
-    fprintf( stderr, "Error number: %d\n", error );
-    fprintf( stderr, "Error message: %s\n", Pa_GetErrorText( error ) );
-    exit(EXIT_FAILURE);
+// Open the microphone, or with a path, play a sound file or raw float PCM from a FIFO ("-" for stdin)
+static bool open_input (source* input, const char* path)
+{
+    if (path == NULL) return source_open_device(input, SAMPLE_RATE, FRAMES_PER_BUFFER);
+    struct stat info;
+    if (strcmp(path, "-") == 0 || (stat(path, &info) == 0 && S_ISFIFO(info.st_mode)))
+        return source_open_pipe(input, path, INPUT_FLOAT32, SAMPLE_RATE, FRAMES_PER_BUFFER, false);
+    if (!source_open_file(input, path, FRAMES_PER_BUFFER, true)) return false;
+    if (input->sample_rate == SAMPLE_RATE) return true;
+    fprintf(stderr, "Error: %s has a sample rate of %.0fHz, not %.0fHz.\n", path, input->sample_rate, SAMPLE_RATE);
+    source_close(input);
+    return false;
 }
 
-static int on_audio_sync (const void* inputBuffer, void* outputBuffer,
-                        unsigned long framesPerBuffer,
-                        const PaStreamCallbackTimeInfo* timeInfo,
-                        PaStreamCallbackFlags statusFlags,
-                        void* userData)
+static void write_midi (int message, void* context)
 {
-    float* in = (float*)inputBuffer;
+    midi_write(message);
+}
 
-    for (int i = 0; i < framesPerBuffer; ++i)
+int main (int argc, char** argv)
+{
+    const char* session_name = NULL;
+    int option;
+    while ((option = getopt(argc, argv, "r:")) != -1)
     {
-        if (in[i] < -1 || in[i] > 1) printf("clipping\n");
-        double sample = in[i] > 1 ? 1 : in[i] < -1 ? -1 : in[i];
-        if (backend_push_sample(sample)) gui_fft_filled();
+        if (option == 'r') session_name = optarg;
+        else
+        {
+            fprintf(stderr, "Usage: bleep [-r session] [sound file | FIFO | -]\n");
+            fprintf(stderr, "  -r  record the input and features to session.wav and session.feat\n");
+            exit(EXIT_FAILURE);
+        }
     }
+    const char* path = optind < argc ? argv[optind] : NULL;
 
-    return paContinue;
-}
-
-int main (void)
-{
     fft_buffer_loc = 0;
     onset_fft_buffer_loc = 0;
     onset_triggered = 0;
@@ -58,6 +76,8 @@ int main (void)
     
     // Initialize Midi
     midi_init();
+    control note_control;
+    control_init(&note_control, write_midi, NULL);
     
     // Initialize RS-232 connection to glove_
     int ser_live=0, ser_out_live=0;
@@ -71,41 +91,24 @@ int main (void)
         ser_out_live = serial_out_init();
     }
 
-    // Initialize PortAudio
-    pa_check_error(Pa_Initialize());
-
-    // Configure stream input
-    PaStreamParameters in;
-    in.device = Pa_GetDefaultInputDevice();
-    in.channelCount = 1;
-    in.sampleFormat = paFloat32;
-    in.suggestedLatency = Pa_GetDeviceInfo(in.device)->defaultLowInputLatency;
-    in.hostApiSpecificStreamInfo = NULL;
-
-    // Configure stream output
-    PaStreamParameters out;
-    out.device = Pa_GetDefaultOutputDevice();
-    if (out.device == paNoDevice)
+    // Initialize audio input
+    source input;
+    if (!open_input(&input, path))
+    {
+        fprintf(stderr, "Error: Failed to open audio input.\n");
+        exit(EXIT_FAILURE);
+    }
+    recorder session;
+    char names[BACKEND_SNAPSHOT_SIZE][BACKEND_NAME_SIZE];
+    const char* name_list[BACKEND_SNAPSHOT_SIZE];
+    backend_snapshot_names(names, name_list);
+    if (session_name && !recorder_open(&session, session_name, path ? path : "microphone", SAMPLE_RATE, FFT_HOP,
+                                       name_list, BACKEND_SNAPSHOT_SIZE))
     {
-        fprintf(stderr, "Error: No default output device.\n");
+        fprintf(stderr, "Error: Failed to create the recording %s.\n", session_name);
         exit(EXIT_FAILURE);
     }
-    out.channelCount = 2;
-    out.sampleFormat = paFloat32;
-    out.suggestedLatency = Pa_GetDeviceInfo(out.device)->defaultLowOutputLatency;
-    out.hostApiSpecificStreamInfo = NULL;
-
-    // Initialize stream
-    PaStream *stream;
-    pa_check_error(Pa_OpenStream(&stream,
-                                 &in,
-                                 &out,
-                                 SAMPLE_RATE,
-                                 FRAMES_PER_BUFFER,
-                                 paClipOff,
-                                 on_audio_sync,
-                                 NULL));
-    pa_check_error(Pa_StartStream(stream));
+    if (!source_start(&input, on_audio_block, session_name ? &session : NULL)) exit(EXIT_FAILURE);
 
     // Initialize the GUI
     gui_init();
@@ -137,66 +140,20 @@ int main (void)
         }
 
         //MIDI OUT STATEMENTS
-        int outputPitch = -INFINITY;
-        if (onset_average_amplitude>ONSET_THRESHOLD)
-        {
-            if (!note_on)
-            {
-                midi_write(Pm_Message(0x90|midi_channel, 54, 100/*(int)average_amplitude*/));
-                // printf("midi on\n");
-                note_on = 1;
-            }
-            //0x2000 is 185 hz, 0x0000 is 73.416, 0x3fff is 466.16
-            double midiNumber = 12 * log2(dominant_frequency_lp/440) + 69;
-            //0x0000 is 38, 0x3fff is 70
-            outputPitch = (int)((midiNumber-38)/32*0x3FFF);
-            if (outputPitch > 0x3FFF) outputPitch = 0x3FFF;
-            if (outputPitch < 0x0000) outputPitch = 0x0000;
-
-            int outputCentroid = (int)((spectral_centroid-500)/300*127);
-            if (outputCentroid > 127) outputCentroid = 127;
-            if (outputCentroid < 000) outputCentroid = 000;
-            if (prev_spectral_centroid != -INFINITY){
-                if (abs(outputCentroid-prev_spectral_centroid)>127){
-                    outputCentroid = prev_spectral_centroid;
-                }
-                else prev_spectral_centroid = outputCentroid;
-            }
-            else prev_spectral_centroid = outputCentroid;
-            
-            if (prev_output_pitch != -INFINITY){
-                if ((outputPitch == 0) || (outputPitch == 0x3FFF)){
-                    outputPitch = prev_output_pitch;
-                }
-                else prev_output_pitch = outputPitch;
-            }
-            else prev_output_pitch = outputPitch;
-            int lsb_7 = outputPitch&0x7F;
-            int msb_7 = (outputPitch>>7)&0x7F;
-
-            
-            if (ser_live) midi_write(Pm_Message(0xB0/*|midi_channel*/, 0, angle));
-            midi_write(Pm_Message(0xB0/*|midi_channel*/, 1, outputCentroid));
-            if (ser_out_live) serial_out_write((char)((outputCentroid/2)|(midi_channel<<6)+1));
-//            printf("centroid out: %03u pitch out: %04u\n", outputCentroid, outputPitch);
-            midi_write(Pm_Message(0xE0|midi_channel, lsb_7, msb_7));
-        }
-        else if (onset_average_amplitude<OFFSET_THRESHOLD)
-        {
-            if (note_on)
-            {
-                midi_write(Pm_Message(0x80|midi_channel, 54, 100));
-                if (ser_out_live) serial_out_clear(); //turn off all colors
-                // printf("midi off\n");
-                note_on = 0;
-                dywapitch_inittracking(&pitch_tracker);
-                prev_spectral_centroid = -INFINITY;
-                prev_output_pitch = -INFINITY;
-            }
-            outputPitch = -INFINITY;
-        }
+        note_control.channel    = midi_channel;
+        note_control.angle      = angle;
+        note_control.send_angle = ser_live;
+        int event = control_update(&note_control);
+        if (ser_out_live && event == CONTROL_UPDATE) serial_out_write((char)((note_control.centroid/2)|(midi_channel<<6)+1));
+        if (ser_out_live && event == CONTROL_NOTE_OFF) serial_out_clear(); //turn off all colors
         midi_flush();
 
+        // Clipping is counted in the audio callback, and reported here
+        size_t clipped = backend_clipped();
+        if (clipped) printf("clipping (%zu samples)\n", clipped);
+        size_t dropped = session_name ? recorder_dropped(&session) : 0;
+        if (dropped) printf("recording dropped %zu blocks\n", dropped);
+
         // GUI HANDLING
         gui_redraw();
 
@@ -213,10 +170,9 @@ int main (void)
     // Shut down the GUI
     gui_cleanup();
     
-    // Shut down PortAudio
-    pa_check_error(Pa_StopStream(stream));
-    pa_check_error(Pa_CloseStream(stream));
-    Pa_Terminate();
+    // Shut down audio input
+    source_close(&input);
+    if (session_name && !recorder_close(&session)) fprintf(stderr, "Error: Failed to write the recording.\n");
 
     // Shut down Midi
     midi_cleanup();
@@ -0,0 +1,112 @@
+#include "mel.h"
+#include "plans.h"
+
+#include <fftw3.h>
+
+#include <math.h>
+#include <stdlib.h>
+
+#define LOG_FLOOR 1e-12 // Added to band energies before taking their log
+
+// Return the position of freq on a perceptual scale
+static double to_scale (int scale, double freq)
+{
+    if (scale == BARK_SCALE) return 26.81*freq/(1960 + freq) - 0.53; // Traunmuller
+    return 2595*log10(1 + freq/700);
+}
+
+// Return the frequency of a position on a perceptual scale
+static double from_scale (int scale, double position)
+{
+    if (scale == BARK_SCALE) return 1960*(position + 0.53)/(26.28 - position);
+    return 700*(pow(10, position/2595) - 1);
+}
+
+void mel_init (mel_bank* bank, int scale, size_t num_bands, size_t num_coeffs, size_t sample_size, double sample_rate,
+               double min_freq, double max_freq)
+{
+    bank->num_bands    = num_bands;
+    bank->num_coeffs   = num_coeffs < num_bands ? num_coeffs : num_bands;
+    bank->start        = calloc(num_bands, sizeof(size_t));
+    bank->length       = calloc(num_bands, sizeof(size_t));
+    bank->offset       = calloc(num_bands, sizeof(size_t));
+    bank->log_energies = calloc(num_bands, sizeof(double));
+    bank->dct          = calloc(num_bands, sizeof(double));
+
+    // Triangle b rises from edges[b] to edges[b+1] and falls to edges[b+2]
+    double edges[num_bands+2];
+    double low  = to_scale(scale, min_freq);
+    double high = to_scale(scale, max_freq);
+    for (size_t i = 0; i < num_bands+2; ++i)
+        edges[i] = from_scale(scale, low + (high - low)*i/(num_bands+1));
+
+    double bin_size = sample_rate/sample_size;
+    size_t last_bin = sample_size/2;
+    size_t total = 0;
+    for (size_t b = 0; b < num_bands; ++b)
+    {
+        double first = floor(edges[b]/bin_size) + 1;
+        double last  = ceil(edges[b+2]/bin_size) - 1;
+        if (last > last_bin) last = last_bin;
+        if (first > last)
+        {
+            // Narrower than a bin: take the bin nearest the peak
+            first = last = fmin(floor(edges[b+1]/bin_size + 0.5), last_bin);
+        }
+        bank->start[b]  = first;
+        bank->length[b] = last - first + 1;
+        bank->offset[b] = total;
+        total += bank->length[b];
+    }
+
+    bank->weights = calloc(total, sizeof(double));
+    for (size_t b = 0; b < num_bands; ++b)
+    {
+        double* weights = bank->weights + bank->offset[b];
+        if (bank->length[b] == 1)
+        {
+            weights[0] = 1;
+            continue;
+        }
+        for (size_t i = 0; i < bank->length[b]; ++i)
+        {
+            double freq = (bank->start[b] + i)*bin_size;
+            if (freq <= edges[b+1]) weights[i] = (freq - edges[b])/(edges[b+1] - edges[b]);
+            else                    weights[i] = (edges[b+2] - freq)/(edges[b+2] - edges[b+1]);
+        }
+    }
+    plan_r2r(num_bands, FFTW_REDFT10); // mel_mfcc's DCT, planned here so it is only looked up
+}
+
+void mel_energies (mel_bank* bank, double* fft_mag, double* energies)
+{
+    for (size_t b = 0; b < bank->num_bands; ++b)
+    {
+        double* mag = fft_mag + bank->start[b];
+        double* weights = bank->weights + bank->offset[b];
+        double sum = 0;
+        for (size_t i = 0; i < bank->length[b]; ++i) sum += weights[i]*mag[i];
+        energies[b] = sum;
+    }
+}
+
+void mel_mfcc (mel_bank* bank, double* energies, double* coeffs)
+{
+    size_t n = bank->num_bands;
+    for (size_t b = 0; b < n; ++b) bank->log_energies[b] = log(energies[b] + LOG_FLOOR);
+    fftw_execute_r2r(plan_r2r(n, FFTW_REDFT10), bank->log_energies, bank->dct);
+
+    // FFTW's DCT-II is unnormalized and doubled; scale it to be orthonormal
+    coeffs[0] = bank->dct[0]*sqrt(1.0/(4*n));
+    for (size_t k = 1; k < bank->num_coeffs; ++k) coeffs[k] = bank->dct[k]*sqrt(1.0/(2*n));
+}
+
+void mel_cleanup (mel_bank* bank)
+{
+    free(bank->start);
+    free(bank->length);
+    free(bank->offset);
+    free(bank->weights);
+    free(bank->log_energies);
+    free(bank->dct);
+}
@@ -0,0 +1,49 @@
+// Mel or bark filterbank and MFCCs
+//
+// Every band is a triangle on a perceptual frequency scale, applied to a power spectrum.
+// Only the bins under each triangle are stored, so applying the whole bank costs about
+// one multiply per bin no matter how many bands there are. The cepstral coefficients
+// are the orthonormal DCT-II of the log band energies.
+#include <stdlib.h>
+
+#define MEL_SCALE  0
+#define BARK_SCALE 1
+
+typedef struct
+{
+    size_t  num_bands;
+    size_t  num_coeffs;
+    size_t* start;    // First bin under each band (num_bands)
+    size_t* length;   // Number of bins under each band (num_bands)
+    size_t* offset;   // Index of each band's first weight in weights (num_bands)
+    double* weights;  // Triangle weights of every band, one run after another
+    double* log_energies; // DCT input (num_bands)
+    double* dct;          // DCT output (num_bands)
+} mel_bank;
+
+// Lay out the triangles of a filterbank and allocate its buffers
+//   bank:        the filterbank to be initialized
+//   scale:       MEL_SCALE or BARK_SCALE
+//   num_bands:   the number of triangles
+//   num_coeffs:  the number of cepstral coefficients mel_mfcc returns, at most num_bands
+//   sample_size: the length of the sample the spectrum is computed from
+//   sample_rate: the sampling rate (in Hz) of the sample
+//   min_freq:    lower edge of the first triangle
+//   max_freq:    upper edge of the last triangle
+void mel_init (mel_bank* bank, int scale, size_t num_bands, size_t num_coeffs, size_t sample_size, double sample_rate,
+               double min_freq, double max_freq);
+
+// Return the energy of every band
+//   bank:     an initialized filterbank
+//   fft_mag:  power spectrum of length sample_size/2+1
+//   energies: output array of length num_bands
+void mel_energies (mel_bank* bank, double* fft_mag, double* energies);
+
+// Return the cepstral coefficients of a set of band energies
+//   bank:     an initialized filterbank
+//   energies: input array of length num_bands, from mel_energies
+//   coeffs:   output array of length num_coeffs
+void mel_mfcc (mel_bank* bank, double* energies, double* coeffs);
+
+// Release the filterbank's buffers
+void mel_cleanup (mel_bank* bank);
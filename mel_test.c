@@ -0,0 +1,75 @@
+#include "mel.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#define SAMPLE_RATE 44100.0
+#define SAMPLE_SIZE 1024
+#define NUM_BANDS   26
+#define NUM_COEFFS  13
+
+// Test that neighbouring triangles overlap so every bin between the first and last peak
+// has a total weight of one
+bool partition_test (int scale, double min_freq, double max_freq)
+{
+    mel_bank bank;
+    mel_init(&bank, scale, NUM_BANDS, NUM_COEFFS, SAMPLE_SIZE, SAMPLE_RATE, min_freq, max_freq);
+    double fft_mag[SAMPLE_SIZE/2+1] = {0};
+    double energies[NUM_BANDS];
+    size_t first = bank.start[1];
+    size_t last  = bank.start[NUM_BANDS-1];
+    bool pass = true;
+    for (size_t bin = first; bin < last && pass; ++bin)
+    {
+        fft_mag[bin] = 1;
+        mel_energies(&bank, fft_mag, energies);
+        fft_mag[bin] = 0;
+        double total = 0;
+        for (size_t b = 0; b < NUM_BANDS; ++b) total += energies[b];
+        if (fabs(total - 1) > 1e-9)
+        {
+            fprintf(stderr, "FAILED: mel partition\n");
+            fprintf(stderr, "    Scale: %s, bin: %zu\n", scale == MEL_SCALE ? "mel" : "bark", bin);
+            fprintf(stderr, "    Total weight = %f (expected 1)\n\n", total);
+            pass = false;
+        }
+    }
+    mel_cleanup(&bank);
+    return pass;
+}
+
+// Test that a cosine across the log band energies shows up in a single coefficient
+bool mfcc_test (size_t k, double level)
+{
+    mel_bank bank;
+    mel_init(&bank, MEL_SCALE, NUM_BANDS, NUM_COEFFS, SAMPLE_SIZE, SAMPLE_RATE, 50, 8000);
+    double energies[NUM_BANDS];
+    double coeffs[NUM_COEFFS];
+    for (size_t b = 0; b < NUM_BANDS; ++b) energies[b] = exp(level + cos(M_PI*(b + 0.5)*k/NUM_BANDS));
+    mel_mfcc(&bank, energies, coeffs);
+    mel_cleanup(&bank);
+
+    bool pass = true;
+    for (size_t c = 0; c < NUM_COEFFS; ++c)
+    {
+        double expected = (c == 0 ? sqrt(NUM_BANDS)*level : 0) + (c == k ? sqrt(NUM_BANDS/2.0) : 0);
+        if (fabs(coeffs[c] - expected) > 1e-6)
+        {
+            fprintf(stderr, "FAILED: mfcc\n");
+            fprintf(stderr, "    Cosine: %zu, level: %.1f\n", k, level);
+            fprintf(stderr, "    Coefficient %zu = %f (expected %f)\n\n", c, coeffs[c], expected);
+            pass = false;
+        }
+    }
+    return pass;
+}
+
+int main (void)
+{
+    bool pass = partition_test(MEL_SCALE, 300, 8000);
+    pass = partition_test(BARK_SCALE, 300, 8000) && pass;
+    pass = mfcc_test(3, -4) && pass;
+    pass = mfcc_test(7, 0) && pass;
+    return pass ? 0 : 1;
+}
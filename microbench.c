@@ -0,0 +1,260 @@
+// DSP kernel microbenchmarks
+//
+// Times every kernel at every power of two frame size from MIN_SIZE to MAX_SIZE, both with
+// warm caches (calls back to back) and with cold caches (every call preceded by sweeping a
+// buffer larger than the last level cache). Each measurement is repeated SAMPLES times, and
+// reported as the median ns/call, the coefficient of variation across samples and the
+// throughput in input samples per second.
+//
+//   microbench [-k kernel] [-w baseline] [-b baseline] [-t percent]
+//
+// With -w the medians are written to a baseline file; with -b they are compared against one,
+// and the exit status is 1 if any kernel is more than -t percent (default 25) slower.
+#include "dywapitchtrack.h"
+#include "filter.h"
+#include "pitch.h"
+#include "windowing.h"
+
+#include <fftw3.h>
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MIN_SIZE          64
+#define MAX_SIZE          8192
+#define SAMPLES           31       // Timed repetitions of every measurement
+#define MIN_SAMPLE_NS     100000.0 // Warm samples repeat a kernel for at least this long
+#define EVICT_SIZE        (64 << 20) // Bytes swept before every cold call
+#define SAMPLE_RATE       44100.0
+#define DEFAULT_THRESHOLD 25.0
+
+typedef struct
+{
+    const char* name;
+    void (*run) (size_t size);
+} kernel;
+
+typedef struct
+{
+    char   name[64];
+    size_t size;
+    bool   cold;
+    double ns;
+} measurement;
+
+static double        sample[MAX_SIZE];
+static double        output[MAX_SIZE];
+static fftw_complex  fft[MAX_SIZE/2+1];
+static double        fft_mag[MAX_SIZE/2+1];
+static double        windowed[MAX_SIZE/2+1];
+static volatile double sink; // Results are stored here, so kernels can't be optimized away
+static char*         evict;
+
+// Kernels take the frame size; windows apply to its magnitude spectrum, of size/2+1 bins, as
+// in the backend
+static void run_calc_fft (size_t size)      { calc_fft(sample, fft, size); }
+static void run_calc_fft_mag (size_t size)  { calc_fft_mag(fft, fft_mag, size); }
+static void run_welch (size_t size)         { welch_window(fft_mag, size/2+1, windowed); }
+static void run_hanning (size_t size)       { hanning_window(fft_mag, size/2+1, windowed); }
+static void run_hamming (size_t size)       { hamming_window(fft_mag, size/2+1, windowed); }
+static void run_blackman (size_t size)      { blackman_window(fft_mag, size/2+1, windowed); }
+static void run_nuttal (size_t size)        { nuttal_window(fft_mag, size/2+1, windowed); }
+static void run_centroid (size_t size)      { sink = calc_spectral_centroid(fft_mag, size, SAMPLE_RATE); }
+static void run_dominant_lp (size_t size)   { sink = dominant_freq_lp(fft, fft_mag, size, SAMPLE_RATE, 5000); }
+static void run_band_pass (size_t size)     { band_pass(sample, output, size, SAMPLE_RATE, 900, 2800); }
+static void run_wavelet (size_t size)       { sink = _dywapitch_computeWaveletPitch(sample, 0, size); }
+
+static kernel kernels[] = {
+    {"calc_fft",               run_calc_fft},
+    {"calc_fft_mag",           run_calc_fft_mag},
+    {"welch_window",           run_welch},
+    {"hanning_window",         run_hanning},
+    {"hamming_window",         run_hamming},
+    {"blackman_window",        run_blackman},
+    {"nuttal_window",          run_nuttal},
+    {"calc_spectral_centroid", run_centroid},
+    {"dominant_freq_lp",       run_dominant_lp},
+    {"band_pass",              run_band_pass},
+    {"wavelet_pitch",          run_wavelet},
+};
+#define NUM_KERNELS (sizeof(kernels)/sizeof(kernels[0]))
+
+static double now_ns ()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec*1e9 + t.tv_nsec;
+}
+
+// Push the kernel's data and code out of the caches
+static void evict_caches ()
+{
+    for (size_t i = 0; i < EVICT_SIZE; i += 64) evict[i]++;
+}
+
+static int compare_doubles (const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Return the median ns/call of a kernel, and its coefficient of variation through *cv
+static double measure (kernel* k, size_t size, bool cold, double* cv)
+{
+    // Fill the inputs every kernel reads, as the earlier kernels in a frame would
+    calc_fft(sample, fft, size);
+    calc_fft_mag(fft, fft_mag, size);
+
+    size_t calls = 1;
+    if (!cold)
+    {
+        // Warm up, then repeat enough calls per sample for the clock to resolve them
+        double start = now_ns();
+        k->run(size);
+        while (now_ns() - start < MIN_SAMPLE_NS/4) k->run(size);
+        start = now_ns();
+        k->run(size);
+        double once = now_ns() - start;
+        calls = once > 0 ? ceil(MIN_SAMPLE_NS/once) : 1000;
+    }
+
+    double samples[SAMPLES];
+    double sum = 0, sum_squares = 0;
+    for (size_t s = 0; s < SAMPLES; ++s)
+    {
+        if (cold) evict_caches();
+        double start = now_ns();
+        for (size_t c = 0; c < calls; ++c) k->run(size);
+        samples[s] = (now_ns() - start)/calls;
+        sum += samples[s];
+        sum_squares += samples[s]*samples[s];
+    }
+    double mean = sum/SAMPLES;
+    double variance = sum_squares/SAMPLES - mean*mean;
+    *cv = mean > 0 && variance > 0 ? sqrt(variance)/mean : 0;
+    qsort(samples, SAMPLES, sizeof(double), compare_doubles);
+    return samples[SAMPLES/2];
+}
+
+// Read a baseline file; return the number of measurements
+static size_t read_baseline (const char* path, measurement** baseline)
+{
+    *baseline = NULL;
+    FILE* f = fopen(path, "r");
+    if (f == NULL) return 0;
+    size_t count = 0;
+    measurement m;
+    char mode[8];
+    while (fscanf(f, "%63s %zu %7s %lf", m.name, &m.size, mode, &m.ns) == 4)
+    {
+        m.cold = strcmp(mode, "cold") == 0;
+        *baseline = realloc(*baseline, sizeof(measurement) * (count+1));
+        (*baseline)[count++] = m;
+    }
+    fclose(f);
+    return count;
+}
+
+static void usage ()
+{
+    fprintf(stderr, "Usage: microbench [-k kernel] [-w baseline] [-b baseline] [-t percent]\n");
+    fprintf(stderr, "  -k  only run kernels whose name contains this\n");
+    fprintf(stderr, "  -w  write the results to a baseline file\n");
+    fprintf(stderr, "  -b  compare the results against a baseline file\n");
+    fprintf(stderr, "  -t  slowdown (in percent) that fails the comparison (default %.0f)\n", DEFAULT_THRESHOLD);
+}
+
+int main (int argc, char** argv)
+{
+    const char* filter = NULL;
+    const char* write_path = NULL;
+    const char* baseline_path = NULL;
+    double threshold = DEFAULT_THRESHOLD;
+    int option;
+    while ((option = getopt(argc, argv, "k:w:b:t:")) != -1)
+    {
+        switch (option) {
+            case 'k':
+                filter = optarg; break;
+            case 'w':
+                write_path = optarg; break;
+            case 'b':
+                baseline_path = optarg; break;
+            case 't':
+                threshold = atof(optarg); break;
+            default:
+                usage();
+                return 1;
+        }
+    }
+
+    measurement* baseline = NULL;
+    size_t baseline_size = 0;
+    if (baseline_path && (baseline_size = read_baseline(baseline_path, &baseline)) == 0)
+    {
+        fprintf(stderr, "Failed to read baseline: %s\n", baseline_path);
+        return 1;
+    }
+    FILE* out = NULL;
+    if (write_path && (out = fopen(write_path, "w")) == NULL)
+    {
+        fprintf(stderr, "Failed to open %s\n", write_path);
+        return 1;
+    }
+
+    // A voice-like test signal: a 220Hz fundamental with decaying harmonics and some noise
+    srand(1);
+    for (size_t i = 0; i < MAX_SIZE; ++i)
+    {
+        sample[i] = 0.01*(rand()/(double)RAND_MAX - 0.5);
+        for (int h = 1; h <= 8; ++h) sample[i] += sin(2*M_PI*220*h*i/SAMPLE_RATE)/h;
+    }
+    evict = calloc(EVICT_SIZE, 1);
+
+    size_t regressions = 0;
+    printf("%-24s %6s %5s %12s %7s %10s\n", "kernel", "size", "cache", "ns/call", "cv", "Msample/s");
+    for (size_t k = 0; k < NUM_KERNELS; ++k)
+    {
+        if (filter && !strstr(kernels[k].name, filter)) continue;
+        for (size_t size = MIN_SIZE; size <= MAX_SIZE; size *= 2)
+        {
+            for (int cold = 0; cold <= 1; ++cold)
+            {
+                double cv;
+                double ns = measure(&kernels[k], size, cold, &cv);
+                printf("%-24s %6zu %5s %12.0f %6.1f%% %10.1f", kernels[k].name, size, cold ? "cold" : "warm",
+                       ns, 100*cv, ns > 0 ? size/ns*1e3 : 0);
+                if (out) fprintf(out, "%s %zu %s %.1f\n", kernels[k].name, size, cold ? "cold" : "warm", ns);
+
+                for (size_t b = 0; b < baseline_size; ++b)
+                {
+                    measurement* m = &baseline[b];
+                    if (strcmp(m->name, kernels[k].name) != 0 || m->size != size || m->cold != cold) continue;
+                    double change = 100*(ns/m->ns - 1);
+                    printf(" %+7.1f%%", change);
+                    if (change > threshold)
+                    {
+                        printf(" REGRESSION");
+                        ++regressions;
+                    }
+                }
+                printf("\n");
+            }
+        }
+    }
+
+    if (out) fclose(out);
+    free(baseline);
+    free(evict);
+    if (regressions)
+    {
+        fprintf(stderr, "FAILED: %zu measurements are more than %.0f%% slower than %s\n", regressions, threshold, baseline_path);
+        return 1;
+    }
+    return 0;
+}
@@ -1,17 +1,28 @@
+#include "pitch.h"
+#include "plans.h"
+
 #include <fftw3.h>
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 #define E 2.71828182845904523536028747135266249775724709369995
+#define MCLEOD_K 0.9 // Key maxima above MCLEOD_K * the highest one are period candidates
+#define LOG_FLOOR 1e-12 // Added to magnitudes before taking their log
+#define HPS_OVERSAMPLING 8 // Harmonic product spectrum candidates per bin
+#define HARMONIC_TOLERANCE 0.1 // Largest distance (in harmonic numbers) of a peak from a harmonic
 
 
 void calc_fft (double* sample, fftw_complex* fft, size_t sample_size)
 {
-    fftw_plan plan_forward = fftw_plan_dft_r2c_1d((int)sample_size, sample, fft, FFTW_ESTIMATE);
-    fftw_execute(plan_forward);
-    fftw_destroy_plan(plan_forward);
+    fftw_execute_dft_r2c(plan_r2c(sample_size), sample, fft);
 }
 
 void calc_fft_mag (fftw_complex* fft, double* fft_mag, size_t sample_size)
@@ -153,48 +164,299 @@ double calc_spectral_crest(double* fft_mag, size_t sample_size, double sample_ra
     return crest;
 }
 
-double calc_harmonics(fftw_complex* fft, double* fft_mag, size_t sample_size, double sample_rate)
+// Interpolate the peak at bin i and insert it into peaks, evicting the weakest peak if full
+static void add_peak (double* fft_mag, size_t i, double bin_size, spectral_peak* peaks, size_t* num_peaks, size_t max_peaks)
 {
-    double harmonics[sample_size/2+1];
-    harmonics[0] = -INFINITY;
-    harmonics[sample_size/2] = -INFINITY;
-    double peak;
-    double left;
-    double right;
-    double delta;
-    double est_freq;
-    //calc harmonics
-    for (size_t i = 1; i<sample_size/2; ++i)
+    double left   = log(fft_mag[i-1] + LOG_FLOOR);
+    double center = log(fft_mag[i]   + LOG_FLOOR);
+    double right  = log(fft_mag[i+1] + LOG_FLOOR);
+    double denominator = left - 2*center + right;
+    double delta = denominator == 0 ? 0 : 0.5*(left - right)/denominator;
+    spectral_peak peak = {(i + delta) * bin_size, exp(center - 0.25*(left - right)*delta)};
+
+    if (*num_peaks == max_peaks)
     {
-        if ((fft_mag[i]>fft_mag[i-1])&&(fft_mag[i]>fft_mag[i+1]))
+        size_t weakest = 0;
+        for (size_t j = 1; j < max_peaks; ++j)
         {
-            peak  = fft[i][0];
-            left  = fft[i-1][0];
-            right = fft[i+1][0];
-            delta = (right - left) / (2 * peak - left - right);
-            est_freq = sample_rate / sample_size * (i - delta);
-            harmonics[i] = est_freq;
-        }else{
-            harmonics[i]=-INFINITY;
+            if (peaks[j].magnitude < peaks[weakest].magnitude) weakest = j;
         }
+        if (peaks[weakest].magnitude >= peak.magnitude) return;
+        for (size_t j = weakest; j+1 < max_peaks; ++j) peaks[j] = peaks[j+1];
+        --*num_peaks;
+    }
+    peaks[(*num_peaks)++] = peak;
+}
+
+size_t find_peaks (double* fft_mag, size_t sample_size, double sample_rate, double low, double high, double min_magnitude, spectral_peak* peaks, size_t max_peaks)
+{
+    if (max_peaks == 0) return 0;
+    double bin_size = sample_rate/sample_size;
+    size_t start = low/bin_size;
+    size_t end   = high/bin_size + 1;
+    if (start < 1) start = 1;
+    if (end > sample_size/2) end = sample_size/2;
+
+    // Bins greater than their left neighbour, at least their right one and above the floor
+    size_t num_peaks = 0;
+    size_t i = start;
+#if defined(__SSE2__)
+    __m128d floor = _mm_set1_pd(min_magnitude);
+    for (; i+2 <= end; i += 2)
+    {
+        __m128d center = _mm_loadu_pd(fft_mag + i);
+        __m128d is_peak = _mm_and_pd(_mm_cmpgt_pd(center, _mm_loadu_pd(fft_mag + i - 1)),
+                                     _mm_cmpge_pd(center, _mm_loadu_pd(fft_mag + i + 1)));
+        int mask = _mm_movemask_pd(_mm_and_pd(is_peak, _mm_cmpge_pd(center, floor)));
+        if (mask & 1) add_peak(fft_mag, i,   bin_size, peaks, &num_peaks, max_peaks);
+        if (mask & 2) add_peak(fft_mag, i+1, bin_size, peaks, &num_peaks, max_peaks);
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    float64x2_t floor = vdupq_n_f64(min_magnitude);
+    for (; i+2 <= end; i += 2)
+    {
+        float64x2_t center = vld1q_f64(fft_mag + i);
+        uint64x2_t is_peak = vandq_u64(vcgtq_f64(center, vld1q_f64(fft_mag + i - 1)),
+                                       vcgeq_f64(center, vld1q_f64(fft_mag + i + 1)));
+        is_peak = vandq_u64(is_peak, vcgeq_f64(center, floor));
+        if (vgetq_lane_u64(is_peak, 0)) add_peak(fft_mag, i,   bin_size, peaks, &num_peaks, max_peaks);
+        if (vgetq_lane_u64(is_peak, 1)) add_peak(fft_mag, i+1, bin_size, peaks, &num_peaks, max_peaks);
+    }
+#endif
+    for (; i < end; ++i)
+    {
+        if (fft_mag[i] > fft_mag[i-1] && fft_mag[i] >= fft_mag[i+1] && fft_mag[i] >= min_magnitude)
+            add_peak(fft_mag, i, bin_size, peaks, &num_peaks, max_peaks);
     }
-    //calc average
-    double prev_harmonic = 0;
-    double harmonic_total = 0;
-    int    num_harmonics_seen = 0;
-    for (size_t i = 0; i<sample_size/2+1; ++i)
+    return num_peaks;
+}
+
+double harmonic_pitch (spectral_peak* peaks, size_t num_peaks, double min_freq, double max_freq)
+{
+    // Candidates: every peak and every spacing between neighbouring peaks
+    double best_score = 0;
+    double best = -INFINITY;
+    double total = 0;
+    for (size_t i = 0; i < num_peaks; ++i) total += sqrt(peaks[i].magnitude);
+    for (size_t c = 0; c < 2*num_peaks; ++c)
     {
-        if ((harmonics[i]>50)&&(harmonics[i]<500))
+        double candidate = c < num_peaks ? peaks[c].frequency
+                                         : c+1 < 2*num_peaks ? peaks[c-num_peaks+1].frequency - peaks[c-num_peaks].frequency : 0;
+        if (!(candidate >= min_freq && candidate <= max_freq)) continue;
+
+        // Score: the share of the spectrum explained, times the share of harmonic slots filled
+        double explained = 0;
+        double numerator = 0;
+        double denominator = 0;
+        int    filled = 0;
+        int    last_harmonic = 0;
+        for (size_t i = 0; i < num_peaks; ++i)
         {
-            if (prev_harmonic==0) {
-                prev_harmonic = harmonics[i];
-                num_harmonics_seen=1;
-            }else{
-                harmonic_total+=(harmonics[i]-prev_harmonic);
-                prev_harmonic = harmonics[i];
-                num_harmonics_seen+=1;
-            }
+            double ratio = peaks[i].frequency/candidate;
+            int harmonic = (int)(ratio + 0.5);
+            if (harmonic < 1 || fabs(ratio - harmonic) > HARMONIC_TOLERANCE) continue;
+            double weight = sqrt(peaks[i].magnitude);
+            explained   += weight;
+            numerator   += weight*peaks[i].frequency*harmonic;
+            denominator += weight*harmonic*harmonic;
+            if (harmonic != last_harmonic) ++filled;
+            last_harmonic = harmonic;
+        }
+        if (last_harmonic == 0) continue;
+        double score = explained/total * filled/last_harmonic;
+        if (score > best_score)
+        {
+            best_score = score;
+            best = numerator/denominator; // Least squares fit of the harmonic series
         }
     }
-    return harmonic_total/num_harmonics_seen;
-}
\ No newline at end of file
+    return best;
+}
+
+// Return the length of the zero padded frame, a power of two of at least 2*sample_size
+static size_t mcleod_padded_size (size_t sample_size)
+{
+    size_t padded_size = 1;
+    while (padded_size < 2*sample_size) padded_size *= 2;
+    return padded_size;
+}
+
+size_t mcleod_scratch_size (size_t sample_size)
+{
+    size_t padded_size = mcleod_padded_size(sample_size);
+    return padded_size + 2*(padded_size/2+1); // The padded frame, then its spectrum
+}
+
+// Return the key maximum of the next positive lobe of nsdf at or after *tau, or 0 if none
+// is left: the highest point between a positive zero crossing and the next negative one
+static size_t next_key_maximum (double* nsdf, size_t max_lag, size_t* tau)
+{
+    while (*tau < max_lag-1)
+    {
+        while (*tau < max_lag-1 && nsdf[*tau] <= 0) ++*tau;
+        size_t best = *tau;
+        while (*tau < max_lag-1 && nsdf[*tau] > 0)
+        {
+            if (nsdf[*tau] > nsdf[best]) best = *tau;
+            ++*tau;
+        }
+        // A lobe cut off by max_lag only counts if its maximum is not at the edge
+        if (nsdf[best] > 0 && (*tau < max_lag-1 || best+1 < *tau)) return best;
+    }
+    return 0;
+}
+
+double mcleod_pitch (double* sample, size_t sample_size, double sample_rate, double min_freq, double* scratch, double* clarity)
+{
+    if (clarity) *clarity = 0;
+
+    // Autocorrelation r(tau) through the power spectrum of the zero padded frame
+    size_t padded_size = mcleod_padded_size(sample_size);
+    double*       padded   = scratch;
+    fftw_complex* spectrum = (fftw_complex*)(scratch + padded_size);
+    for (size_t i = 0; i < sample_size; ++i) padded[i] = sample[i];
+    for (size_t i = sample_size; i < padded_size; ++i) padded[i] = 0;
+    fftw_execute_dft_r2c(plan_r2c(padded_size), padded, spectrum);
+    for (size_t i = 0; i < padded_size/2+1; ++i)
+    {
+        spectrum[i][0] = spectrum[i][0]*spectrum[i][0] + spectrum[i][1]*spectrum[i][1];
+        spectrum[i][1] = 0;
+    }
+    double* acf = padded;
+    fftw_execute_dft_c2r(plan_c2r(padded_size), spectrum, acf);
+
+    // Normalized square difference n(tau) = 2r(tau)/m(tau), m(tau) = sum of x[j]^2 + x[j+tau]^2,
+    // computed in place of r(tau)
+    size_t max_lag = sample_size/2;
+    if (min_freq > 0 && sample_rate/min_freq + 1 < max_lag) max_lag = sample_rate/min_freq + 1;
+    if (max_lag < 3) return -INFINITY;
+    double* nsdf = acf;
+    double m = 0;
+    for (size_t i = 0; i < sample_size; ++i) m += 2*sample[i]*sample[i];
+    if (m == 0) return -INFINITY;
+    for (size_t tau = 0; tau < max_lag; ++tau)
+    {
+        if (tau > 0) m -= sample[tau-1]*sample[tau-1] + sample[sample_size-tau]*sample[sample_size-tau];
+        nsdf[tau] = m > 0 ? 2*acf[tau]/padded_size/m : 0;
+    }
+
+    // Skip the lag 0 lobe, then find the highest key maximum
+    size_t start = 1;
+    while (start < max_lag && nsdf[start] > 0) ++start;
+    double highest = 0;
+    size_t tau = start;
+    size_t peak;
+    while ((peak = next_key_maximum(nsdf, max_lag, &tau)))
+        if (nsdf[peak] > highest) highest = nsdf[peak];
+
+    // The first key maximum close enough to the highest one is the period
+    tau = start;
+    while ((peak = next_key_maximum(nsdf, max_lag, &tau)))
+    {
+        if (nsdf[peak] < MCLEOD_K * highest) continue;
+
+        double left   = nsdf[peak-1];
+        double center = nsdf[peak];
+        double right  = nsdf[peak+1];
+        double denominator = left - 2*center + right;
+        double delta = denominator == 0 ? 0 : 0.5*(left - right)/denominator;
+        if (clarity)
+        {
+            *clarity = center - 0.25*(left - right)*delta;
+            if (*clarity > 1) *clarity = 1;
+        }
+        return sample_rate / (peak + delta);
+    }
+    return -INFINITY;
+}
+
+double cepstral_pitch (double* fft_mag, double* cepstrum, size_t sample_size, double sample_rate, double min_freq, double max_freq)
+{
+    // The spectrum of a real signal is even, so its inverse transform is a DCT-I of the
+    // half spectrum, and the cepstrum lags run from 0 to sample_size/2 samples
+    size_t num_bins = sample_size/2+1;
+    double log_mag[num_bins];
+    for (size_t i = 0; i < num_bins; ++i) log_mag[i] = log(fft_mag[i] + LOG_FLOOR);
+    fftw_execute_r2r(plan_r2r(num_bins, FFTW_REDFT00), log_mag, cepstrum);
+    for (size_t i = 0; i < num_bins; ++i) cepstrum[i] /= sample_size;
+
+    size_t min_lag = sample_rate/max_freq;
+    size_t max_lag = sample_rate/min_freq + 1;
+    if (min_lag < 2) min_lag = 2;
+    if (max_lag > sample_size/2-1) max_lag = sample_size/2-1;
+    if (min_lag >= max_lag) return -INFINITY;
+
+    size_t peak = min_lag;
+    for (size_t lag = min_lag; lag < max_lag; ++lag)
+    {
+        if (cepstrum[lag] > cepstrum[peak]) peak = lag;
+    }
+    if (cepstrum[peak] <= 0) return -INFINITY;
+
+    double left   = cepstrum[peak-1];
+    double center = cepstrum[peak];
+    double right  = cepstrum[peak+1];
+    double denominator = left - 2*center + right;
+    double delta = denominator == 0 ? 0 : 0.5*(left - right)/denominator;
+    return sample_rate / (peak + delta);
+}
+
+double hps_pitch (double* fft_mag, size_t sample_size, double sample_rate, int num_harmonics, double min_freq, double max_freq)
+{
+    // Candidates are spaced a fraction of a bin apart, since the harmonics of a fundamental
+    // between two bins drift away from the integer multiples of its nearest bin
+    double bin_size = sample_rate/sample_size;
+    size_t num_bins = sample_size/2+1;
+    double min_bin  = min_freq/bin_size;
+    double max_bin  = max_freq/bin_size;
+    if (min_bin < 1) min_bin = 1;
+    if (max_bin > (num_bins-2.0)/num_harmonics) max_bin = (num_bins-2.0)/num_harmonics;
+    if (min_bin >= max_bin) return -INFINITY;
+
+    // Product of the spectrum sampled at each multiple of the candidate, as a sum of logs.
+    // Each harmonic reads the larger of the two bins around it. The fundamental itself
+    // must be a spectral peak, otherwise leakage into the lowest bins wins subharmonics.
+    double best_bin = 0;
+    double best = -INFINITY;
+    for (double candidate = min_bin; candidate <= max_bin; candidate += 1.0/HPS_OVERSAMPLING)
+    {
+        size_t fundamental = (size_t)candidate;
+        if (fft_mag[fundamental+1] > fft_mag[fundamental]) ++fundamental;
+        if (fft_mag[fundamental] < fft_mag[fundamental-1] || fft_mag[fundamental] < fft_mag[fundamental+1]) continue;
+
+        double product = 0;
+        for (int h = 1; h <= num_harmonics; ++h)
+        {
+            size_t bin = (size_t)(candidate*h);
+            double mag = fft_mag[bin] > fft_mag[bin+1] ? fft_mag[bin] : fft_mag[bin+1];
+            product += log(mag + LOG_FLOOR);
+        }
+        if (product > best)
+        {
+            best = product;
+            best_bin = candidate;
+        }
+    }
+    if (best_bin == 0) return -INFINITY;
+
+    // Refine with every harmonic: the strongest bin next to best_bin*h holds harmonic h,
+    // and its interpolated frequency divided by h estimates the fundamental. Higher
+    // harmonics are measured h times more precisely, so they are weighted by h.
+    double estimate = 0;
+    double weights  = 0;
+    for (int h = 1; h <= num_harmonics; ++h)
+    {
+        size_t bin = (size_t)(best_bin*h + 0.5);
+        if (fft_mag[bin-1] > fft_mag[bin]) --bin;
+        else if (fft_mag[bin+1] > fft_mag[bin]) ++bin;
+        if (bin < 1 || bin > num_bins-2) continue;
+        double left   = log(fft_mag[bin-1] + LOG_FLOOR);
+        double center = log(fft_mag[bin]   + LOG_FLOOR);
+        double right  = log(fft_mag[bin+1] + LOG_FLOOR);
+        double denominator = left - 2*center + right;
+        double delta = denominator == 0 ? 0 : 0.5*(left - right)/denominator;
+        estimate += (bin + delta) * bin_size;
+        weights  += h;
+    }
+    return weights > 0 ? estimate/weights : -INFINITY;
+}
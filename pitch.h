@@ -1,5 +1,14 @@
 #include <fftw3.h>
 
+#define MAX_HARMONICS 32
+
+// A local maximum of a magnitude spectrum
+typedef struct
+{
+    double frequency; // Interpolated frequency (in Hz)
+    double magnitude; // Interpolated magnitude
+} spectral_peak;
+
 // Perform a fast fourier transform on sample, storing the result in fft
 //   sample:      input array of length sample_size
 //   fft:         output array of length sample_size/2+1
@@ -55,9 +64,56 @@ double calc_spectral_crest(double* fft_mag, size_t sample_size, double sample_ra
 //   high:        highest frequency to be analyzed (inclusive)
 double calc_spectral_flatness(double* fft_mag, size_t sample_size, size_t sample_rate, size_t low, size_t high);
 
-// Return the average difference between harmonics between 500 and 5000Hz
-//   fft:         input array of length sample_size/2+1
+// Find the local maxima of fft_mag between low and high, interpolated on a log scale.
+// Return the number of peaks stored, sorted by frequency. If there are more than
+// max_peaks peaks, the strongest are kept.
+//   fft_mag:       input array of length sample_size/2+1
+//   sample_size:   the length of the original sample the fft was based on
+//   sample_rate:   the sampling rate (in Hz) of the original sample
+//   low:           minimum frequency to be scanned (inclusive)
+//   high:          highest frequency to be scanned (inclusive)
+//   min_magnitude: peaks below this magnitude are ignored
+//   peaks:         output array of length max_peaks
+//   max_peaks:     the capacity of peaks
+size_t find_peaks (double* fft_mag, size_t sample_size, double sample_rate, double low, double high, double min_magnitude, spectral_peak* peaks, size_t max_peaks);
+
+// Return the fundamental frequency whose harmonic series best explains a peak list, or -INFINITY
+//   peaks:     input array of length num_peaks, sorted by frequency (as from find_peaks)
+//   num_peaks: the number of peaks
+//   min_freq:  lowest frequency to be detected
+//   max_freq:  highest frequency to be detected
+double harmonic_pitch (spectral_peak* peaks, size_t num_peaks, double min_freq, double max_freq);
+
+// Return the fundamental frequency of sample using the McLeod Pitch Method, or -INFINITY
+// if the sample has no clear period. The autocorrelation is computed with one forward and
+// one inverse FFT of the zero padded sample, and the period refined with a parabola.
+//   sample:      input array of length sample_size
+//   sample_size: the length of the sample array
+//   sample_rate: the sampling rate (in Hz) of the sample
+//   min_freq:    the lowest frequency to be detected, limited to 2*sample_rate/sample_size
+//   scratch:     work array of length mcleod_scratch_size(sample_size)
+//   clarity:     output (or NULL), the normalized autocorrelation at the period, from 0 to 1
+double mcleod_pitch (double* sample, size_t sample_size, double sample_rate, double min_freq, double* scratch, double* clarity);
+
+// Return the length of the scratch array mcleod_pitch needs
+//   sample_size: the length of the sample array
+size_t mcleod_scratch_size (size_t sample_size);
+
+// Return the fundamental frequency from the peak of the real cepstrum, or -INFINITY
 //   fft_mag:     input array of length sample_size/2+1
+//   cepstrum:    output array of length sample_size/2+1, indexed by lag (in samples)
 //   sample_size: the length of the original sample the fft was based on
 //   sample_rate: the sampling rate (in Hz) of the original sample
-double calc_harmonics(fftw_complex* fft, double* fft_mag, size_t sample_size, double sample_rate);
+//   min_freq:    lowest frequency to be detected, limited to 2*sample_rate/sample_size
+//   max_freq:    highest frequency to be detected
+double cepstral_pitch (double* fft_mag, double* cepstrum, size_t sample_size, double sample_rate, double min_freq, double max_freq);
+
+// Return the fundamental frequency maximizing the harmonic product spectrum, or -INFINITY.
+// The winning bin is refined from the interpolated peaks of all of its harmonics.
+//   fft_mag:       input array of length sample_size/2+1
+//   sample_size:   the length of the original sample the fft was based on
+//   sample_rate:   the sampling rate (in Hz) of the original sample
+//   num_harmonics: the number of harmonics multiplied together
+//   min_freq:      lowest frequency to be detected
+//   max_freq:      highest frequency to be detected
+double hps_pitch (double* fft_mag, size_t sample_size, double sample_rate, int num_harmonics, double min_freq, double max_freq);
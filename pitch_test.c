@@ -1,15 +1,26 @@
+#include "cqt.h"
+#include "dywapitchtrack.h"
+#include "ensemble.h"
 #include "pitch.h"
 #include "tinydir.h"
+#include "wav.h"
 
 #include <fftw3.h>
-#include <sndfile.h>
 
 #include <math.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 
+#define BENCH_FRAME_SIZE 1024
+#define MCLEOD_MIN_FREQ  50
+#define BENCH_DEADLINE   1000000 // Microseconds, long enough for every ensemble member
+#define BENCH_CQT_SIZE   16384   // At 44.1kHz, as long as the backend's CQT frame
+#define BENCH_CQT_BINS   72      // Semitones from 55Hz, as in the backend
+
 // Return true iff str ends with suffix
 bool ends_with (char* str, char* suffix)
 {
@@ -27,11 +38,10 @@ bool test (char* test, double* sample, size_t sample_size, double sample_rate, d
     // Set up
     bool pass = true;
     fftw_complex* fft = malloc(sizeof(fftw_complex)*(sample_size/2+1));
-    double* fft_tmp = malloc(sizeof(double)*sample_size);
     double* fft_mag = malloc(sizeof(double)*(sample_size/2+1));
 
     // Test functions
-    calc_fft(sample, fft, fft_tmp, sample_size);
+    calc_fft(sample, fft, sample_size);
     calc_fft_mag(fft, fft_mag, sample_size);
     double dom = dominant_freq(fft, fft_mag, sample_size, sample_rate);
     double dom_err = dom - sample_freq;
@@ -48,10 +58,28 @@ bool test (char* test, double* sample, size_t sample_size, double sample_rate, d
         fprintf(stderr, "\n");
     }
 
+    size_t frame_size = sample_size < BENCH_FRAME_SIZE ? sample_size : BENCH_FRAME_SIZE;
+    if (sample_freq > 2*sample_rate/frame_size)
+    {
+        double clarity;
+        double* scratch = malloc(sizeof(double)*mcleod_scratch_size(frame_size));
+        double mcleod = mcleod_pitch(sample, frame_size, sample_rate, MCLEOD_MIN_FREQ, scratch, &clarity);
+        free(scratch);
+        double mcleod_err = mcleod - sample_freq;
+        if (!(fabs(mcleod_err)/sample_freq <= .02))
+        {
+            fprintf(stderr, "FAILED: %s\n", test);
+            fprintf(stderr, "    Frame size:  %ld\n", frame_size);
+            fprintf(stderr, "    Frequency:   %.0f\n", sample_freq);
+            fprintf(stderr, "    McLeod = %f (%+.2fhz) (clarity %.2f)\n", mcleod, mcleod_err, clarity);
+            pass = false;
+            fprintf(stderr, "\n");
+        }
+    }
+
     // Clean up
     free(sample);
     free(fft);
-    free(fft_tmp);
     free(fft_mag);
     return pass;
 }
@@ -65,22 +93,25 @@ bool sine_test (size_t sample_size, double sample_rate, double sample_freq)
     return test("sine wave", sample, sample_size, sample_rate, sample_freq);
 }
 
-// Test pitch detection on a WAV file
+// Test pitch detection on a WAV file, which is analyzed as a single frame
 bool file_test (char* file, double sample_freq)
 {
-    SF_INFO info;
-    SNDFILE* f = sf_open(file, SFM_READ, &info);
-    if (f == NULL)
+    wav_reader r;
+    if (!wav_open(&r, file))
     {
         fprintf(stderr, "FAILED: %s\n    File not found.\n", file);
         return false;
     }
-    double* sample = malloc(sizeof(double)*info.frames);
-
-    sf_read_double(f, sample, info.frames);
-    test(file, sample, info.frames, info.samplerate, sample_freq);
+    double* sample = malloc(sizeof(double)*r.frames);
+    float block[BENCH_FRAME_SIZE];
+    size_t count, sample_size = 0;
+    while ((count = wav_read(&r, block, BENCH_FRAME_SIZE)) > 0)
+    {
+        for (size_t i = 0; i < count; ++i) sample[sample_size++] = block[i];
+    }
+    test(file, sample, sample_size, r.sample_rate, sample_freq);
 
-    sf_close(f);
+    wav_close(&r);
     return true;
 }
 
@@ -123,9 +154,303 @@ fail:
     return false;
 }
 
-// Run all tests
-int main (void)
+// Accuracy and cost of one estimator over a set of frames
+typedef struct
+{
+    long        frames;
+    long        correct;       // Within 50 cents of the labeled frequency
+    long        octave_errors; // Within 50 cents of half or twice the labeled frequency
+    double      total_ns;
+    double*     cents;         // Absolute error of every frame, INFINITY if there was no estimate
+    long        capacity;      // Length of cents
+} estimator_stats;
+
+#define BENCH_ESTIMATORS 8
+static const char* estimator_names[BENCH_ESTIMATORS] = {"dominant_freq_lp", "mcleod_pitch", "cepstral_pitch",
+                                                        "hps_pitch", "wavelet_pitch", "ensemble", "harmonic_pitch",
+                                                        "cqt_pitch"};
+
+// The estimators' stats over the files of one directory (one vowel of the samples)
+typedef struct
+{
+    char            name[256];
+    estimator_stats stats[BENCH_ESTIMATORS];
+} bench_group;
+
+static bench_group* groups; // groups[0] covers every file
+static size_t       num_groups;
+
+static void add_group (const char* name)
+{
+    groups = realloc(groups, sizeof(bench_group) * (num_groups+1));
+    bench_group* g = &groups[num_groups++];
+    memset(g, 0, sizeof(bench_group));
+    snprintf(g->name, sizeof(g->name), "%s", name);
+}
+
+static double now_ns ()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec*1e9 + t.tv_nsec;
+}
+
+static void add_score (estimator_stats* stats, double cents, double ns)
+{
+    if (stats->frames == stats->capacity)
+    {
+        stats->capacity = stats->capacity ? 2*stats->capacity : 1024;
+        stats->cents = realloc(stats->cents, sizeof(double) * stats->capacity);
+    }
+    stats->cents[stats->frames++] = fabs(cents);
+    stats->total_ns += ns;
+    if      (fabs(cents) < 50)                                           ++stats->correct;
+    else if (fabs(fabs(cents)-1200) < 50 || fabs(fabs(cents)-2400) < 50) ++stats->octave_errors;
+}
+
+// Score an estimate in a group and in the total
+static void score (bench_group* group, size_t estimator, double estimate, double sample_freq, double ns)
+{
+    double cents = estimate > 0 ? 1200*log2(estimate/sample_freq) : INFINITY;
+    add_score(&group->stats[estimator], cents, ns);
+    add_score(&groups[0].stats[estimator], cents, ns);
+}
+
+// Compare the pitch estimators frame by frame on a WAV file labeled with its frequency
+void bench_file (char* file, double sample_freq, bench_group* group, ensemble* e, cqt* c)
+{
+    wav_reader r;
+    if (!wav_open(&r, file)) return;
+    cqt_reset(c);
+
+    fftw_complex fft[BENCH_FRAME_SIZE/2+1];
+    double fft_mag[BENCH_FRAME_SIZE/2+1];
+    float block[BENCH_FRAME_SIZE];
+    double frame[BENCH_FRAME_SIZE];
+    double* scratch = malloc(sizeof(double)*mcleod_scratch_size(BENCH_FRAME_SIZE));
+    while (wav_read(&r, block, BENCH_FRAME_SIZE) == BENCH_FRAME_SIZE)
+    {
+        for (size_t i = 0; i < BENCH_FRAME_SIZE; ++i) frame[i] = block[i];
+
+        double start = now_ns();
+        calc_fft(frame, fft, BENCH_FRAME_SIZE);
+        calc_fft_mag(fft, fft_mag, BENCH_FRAME_SIZE);
+        double lp = dominant_freq_lp(fft, fft_mag, BENCH_FRAME_SIZE, r.sample_rate, 5000);
+        score(group, 0, lp, sample_freq, now_ns()-start);
+
+        start = now_ns();
+        double mcleod = mcleod_pitch(frame, BENCH_FRAME_SIZE, r.sample_rate, MCLEOD_MIN_FREQ, scratch, NULL);
+        score(group, 1, mcleod, sample_freq, now_ns()-start);
+
+        // The spectrum is shared with dominant_freq_lp, so only the estimators themselves are timed
+        double cepstrum[BENCH_FRAME_SIZE/2+1];
+        start = now_ns();
+        double cepstral = cepstral_pitch(fft_mag, cepstrum, BENCH_FRAME_SIZE, r.sample_rate, 50, 1000);
+        score(group, 2, cepstral, sample_freq, now_ns()-start);
+
+        start = now_ns();
+        double hps = hps_pitch(fft_mag, BENCH_FRAME_SIZE, r.sample_rate, 4, 50, 1000);
+        score(group, 3, hps, sample_freq, now_ns()-start);
+
+        start = now_ns();
+        spectral_peak peaks[MAX_HARMONICS];
+        size_t num_peaks = find_peaks(fft_mag, BENCH_FRAME_SIZE, r.sample_rate, 50, 5000, 0, peaks, MAX_HARMONICS);
+        double harmonic = harmonic_pitch(peaks, num_peaks, 50, 1000);
+        score(group, 6, harmonic, sample_freq, now_ns()-start);
+
+        start = now_ns();
+        double wavelet = _dywapitch_computeWaveletPitch(frame, 0, BENCH_FRAME_SIZE);
+        score(group, 4, wavelet, sample_freq, now_ns()-start);
+
+        start = now_ns();
+        double fused = ensemble_estimate(e, frame, fft, fft_mag, BENCH_DEADLINE, NULL);
+        score(group, 5, fused, sample_freq, now_ns()-start);
+
+        // Streaming, so its frame reaches back over the frames before
+        double cqt_mag[BENCH_CQT_BINS];
+        start = now_ns();
+        cqt_push(c, frame, BENCH_FRAME_SIZE);
+        cqt_compute(c, cqt_mag);
+        double constant_q = cqt_pitch(c, cqt_mag, 6, 1000);
+        score(group, 7, constant_q, sample_freq, now_ns()-start);
+    }
+    free(scratch);
+    wav_close(&r);
+}
+
+// Compare the pitch estimators on every labeled WAV file found in the directory at path,
+// grouping files by the directory they are in
+void bench_dir (char* path, ensemble* e, cqt* c)
+{
+    tinydir_dir dir;
+    tinydir_open(&dir, path);
+    size_t group = 0; // This directory's group, once it has a labeled file (groups[0] is the total)
+
+    while (dir.has_next)
+    {
+        tinydir_file file;
+        tinydir_readfile(&dir, &file);
+        if (file.name[0] != '.')
+        {
+            char file_path[1024];
+            strcpy(file_path, path);
+            strcat(file_path, "/");
+            strcat(file_path, file.name);
+
+            double freq = atof(file.name);
+            if (file.is_dir) bench_dir(file_path, e, c);
+            else if (freq > 0 && ends_with(file.name, ".wav"))
+            {
+                if (group == 0)
+                {
+                    char* name = strrchr(path, '/');
+                    add_group(name ? name+1 : path);
+                    group = num_groups-1;
+                }
+                bench_file(file_path, freq, &groups[group], e, c);
+            }
+        }
+
+        tinydir_next(&dir);
+    }
+
+    tinydir_close(&dir);
+}
+
+static int compare_doubles (const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static int compare_groups (const void* a, const void* b)
+{
+    return strcmp(((const bench_group*)a)->name, ((const bench_group*)b)->name);
+}
+
+// Return the nearest rank percentile of sorted values, or NAN if there are none
+static double percentile (double* sorted, long count, double p)
+{
+    if (count == 0) return NAN;
+    long rank = ceil(p/100*count);
+    return sorted[rank > 0 ? rank-1 : 0];
+}
+
+// Write a string as JSON, escaping quotes, backslashes and control characters
+static void json_string (FILE* out, const char* str)
+{
+    fputc('"', out);
+    for (const unsigned char* c = (const unsigned char*)str; *c; ++c)
+    {
+        if      (*c == '"' || *c == '\\') fprintf(out, "\\%c", *c);
+        else if (*c < 0x20)               fprintf(out, "\\u%04x", *c);
+        else                              fputc(*c, out);
+    }
+    fputc('"', out);
+}
+
+// Write a number as JSON, which has no infinity
+static void json_number (FILE* out, const char* name, double value, const char* separator)
+{
+    if (isfinite(value)) fprintf(out, "\"%s\": %.6g%s", name, value, separator);
+    else                 fprintf(out, "\"%s\": null%s", name, separator);
+}
+
+// Write the stats of every group with frames as JSON (a group is added before its first
+// file is read, which may fail)
+static void write_json (FILE* out)
+{
+    static const double percentiles[] = {50, 90, 95, 99};
+    fprintf(out, "{\n  \"frame_size\": %d,\n  \"groups\": {", BENCH_FRAME_SIZE);
+    const char* separator = "\n";
+    for (size_t g = 0; g < num_groups; ++g)
+    {
+        if (groups[g].stats[0].frames == 0) continue; // Every estimator scores every frame
+        fprintf(out, "%s    ", separator);
+        separator = ",\n";
+        json_string(out, groups[g].name);
+        fprintf(out, ": {\n");
+        for (size_t i = 0; i < BENCH_ESTIMATORS; ++i)
+        {
+            estimator_stats* stats = &groups[g].stats[i];
+            fprintf(out, "      ");
+            json_string(out, estimator_names[i]);
+            fprintf(out, ": {");
+            fprintf(out, "\"frames\": %ld, ", stats->frames);
+            json_number(out, "accuracy", (double)stats->correct/stats->frames, ", ");
+            json_number(out, "octave_error_rate", (double)stats->octave_errors/stats->frames, ", ");
+            char name[32];
+            for (size_t p = 0; p < sizeof(percentiles)/sizeof(percentiles[0]); ++p)
+            {
+                snprintf(name, sizeof(name), "cents_p%.0f", percentiles[p]);
+                json_number(out, name, percentile(stats->cents, stats->frames, percentiles[p]), ", ");
+            }
+            json_number(out, "ns_per_frame", stats->total_ns/stats->frames, "");
+            fprintf(out, "}%s\n", i+1 < BENCH_ESTIMATORS ? "," : "");
+        }
+        fprintf(out, "    }");
+    }
+    fprintf(out, "\n  }\n}\n");
+}
+
+// Print the accuracy of every estimator on the labeled samples, and write the accuracy per
+// directory as JSON if json_path is given
+void bench (char* path, char* json_path)
+{
+    add_group("all");
+    ensemble e;
+    if (!ensemble_init(&e, BENCH_FRAME_SIZE, 44100, 50, 1000))
+    {
+        fprintf(stderr, "Failed to start the pitch ensemble\n");
+        return;
+    }
+    cqt c;
+    cqt_init(&c, BENCH_CQT_SIZE, 44100, 55, BENCH_CQT_BINS, 12);
+    bench_dir(path, &e, &c);
+    ensemble_cleanup(&e);
+    cqt_cleanup(&c);
+
+    qsort(groups+1, num_groups-1, sizeof(bench_group), compare_groups);
+    for (size_t g = 0; g < num_groups; ++g)
+        for (size_t i = 0; i < BENCH_ESTIMATORS; ++i)
+            qsort(groups[g].stats[i].cents, groups[g].stats[i].frames, sizeof(double), compare_doubles);
+
+    printf("%-18s %8s %9s %9s %8s %8s %10s\n", "estimator", "frames", "correct", "octave", "p50", "p90", "ns/frame");
+    for (size_t i = 0; i < BENCH_ESTIMATORS; ++i)
+    {
+        estimator_stats* stats = &groups[0].stats[i];
+        if (stats->frames == 0) continue;
+        printf("%-18s %8ld %8.1f%% %8.1f%% %8.1f %8.1f %10.0f\n", estimator_names[i], stats->frames,
+               100.0*stats->correct/stats->frames, 100.0*stats->octave_errors/stats->frames,
+               percentile(stats->cents, stats->frames, 50), percentile(stats->cents, stats->frames, 90),
+               stats->total_ns/stats->frames);
+    }
+
+    if (json_path && groups[0].stats[0].frames > 0)
+    {
+        FILE* out = fopen(json_path, "w");
+        if (out == NULL) fprintf(stderr, "Failed to open %s\n", json_path);
+        else
+        {
+            write_json(out);
+            fclose(out);
+        }
+    }
+
+    for (size_t g = 0; g < num_groups; ++g)
+        for (size_t i = 0; i < BENCH_ESTIMATORS; ++i) free(groups[g].stats[i].cents);
+    free(groups);
+}
+
+// Run all tests, or benchmark the estimators on the samples with "pitch_test samples [json]"
+int main (int argc, char** argv)
 {
+    if (argc > 1)
+    {
+        bench(argv[1], argc > 2 ? argv[2] : NULL);
+        return 0;
+    }
+
     for (int f = 80; f < 1200; f += 1)
     {
         if (!sine_test(1024, 44100, f)) return 1;
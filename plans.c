@@ -0,0 +1,96 @@
+#include "plans.h"
+
+#include <fftw3.h>
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define PLAN_CAPACITY 32
+#define PLAN_FLAGS    (FFTW_ESTIMATE | FFTW_UNALIGNED)
+#define KIND_R2C      -1
+#define KIND_C2R      -2
+
+typedef struct
+{
+    size_t    size;
+    int       kind;
+    fftw_plan plan;
+} cached_plan;
+
+// Entries are written once, before num_plans is released past them, and never change
+static cached_plan     plans[PLAN_CAPACITY];
+static atomic_size_t   num_plans;
+static pthread_mutex_t plans_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static fftw_plan make_plan (size_t size, int kind)
+{
+    // FFTW_ESTIMATE does not touch the arrays, they only describe the layout
+    double*       real    = fftw_malloc(sizeof(double) * size);
+    double*       real2   = fftw_malloc(sizeof(double) * size);
+    fftw_complex* complex = fftw_malloc(sizeof(fftw_complex) * (size/2+1));
+    fftw_plan plan;
+    switch (kind)
+    {
+        case KIND_R2C:
+            plan = fftw_plan_dft_r2c_1d((int)size, real, complex, PLAN_FLAGS); break;
+        case KIND_C2R:
+            plan = fftw_plan_dft_c2r_1d((int)size, complex, real, PLAN_FLAGS); break;
+        default:
+            plan = fftw_plan_r2r_1d((int)size, real, real2, (fftw_r2r_kind)kind, PLAN_FLAGS); break;
+    }
+    fftw_free(real);
+    fftw_free(real2);
+    fftw_free(complex);
+    return plan;
+}
+
+// Return the published plan of a size and kind, or NULL
+static fftw_plan find_plan (size_t size, int kind, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+        if (plans[i].size == size && plans[i].kind == kind) return plans[i].plan;
+    return NULL;
+}
+
+static fftw_plan get_plan (size_t size, int kind)
+{
+    fftw_plan plan = find_plan(size, kind, atomic_load_explicit(&num_plans, memory_order_acquire));
+    if (plan) return plan;
+
+    // Another thread may have made it since
+    pthread_mutex_lock(&plans_lock);
+    size_t count = atomic_load_explicit(&num_plans, memory_order_relaxed);
+    plan = find_plan(size, kind, count);
+    if (!plan)
+    {
+        if (count == PLAN_CAPACITY)
+        {
+            fprintf(stderr, "plans: cache full (%d plans) planning size %zu, raise PLAN_CAPACITY\n", PLAN_CAPACITY, size);
+            abort();
+        }
+        plan = make_plan(size, kind);
+        plans[count].size = size;
+        plans[count].kind = kind;
+        plans[count].plan = plan;
+        atomic_store_explicit(&num_plans, count + 1, memory_order_release);
+    }
+    pthread_mutex_unlock(&plans_lock);
+    return plan;
+}
+
+fftw_plan plan_r2c (size_t size)
+{
+    return get_plan(size, KIND_R2C);
+}
+
+fftw_plan plan_c2r (size_t size)
+{
+    return get_plan(size, KIND_C2R);
+}
+
+fftw_plan plan_r2r (size_t size, fftw_r2r_kind kind)
+{
+    return get_plan(size, (int)kind);
+}
@@ -0,0 +1,28 @@
+// Cached FFTW plans
+//
+// Planning is far more expensive than executing a transform, so plans are created
+// once per length and kind and reused for the lifetime of the program. Plans are
+// made with FFTW_UNALIGNED and are out-of-place, so they can be executed on any pair
+// of distinct arrays with the new-array execute functions (fftw_execute_dft_r2c,
+// fftw_execute_dft_c2r, fftw_execute_r2r).
+//
+// Looking up a plan that exists never locks, so the audio thread may do it. Making a plan
+// does: FFTW's planner allocates and is not thread safe. Init functions therefore ask for
+// every plan their processing uses, and processing only ever finds them in the cache.
+// Running out of cache entries aborts, as it means a plan is made per call.
+#include <fftw3.h>
+
+#include <stdlib.h>
+
+// Return a cached real to complex plan
+//   size: the length of the real input; the output has length size/2+1
+fftw_plan plan_r2c (size_t size);
+
+// Return a cached complex to real plan (unnormalized, destroys its input)
+//   size: the length of the real output; the input has length size/2+1
+fftw_plan plan_c2r (size_t size);
+
+// Return a cached real to real plan
+//   size: the length of the input and output arrays
+//   kind: the FFTW transform kind (FFTW_REDFT10 for a DCT-II, etc.)
+fftw_plan plan_r2r (size_t size, fftw_r2r_kind kind);
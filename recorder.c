@@ -0,0 +1,217 @@
+#include "recorder.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+typedef struct
+{
+    uint64_t position; // Of the first sample
+    size_t   count;
+    float    samples[RECORDER_BLOCK_FRAMES];
+} audio_slot;
+
+static void ring_init (recorder_ring* q, size_t slot_size, size_t num_slots)
+{
+    q->slot_size = slot_size;
+    q->num_slots = num_slots;
+    q->slots     = calloc(num_slots, slot_size);
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+}
+
+// Return the slot to fill next, or NULL if the ring is full
+static void* ring_claim (recorder_ring* q)
+{
+    size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+    if (head - tail == q->num_slots) return NULL;
+    return q->slots + (head & (q->num_slots-1))*q->slot_size;
+}
+
+// Hand the claimed slot to the consumer
+static void ring_publish (recorder_ring* q)
+{
+    size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+}
+
+// Return the oldest slot, or NULL if the ring is empty
+static void* ring_peek (recorder_ring* q)
+{
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+    if (head == tail) return NULL;
+    return q->slots + (tail & (q->num_slots-1))*q->slot_size;
+}
+
+// Hand the oldest slot back to the producer
+static void ring_release (recorder_ring* q)
+{
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+}
+
+static void flush_audio (recorder* r)
+{
+    if (r->write_loc > 0 && sf_write_float(r->wav, r->write_buffer, r->write_loc) != (sf_count_t)r->write_loc)
+        r->failed = true;
+    r->write_loc = 0;
+}
+
+// Buffer samples for the WAV file, or silence if samples is NULL
+static void write_samples (recorder* r, const float* samples, size_t count)
+{
+    while (count > 0)
+    {
+        size_t n = RECORDER_WRITE_FRAMES - r->write_loc;
+        if (n > count) n = count;
+        if (samples) memcpy(r->write_buffer + r->write_loc, samples, sizeof(float) * n);
+        else         memset(r->write_buffer + r->write_loc, 0, sizeof(float) * n);
+        r->write_loc += n;
+        r->written += n;
+        count -= n;
+        if (samples) samples += n;
+        if (r->write_loc == RECORDER_WRITE_FRAMES) flush_audio(r);
+    }
+}
+
+// Empty both rings into the files
+static void drain (recorder* r)
+{
+    audio_slot* block;
+    while ((block = ring_peek(&r->audio)))
+    {
+        if (block->position > r->written) write_samples(r, NULL, block->position - r->written);
+        write_samples(r, block->samples, block->count);
+        ring_release(&r->audio);
+    }
+    double* frame;
+    while ((frame = ring_peek(&r->features)))
+    {
+        feature_writer_append(&r->feature_file, r->source, frame[0], frame + 1);
+        ring_release(&r->features);
+    }
+}
+
+static void* run_writer (void* arg)
+{
+    recorder* r = arg;
+    // Yield to the audio and GUI threads; on Linux, niceness is per thread
+#ifdef __APPLE__
+    pthread_set_qos_class_self_np(QOS_CLASS_UTILITY, 0);
+#else
+    setpriority(PRIO_PROCESS, 0, 10);
+#endif
+    while (atomic_load(&r->running))
+    {
+        drain(r);
+        usleep(RECORDER_POLL_MS*1000);
+    }
+    drain(r);
+    return NULL;
+}
+
+bool recorder_open (recorder* r, const char* session, const char* source, double sample_rate, size_t hop,
+                    const char** names, size_t num_features)
+{
+    memset(r, 0, sizeof(recorder));
+    if (num_features > RECORDER_MAX_FEATURES) return false;
+    size_t size = strlen(session) + 6;
+    char wav_path[size], feature_path[size];
+    snprintf(wav_path, size, "%s.wav", session);
+    snprintf(feature_path, size, "%s.feat", session);
+    r->sample_rate  = sample_rate;
+    r->num_features = num_features;
+
+    SF_INFO info = {0};
+    info.samplerate = sample_rate;
+    info.channels   = 1;
+    info.format     = SF_FORMAT_WAV | SF_FORMAT_FLOAT;
+    r->wav = sf_open(wav_path, SFM_WRITE, &info);
+    if (r->wav == NULL) return false;
+    if (!feature_writer_open(&r->feature_file, feature_path, sample_rate, hop, names, num_features))
+    {
+        sf_close(r->wav);
+        return false;
+    }
+    r->source = feature_writer_add_source(&r->feature_file, source);
+
+    ring_init(&r->audio, sizeof(audio_slot), RECORDER_AUDIO_SLOTS);
+    ring_init(&r->features, sizeof(double) * (1 + num_features), RECORDER_FEATURE_SLOTS);
+    r->write_buffer = malloc(sizeof(float) * RECORDER_WRITE_FRAMES);
+    atomic_init(&r->dropped, 0);
+    atomic_init(&r->running, true);
+    if (pthread_create(&r->thread, NULL, run_writer, r) != 0)
+    {
+        atomic_store(&r->running, false);
+        recorder_close(r);
+        return false;
+    }
+    return true;
+}
+
+void recorder_push_audio (recorder* r, const float* in, size_t count)
+{
+    for (size_t done = 0; done < count; done += RECORDER_BLOCK_FRAMES)
+    {
+        size_t n = count - done < RECORDER_BLOCK_FRAMES ? count - done : RECORDER_BLOCK_FRAMES;
+        audio_slot* block = ring_claim(&r->audio);
+        if (block)
+        {
+            block->position = r->position;
+            block->count    = n;
+            memcpy(block->samples, in + done, sizeof(float) * n);
+            ring_publish(&r->audio);
+        }
+        else atomic_fetch_add_explicit(&r->dropped, 1, memory_order_relaxed);
+        r->position += n;
+    }
+}
+
+void recorder_push_features (recorder* r, const double* values)
+{
+    double* frame = ring_claim(&r->features);
+    if (frame == NULL)
+    {
+        atomic_fetch_add_explicit(&r->dropped, 1, memory_order_relaxed);
+        return;
+    }
+    frame[0] = r->position/r->sample_rate;
+    memcpy(frame + 1, values, sizeof(double) * r->num_features);
+    ring_publish(&r->features);
+}
+
+void recorder_frame_callback (size_t index, void* context)
+{
+    recorder_block* b = context;
+    recorder_push_audio(b->session, b->block + b->recorded, index+1 - b->recorded);
+    b->recorded = index+1;
+    double values[RECORDER_MAX_FEATURES];
+    b->snapshot(values);
+    recorder_push_features(b->session, values);
+}
+
+void recorder_finish_block (recorder_block* b, size_t count)
+{
+    recorder_push_audio(b->session, b->block + b->recorded, count - b->recorded);
+    b->recorded = count;
+}
+
+size_t recorder_dropped (recorder* r)
+{
+    return atomic_exchange_explicit(&r->dropped, 0, memory_order_relaxed);
+}
+
+bool recorder_close (recorder* r)
+{
+    if (atomic_exchange(&r->running, false)) pthread_join(r->thread, NULL);
+    flush_audio(r);
+    if (sf_close(r->wav) != 0) r->failed = true;
+    if (!feature_writer_close(&r->feature_file)) r->failed = true;
+    free(r->audio.slots);
+    free(r->features.slots);
+    free(r->write_buffer);
+    return !r->failed;
+}
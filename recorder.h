@@ -0,0 +1,107 @@
+// Session recorder
+//
+// Records a session as it happens, so a performance that went wrong can be replayed: the raw
+// input as a float WAV file and a feature snapshot per frame as a feature file (featfile.h).
+// The analysis thread pushes into two single producer, single consumer rings, which only
+// copy into preallocated slots and never block, allocate or do I/O. A writer thread at low
+// priority drains them every RECORDER_POLL_MS in large buffered writes. When the disk can't
+// keep up and a ring is full, the block or frame is dropped and counted; audio lost this way
+// is written as silence, so the recording stays aligned with the feature times.
+#include "featfile.h"
+
+#include <sndfile.h>
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define RECORDER_BLOCK_FRAMES   256   // Samples per audio slot; longer blocks take several
+#define RECORDER_AUDIO_SLOTS    2048  // 3s of 64 frame blocks
+#define RECORDER_FEATURE_SLOTS  1024
+#define RECORDER_MAX_FEATURES   32
+#define RECORDER_WRITE_FRAMES   65536 // Samples per WAV write
+#define RECORDER_POLL_MS        20
+
+// Fixed size slots, written by one thread and read by another
+typedef struct
+{
+    size_t        slot_size;
+    size_t        num_slots; // A power of two
+    char*         slots;
+    atomic_size_t head;      // Slots pushed; only the producer writes it
+    atomic_size_t tail;      // Slots popped; only the consumer writes it
+} recorder_ring;
+
+typedef struct
+{
+    double         sample_rate;
+    size_t         num_features;
+    uint64_t       position;      // Samples pushed
+    recorder_ring  audio;
+    recorder_ring  features;
+    atomic_size_t  dropped;       // Slots dropped since the last recorder_dropped
+    atomic_bool    running;
+    pthread_t      thread;
+
+    // Owned by the writer thread
+    SNDFILE*       wav;
+    feature_writer feature_file;
+    size_t         source;
+    float*         write_buffer;  // RECORDER_WRITE_FRAMES samples
+    size_t         write_loc;
+    uint64_t       written;       // Samples written or buffered, including silence for drops
+    bool           failed;        // A write failed
+} recorder;
+
+// Create the files, <session>.wav and <session>.feat, and start the writer thread; return
+// false if a file can't be created
+//   r:            the recorder to be initialized
+//   session:      the path of the files, without extension
+//   source:       the name of the session's input in the feature file
+//   sample_rate:  the sampling rate (in Hz) of the input
+//   hop:          the nominal number of samples between frames
+//   names:        the names of the features, at most RECORDER_MAX_FEATURES
+//   num_features: the number of features
+bool recorder_open (recorder* r, const char* session, const char* source, double sample_rate, size_t hop,
+                    const char** names, size_t num_features);
+
+// Record a block of input; never blocks
+//   r:     an open recorder
+//   in:    input array of length count
+//   count: the number of samples
+void recorder_push_audio (recorder* r, const float* in, size_t count);
+
+// Record the features of a frame that ended with the last sample pushed; never blocks
+//   r:      an open recorder
+//   values: the features, of length num_features
+void recorder_push_features (recorder* r, const double* values);
+
+// A block of input on its way into a recording, as the context of recorder_frame_callback
+typedef struct
+{
+    recorder*    session;
+    const float* block;
+    size_t       recorded;                     // Samples of the block recorded so far
+    void       (*snapshot) (double* values);   // Writes the num_features features of the latest frame
+} recorder_block;
+
+// Record a block up to the last sample of a frame, then the frame's features; a frame callback
+// for backend_push_buffer, with backend_snapshot as the snapshot
+//   index:   the position in the block of the frame's last sample
+//   context: a recorder_block
+void recorder_frame_callback (size_t index, void* context);
+
+// Record the rest of a block, after its last frame
+//   b:     the block, as recorder_frame_callback left it
+//   count: the length of the block
+void recorder_finish_block (recorder_block* b, size_t count);
+
+// Return the number of audio blocks and feature frames dropped since the last call; safe to
+// call from any thread
+size_t recorder_dropped (recorder* r);
+
+// Write out everything pushed, stop the writer and close the files; return false if any write
+// failed
+bool recorder_close (recorder* r);
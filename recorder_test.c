@@ -0,0 +1,215 @@
+#include "recorder.h"
+#include "wav.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SAMPLE_RATE 44100.0
+#define NUM_FEATURES 3
+
+static const char* names[NUM_FEATURES] = {"a", "b", "c"};
+
+static float ramp (size_t i)
+{
+    return (i % 1000)/1000.0f - 0.5f;
+}
+
+// Read back a recorded WAV file; return its length
+static size_t read_wav (const char* session, float** samples)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s.wav", session);
+    wav_reader r;
+    *samples = NULL;
+    if (!wav_open(&r, path)) return 0;
+    *samples = malloc(sizeof(float) * (r.frames + 1));
+    size_t frames = wav_read(&r, *samples, r.frames);
+    wav_close(&r);
+    return frames;
+}
+
+static void remove_session (const char* session)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s.wav", session);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s.feat", session);
+    unlink(path);
+}
+
+// Test that blocks of every size and their features come back as pushed
+bool round_trip_test (const char* session)
+{
+    recorder r;
+    if (!recorder_open(&r, session, "test", SAMPLE_RATE, 64, names, NUM_FEATURES))
+    {
+        fprintf(stderr, "FAILED: round trip\n    Can't create %s\n", session);
+        return false;
+    }
+    size_t sizes[] = {64, 1, 255, 256, 257, 1000, 4096};
+    float block[4096];
+    size_t position = 0, num_frames = 0;
+    for (size_t k = 0; k < 200; ++k)
+    {
+        size_t count = sizes[k % (sizeof(sizes)/sizeof(sizes[0]))];
+        for (size_t i = 0; i < count; ++i) block[i] = ramp(position + i);
+        recorder_push_audio(&r, block, count);
+        position += count;
+        double values[NUM_FEATURES] = {k, position, -(double)k};
+        recorder_push_features(&r, values);
+        ++num_frames;
+        // Leave the writer time to keep up
+        if (k % 20 == 0) usleep(RECORDER_POLL_MS*1000);
+    }
+    size_t dropped = recorder_dropped(&r);
+    bool pass = recorder_close(&r) && dropped == 0;
+
+    float* samples;
+    size_t frames = read_wav(session, &samples);
+    pass = pass && frames == position;
+    for (size_t i = 0; i < frames && pass; ++i) pass = samples[i] == ramp(i);
+    free(samples);
+
+    char path[256];
+    snprintf(path, sizeof(path), "%s.feat", session);
+    feature_reader f;
+    if (pass && feature_reader_open(&f, path))
+    {
+        pass = f.header->num_frames == num_frames && f.header->num_columns == NUM_FEATURES + 2 &&
+               feature_reader_column(&f, "b") == 3;
+        double end = 0;
+        for (size_t k = 0; k < num_frames && pass; ++k)
+        {
+            end = feature_reader_value(&f, 3, k);
+            pass = feature_reader_value(&f, 2, k) == k && feature_reader_value(&f, 4, k) == -(double)k &&
+                   feature_reader_value(&f, FEATURE_TIME, k) == end/SAMPLE_RATE;
+        }
+        feature_reader_close(&f);
+    }
+    else pass = false;
+    if (!pass) fprintf(stderr, "FAILED: round trip\n    Frames: %zu of %zu, dropped: %zu\n", frames, position, dropped);
+    remove_session(session);
+    return pass;
+}
+
+// Test that pushing faster than the writer drains drops whole blocks, counts them, and leaves
+// silence in their place
+bool overflow_test (const char* session)
+{
+    recorder r;
+    if (!recorder_open(&r, session, "test", SAMPLE_RATE, 64, names, NUM_FEATURES))
+    {
+        fprintf(stderr, "FAILED: overflow\n    Can't create %s\n", session);
+        return false;
+    }
+    float block[RECORDER_BLOCK_FRAMES];
+    size_t position = 0, num_blocks = 4*RECORDER_AUDIO_SLOTS;
+    for (size_t k = 0; k < num_blocks; ++k)
+    {
+        for (size_t i = 0; i < RECORDER_BLOCK_FRAMES; ++i) block[i] = ramp(position + i) + 1;
+        recorder_push_audio(&r, block, RECORDER_BLOCK_FRAMES);
+        position += RECORDER_BLOCK_FRAMES;
+    }
+    size_t dropped = recorder_dropped(&r);
+    // A last block once the writer has caught up fixes the length
+    usleep(10*RECORDER_POLL_MS*1000);
+    for (size_t i = 0; i < RECORDER_BLOCK_FRAMES; ++i) block[i] = ramp(position + i) + 1;
+    recorder_push_audio(&r, block, RECORDER_BLOCK_FRAMES);
+    position += RECORDER_BLOCK_FRAMES;
+    bool pass = recorder_close(&r) && dropped > 0 && recorder_dropped(&r) == 0;
+
+    float* samples;
+    size_t frames = read_wav(session, &samples);
+    size_t silent = 0;
+    pass = pass && frames == position;
+    for (size_t k = 0; k < frames/RECORDER_BLOCK_FRAMES && pass; ++k)
+    {
+        const float* b = samples + k*RECORDER_BLOCK_FRAMES;
+        bool is_silent = b[0] == 0;
+        silent += is_silent;
+        for (size_t i = 0; i < RECORDER_BLOCK_FRAMES && pass; ++i)
+            pass = b[i] == (is_silent ? 0 : ramp(k*RECORDER_BLOCK_FRAMES + i) + 1);
+    }
+    pass = pass && silent == dropped;
+    free(samples);
+    if (!pass) fprintf(stderr, "FAILED: overflow\n    Frames: %zu of %zu, dropped: %zu, silent: %zu\n", frames, position, dropped, silent);
+    remove_session(session);
+    return pass;
+}
+
+static size_t snapshots;
+
+static void count_snapshot (double* values)
+{
+    ++snapshots;
+    for (size_t i = 0; i < NUM_FEATURES; ++i) values[i] = snapshots;
+}
+
+// Test that a block recorded through its frame callbacks comes back whole, with every frame's
+// features at the time of its last sample
+bool frame_callback_test (const char* session)
+{
+    recorder r;
+    if (!recorder_open(&r, session, "test", SAMPLE_RATE, 64, names, NUM_FEATURES))
+    {
+        fprintf(stderr, "FAILED: frame callback\n    Can't create %s\n", session);
+        return false;
+    }
+    snapshots = 0;
+    float block[1000];
+    size_t ends[] = {0, 99, 500, 999}; // Last samples of the frames in each block
+    size_t num_blocks = 20, num_ends = sizeof(ends)/sizeof(ends[0]);
+    for (size_t k = 0; k < num_blocks; ++k)
+    {
+        for (size_t i = 0; i < 1000; ++i) block[i] = ramp(k*1000 + i);
+        recorder_block b = {&r, block, 0, count_snapshot};
+        // The last block ends between frames
+        for (size_t i = 0; i < num_ends - (k == num_blocks-1); ++i) recorder_frame_callback(ends[i], &b);
+        recorder_finish_block(&b, 1000);
+    }
+    bool pass = recorder_close(&r) && recorder_dropped(&r) == 0;
+
+    float* samples;
+    size_t frames = read_wav(session, &samples);
+    pass = pass && frames == num_blocks*1000;
+    for (size_t i = 0; i < frames && pass; ++i) pass = samples[i] == ramp(i);
+    free(samples);
+
+    char path[256];
+    snprintf(path, sizeof(path), "%s.feat", session);
+    feature_reader f;
+    size_t num_frames = 0;
+    if (pass && feature_reader_open(&f, path))
+    {
+        num_frames = f.header->num_frames;
+        pass = num_frames == snapshots && num_frames == num_blocks*num_ends - 1;
+        for (size_t n = 0; n < num_frames && pass; ++n)
+        {
+            double end = n/num_ends*1000 + ends[n % num_ends] + 1;
+            pass = feature_reader_value(&f, FEATURE_TIME, n) == end/SAMPLE_RATE && feature_reader_value(&f, 2, n) == n+1;
+        }
+        feature_reader_close(&f);
+    }
+    else pass = false;
+    if (!pass) fprintf(stderr, "FAILED: frame callback\n    Samples: %zu, frames: %zu\n", frames, num_frames);
+    remove_session(session);
+    return pass;
+}
+
+int main (void)
+{
+    char session[] = "/tmp/recorder_test_XXXXXX";
+    int fd = mkstemp(session);
+    if (fd < 0) return 1;
+    close(fd);
+    unlink(session);
+
+    if (!round_trip_test(session)) return 1;
+    if (!overflow_test(session)) return 1;
+    if (!frame_callback_test(session)) return 1;
+    return 0;
+}
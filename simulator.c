@@ -0,0 +1,274 @@
+// Live pipeline simulator
+//
+// Runs the live path of main.c on sound files, without audio, MIDI or display devices. Every
+// file is played by a paced file source (source.h) into backend_push_buffer, as the PortAudio
+// callback does, while the main thread runs the control loop (control_update) at the redraw
+// rate and logs the MIDI it sends. The sources inject the faults of a real device: buffer
+// sizes can jitter, and buffers can be dropped as input overflows (xruns) drop them.
+//
+//   simulator [-b frames] [-j frames] [-x probability] [-p poll_ms] [-s seed] [-v] [-r session] path...
+//
+// Paths may be files or directories, which are searched recursively for .wav files; the
+// files are played back to back. MIDI messages are written to stdout, one per line: the time
+// on the audio clock (in seconds) and the three bytes in hex. Callback times and deadline
+// misses are summarized on stderr. With -v the clock is virtual: nothing sleeps, the
+// control loop runs between callbacks at the times it would have, and the log is the same on
+// every run, for regression tests. With -r the session is recorded as by main.c; a virtual
+// clock outruns the recorder's writer, which then drops blocks.
+#include "backend.h"
+#include "control.h"
+#include "corpus.h"
+#include "recorder.h"
+#include "source.h"
+#include "timing.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEFAULT_POLL_MS (1000/60.0) // The main loop waits for a 60Hz display between polls
+
+typedef struct
+{
+    manifest files;
+    size_t   buffer_size;
+    size_t   jitter;       // Buffer sizes vary uniformly by up to this many frames
+    double   xrun_rate;    // Probability that a buffer is dropped
+    double   poll_period;  // Seconds between control loop iterations
+    unsigned seed;
+    bool     virtual_clock;
+    recorder* session;     // NULL if not recording
+
+    double   start;        // Clock time (in ns) of audio time 0
+    double   poll_time;    // Audio time (in seconds) of the control loop iteration in progress
+    size_t   next_poll;    // Control loop iterations run so far, on a virtual clock
+    volatile bool done;    // Set by the audio thread after the last file
+
+    double*  times;        // Callback times (in ns)
+    size_t   num_callbacks;
+    size_t   misses;
+    size_t   xruns;
+} simulation;
+
+static void log_midi (int message, void* context)
+{
+    simulation* s = context;
+    printf("%.6f %02X %02X %02X\n", s->poll_time, message & 0xFF, (message >> 8) & 0xFF, (message >> 16) & 0xFF);
+}
+
+// Run the control loop once, as main.c does between redraws
+static void poll_control (simulation* s, control* c, double time)
+{
+    s->poll_time = time;
+    control_update(c);
+}
+
+// A file playing through the callback path
+typedef struct
+{
+    simulation* sim;
+    control*    control; // Run between callbacks on a virtual clock
+    source*     file;
+    size_t      offset;  // Frames of the files played before this one
+} playback;
+
+static void play_buffer (const float* buffer, size_t count, double time, void* context)
+{
+    playback* p = context;
+    simulation* s = p->sim;
+    double available = (p->offset + p->file->position + count)/SAMPLE_RATE;
+    if (s->virtual_clock)
+    {
+        // Iterations before this buffer is available see the state after the last one
+        for (; s->next_poll*s->poll_period < available; ++s->next_poll) poll_control(s, p->control, s->next_poll*s->poll_period);
+    }
+
+    double begin = timing_now_ns();
+    recorder_block recording = {s->session, buffer, 0, backend_snapshot};
+    backend_push_buffer(buffer, count, s->session ? recorder_frame_callback : NULL, &recording);
+    if (s->session) recorder_finish_block(&recording, count);
+    double end = timing_now_ns();
+    // The callback has to return before the next buffer is full
+    double released = p->file->start_ns + (time + count/SAMPLE_RATE)*1e9;
+    double deadline = (s->virtual_clock ? begin : released) + count/SAMPLE_RATE*1e9;
+    s->times = realloc(s->times, sizeof(double) * (s->num_callbacks+1));
+    s->times[s->num_callbacks++] = end - begin;
+    if (end > deadline) ++s->misses;
+}
+
+// Play every file through the callback path; in virtual time, also run the control loop
+static void play (simulation* s, control* c)
+{
+    size_t offset = 0;
+    for (size_t f = 0; f < s->files.count; ++f)
+    {
+        source file;
+        if (!source_open_file(&file, s->files.paths[f], s->buffer_size, !s->virtual_clock))
+        {
+            fprintf(stderr, "Failed to open file: %s\n", s->files.paths[f]);
+            continue;
+        }
+        if (file.sample_rate != SAMPLE_RATE)
+        {
+            fprintf(stderr, "Skipping %s: sample rate is %.0fHz, not %.0fHz\n", s->files.paths[f], file.sample_rate, SAMPLE_RATE);
+            source_close(&file);
+            continue;
+        }
+        fprintf(stderr, "Playing %s\n", s->files.paths[f]);
+
+        // The seed runs on from file to file, so a run is reproduced by its first seed
+        source_set_faults(&file, s->jitter, s->xrun_rate, s->seed);
+        playback p = {s, c, &file, offset};
+        if (!source_start(&file, play_buffer, &p))
+        {
+            fprintf(stderr, "Failed to start playing %s\n", s->files.paths[f]);
+            source_close(&file);
+            continue;
+        }
+        source_wait(&file);
+        s->seed   = file.seed;
+        s->xruns += file.xruns;
+        offset   += file.position;
+        source_close(&file);
+    }
+    if (s->virtual_clock)
+    {
+        // Dropped buffers at the end are never called back, but still take their time
+        for (; s->next_poll*s->poll_period < offset/SAMPLE_RATE; ++s->next_poll) poll_control(s, c, s->next_poll*s->poll_period);
+        poll_control(s, c, s->next_poll*s->poll_period);
+    }
+}
+
+static void* run_audio (void* arg)
+{
+    simulation* s = arg;
+    play(s, NULL);
+    s->done = true;
+    return NULL;
+}
+
+static int compare_doubles (const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void usage ()
+{
+    fprintf(stderr, "Usage: simulator [-b frames] [-j frames] [-x probability] [-p poll_ms] [-s seed] [-v] [-r session] path...\n");
+    fprintf(stderr, "  -b  frames per buffer (default %d)\n", FRAMES_PER_BUFFER);
+    fprintf(stderr, "  -j  buffer sizes vary by up to this many frames (default 0)\n");
+    fprintf(stderr, "  -x  probability that a buffer is dropped (default 0)\n");
+    fprintf(stderr, "  -p  control loop period in milliseconds (default %.1f)\n", DEFAULT_POLL_MS);
+    fprintf(stderr, "  -s  random seed for jitter and xruns (default 1)\n");
+    fprintf(stderr, "  -v  virtual clock: run as fast as possible, with a reproducible log\n");
+    fprintf(stderr, "  -r  record the input and features to session.wav and session.feat\n");
+}
+
+int main (int argc, char** argv)
+{
+    simulation s;
+    memset(&s, 0, sizeof(s));
+    const char* session_name = NULL;
+    s.buffer_size = FRAMES_PER_BUFFER;
+    s.poll_period = DEFAULT_POLL_MS/1000;
+    s.seed = 1;
+    int option;
+    while ((option = getopt(argc, argv, "b:j:x:p:s:vr:")) != -1)
+    {
+        switch (option) {
+            case 'b':
+                s.buffer_size = atoi(optarg); break;
+            case 'j':
+                s.jitter = atoi(optarg); break;
+            case 'x':
+                s.xrun_rate = atof(optarg); break;
+            case 'p':
+                s.poll_period = atof(optarg)/1000; break;
+            case 's':
+                s.seed = atoi(optarg); break;
+            case 'v':
+                s.virtual_clock = true; break;
+            case 'r':
+                session_name = optarg; break;
+            default:
+                usage();
+                return 1;
+        }
+    }
+    if (optind == argc || s.buffer_size == 0 || s.jitter >= s.buffer_size || s.poll_period <= 0)
+    {
+        usage();
+        return 1;
+    }
+
+    manifest_init(&s.files);
+    for (int i = optind; i < argc; ++i)
+    {
+        if (!manifest_add(&s.files, argv[i], ".wav"))
+        {
+            fprintf(stderr, "Failed to open %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    recorder session;
+    if (session_name)
+    {
+        char names[BACKEND_SNAPSHOT_SIZE][BACKEND_NAME_SIZE];
+        const char* name_list[BACKEND_SNAPSHOT_SIZE];
+        backend_snapshot_names(names, name_list);
+        if (!recorder_open(&session, session_name, "simulator", SAMPLE_RATE, FFT_HOP, name_list, BACKEND_SNAPSHOT_SIZE))
+        {
+            fprintf(stderr, "Failed to create the recording %s\n", session_name);
+            return 1;
+        }
+        s.session = &session;
+    }
+
+    backend_init();
+    control note_control;
+    control_init(&note_control, log_midi, &s);
+
+    if (s.virtual_clock) play(&s, &note_control);
+    else
+    {
+        // The control loop runs on the main thread, as in main.c, and the callbacks on their own
+        pthread_t audio;
+        s.start = timing_now_ns();
+        if (pthread_create(&audio, NULL, run_audio, &s) != 0)
+        {
+            fprintf(stderr, "Failed to start the audio thread\n");
+            return 1;
+        }
+        for (size_t k = 0; !s.done; ++k)
+        {
+            timing_sleep_until(s.start + k*s.poll_period*1e9);
+            poll_control(&s, &note_control, (timing_now_ns() - s.start)/1e9);
+        }
+        pthread_join(audio, NULL);
+    }
+
+    if (s.num_callbacks)
+    {
+        qsort(s.times, s.num_callbacks, sizeof(double), compare_doubles);
+        fprintf(stderr, "%zu callbacks, %zu deadline misses, %zu xruns, %zu clipped samples\n", s.num_callbacks, s.misses,
+                s.xruns, backend_clipped());
+        fprintf(stderr, "Callback time (us): p50 %.1f, p99 %.1f, max %.1f\n", s.times[s.num_callbacks/2]/1e3,
+                s.times[(size_t)(0.99*(s.num_callbacks-1))]/1e3, s.times[s.num_callbacks-1]/1e3);
+    }
+
+    if (s.session)
+    {
+        fprintf(stderr, "Recording: %zu blocks dropped\n", recorder_dropped(s.session));
+        if (!recorder_close(s.session)) fprintf(stderr, "Failed to write the recording %s\n", session_name);
+    }
+
+    free(s.times);
+    manifest_cleanup(&s.files);
+    backend_cleanup();
+    return 0;
+}
@@ -0,0 +1,175 @@
+#include "source.h"
+#include "timing.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// Deliver blocks until the source ends or is stopped
+static void* run_source (void* arg)
+{
+    source* s = arg;
+    s->start_ns = timing_now_ns();
+    // Both faults are drawn for every block, so a seed gives the same sizes with or without xruns
+    bool faulty = s->jitter || s->xrun_rate > 0;
+    for (;;)
+    {
+        size_t size = s->frames_per_buffer;
+        if (faulty) size = size - s->jitter + rand_r(&s->seed) % (2*s->jitter + 1);
+        size_t count;
+        if (!s->running || (count = s->read(s, s->block, size)) == 0) break;
+        if (s->paced) timing_sleep_until(s->start_ns + (s->position + count)/s->sample_rate*1e9);
+        // An overflow loses the input before the callback sees it
+        if (faulty && rand_r(&s->seed) < s->xrun_rate*RAND_MAX) ++s->xruns;
+        else s->callback(s->block, count, s->position/s->sample_rate, s->context);
+        s->position += count;
+    }
+    return NULL;
+}
+
+static bool start_thread (source* s)
+{
+    s->running = true;
+    if (pthread_create(&s->thread, NULL, run_source, s) != 0)
+    {
+        s->running = false;
+        return false;
+    }
+    s->joinable = true;
+    return true;
+}
+
+static void stop_thread (source* s)
+{
+    s->running = false;
+    source_wait(s);
+}
+
+static void init_source (source* s, double sample_rate, size_t frames_per_buffer, bool paced)
+{
+    memset(s, 0, sizeof(source));
+    s->sample_rate       = sample_rate;
+    s->frames_per_buffer = frames_per_buffer;
+    s->paced             = paced;
+    s->block             = malloc(sizeof(float) * frames_per_buffer);
+    s->fd                = -1;
+    s->start             = start_thread;
+    s->stop              = stop_thread;
+}
+
+static size_t read_file (source* s, float* out, size_t count)
+{
+    return wav_read(&s->file, out, count);
+}
+
+static void close_file (source* s)
+{
+    wav_close(&s->file);
+}
+
+bool source_open_file (source* s, const char* path, size_t frames_per_buffer, bool paced)
+{
+    init_source(s, 0, frames_per_buffer, paced);
+    if (!wav_open(&s->file, path))
+    {
+        free(s->block);
+        return false;
+    }
+    s->sample_rate = s->file.sample_rate;
+    s->read        = read_file;
+    s->close       = close_file;
+    return true;
+}
+
+static size_t read_generator (source* s, float* out, size_t count)
+{
+    if (s->length && count > s->length - s->position) count = s->length - s->position;
+    generator_read(&s->synth, out, NULL, count);
+    return count;
+}
+
+void source_open_generator (source* s, const generator_config* config, uint64_t seed, double sample_rate,
+                            size_t frames_per_buffer, double seconds, bool paced)
+{
+    init_source(s, sample_rate, frames_per_buffer, paced);
+    generator_init(&s->synth, config, sample_rate, seed);
+    s->length = seconds*sample_rate;
+    s->read   = read_generator;
+}
+
+// Read whole samples, waiting for a slow writer; return the number read, fewer at the end
+static size_t read_pipe (source* s, float* out, size_t count)
+{
+    size_t sample_size = input_sample_size(s->format);
+    // Integer samples are read into the end of the block, then widened from the start
+    char* buffer = (char*)(out + count) - count*sample_size;
+    size_t bytes = 0;
+    while (bytes < count*sample_size)
+    {
+        ssize_t n = read(s->fd, buffer + bytes, count*sample_size - bytes);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        bytes += n;
+    }
+    count = bytes/sample_size;
+    if (s->format != INPUT_FLOAT32) input_convert(s->format, buffer, out, count);
+    return count;
+}
+
+static void close_pipe (source* s)
+{
+    if (s->fd != STDIN_FILENO) close(s->fd);
+}
+
+bool source_open_pipe (source* s, const char* path, int format, double sample_rate, size_t frames_per_buffer, bool paced)
+{
+    init_source(s, sample_rate, frames_per_buffer, paced);
+    s->fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY);
+    if (s->fd < 0)
+    {
+        free(s->block);
+        return false;
+    }
+    s->format = format;
+    s->read   = read_pipe;
+    s->close  = close_pipe;
+    return true;
+}
+
+bool source_start (source* s, source_callback callback, void* context)
+{
+    s->callback = callback;
+    s->context  = context;
+    s->position = 0;
+    s->xruns    = 0;
+    return s->start(s);
+}
+
+void source_set_faults (source* s, size_t jitter, double xrun_rate, unsigned seed)
+{
+    s->block     = realloc(s->block, sizeof(float) * (s->frames_per_buffer + jitter));
+    s->jitter    = jitter;
+    s->xrun_rate = xrun_rate;
+    s->seed      = seed;
+}
+
+void source_wait (source* s)
+{
+    if (!s->joinable) return;
+    pthread_join(s->thread, NULL);
+    s->joinable = false;
+}
+
+void source_stop (source* s)
+{
+    s->stop(s);
+}
+
+void source_close (source* s)
+{
+    source_stop(s);
+    if (s->close) s->close(s);
+    free(s->block);
+}
@@ -0,0 +1,116 @@
+// Audio sources
+//
+// Everything the backend can listen to behind one interface: an input device, a sound file,
+// the signal generator, or raw PCM from stdin or a FIFO. A source is opened, then started
+// with a block callback, which gets every buffer of mono samples along with the time (in
+// seconds, on the source's clock) of its first sample, until the source ends or is stopped.
+//
+// Devices call back from PortAudio's audio thread; they are opened by source_open_device in
+// source_device.c, so only programs that use them link PortAudio. The other sources call back
+// from a thread of their own, either as fast as they can or paced by the audio clock, every
+// block released when the clock reaches its last sample, as a device would. Blocks are read
+// straight into the buffer handed to the callback. Threaded sources can also inject the faults
+// of a real device (source_set_faults): block sizes that vary, and blocks lost to input
+// overflows (xruns), which are never called back but still take their time on the clock.
+#include "generator.h"
+#include "input.h"
+#include "wav.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef void (*source_callback) (const float* block, size_t count, double time, void* context);
+
+typedef struct source source;
+struct source
+{
+    double          sample_rate;
+    size_t          frames_per_buffer;
+    bool            paced;       // Release blocks on the audio clock instead of as fast as possible
+    source_callback callback;
+    void*           context;
+    size_t          position;    // Frames delivered so far
+    volatile bool   running;
+
+    // Set by the open function
+    bool          (*start) (source* s);
+    void          (*stop) (source* s);
+    void          (*close) (source* s);
+    size_t        (*read) (source* s, float* out, size_t count); // Threaded sources: 0 at the end
+
+    pthread_t       thread;
+    bool            joinable;
+    float*          block;       // frames_per_buffer + jitter samples
+    wav_reader      file;
+    generator       synth;
+    size_t          length;      // Frames the generator plays, 0 for no end
+    int             fd;          // Raw PCM input
+    int             format;
+    void*           stream;      // The PortAudio stream of a device
+
+    // Injected faults, set by source_set_faults
+    size_t          jitter;      // Block sizes vary uniformly by up to this many frames
+    double          xrun_rate;   // Probability that a block is lost
+    unsigned        seed;        // Advanced with every block
+    size_t          xruns;       // Blocks lost so far
+    double          start_ns;    // Clock time (in ns, see timing.h) of the first sample
+};
+
+// Open the default input device; return false if it can't be opened
+//   s:                 the source to be initialized
+//   sample_rate:       the sampling rate (in Hz) to open the device at
+//   frames_per_buffer: the size of every block
+bool source_open_device (source* s, double sample_rate, size_t frames_per_buffer);
+
+// Open a sound file, mixed down to mono; return false if it can't be opened
+//   s:                 the source to be initialized
+//   path:              the sound file, played at its own sampling rate
+//   frames_per_buffer: the size of every block but the last
+//   paced:             release blocks on the audio clock
+bool source_open_file (source* s, const char* path, size_t frames_per_buffer, bool paced);
+
+// Open the signal generator
+//   s:                 the source to be initialized
+//   config:            the generator's configuration
+//   seed:              the generator's seed
+//   sample_rate:       the sampling rate (in Hz) to generate at
+//   frames_per_buffer: the size of every block but the last
+//   seconds:           the length of the signal, 0 for no end
+//   paced:             release blocks on the audio clock
+void source_open_generator (source* s, const generator_config* config, uint64_t seed, double sample_rate,
+                            size_t frames_per_buffer, double seconds, bool paced);
+
+// Open raw mono PCM from a pipe or a FIFO; return false if it can't be opened
+//   s:                 the source to be initialized
+//   path:              a FIFO or any other file, "-" for stdin
+//   format:            INPUT_FLOAT32, INPUT_INT16 or INPUT_INT24
+//   sample_rate:       the sampling rate (in Hz) of the samples
+//   frames_per_buffer: the size of every block but the last
+//   paced:             release blocks on the audio clock, for input faster than real time
+bool source_open_pipe (source* s, const char* path, int format, double sample_rate, size_t frames_per_buffer, bool paced);
+
+// Make a threaded source vary its block sizes and lose blocks, reproducibly for a seed; call
+// before source_start
+//   s:         an open file, generator or pipe source
+//   jitter:    block sizes vary uniformly by up to this many frames, less than frames_per_buffer
+//   xrun_rate: probability that a block is lost
+//   seed:      seed for both, carried from run to run in s->seed
+void source_set_faults (source* s, size_t jitter, double xrun_rate, unsigned seed);
+
+// Start calling back with blocks; return false if the source failed to start
+//   s:        an open source
+//   callback: called with every block
+//   context:  passed to callback
+bool source_start (source* s, source_callback callback, void* context);
+
+// Wait for a source that ends (a file, a pipe or a generator with a length) to deliver its
+// last block; return immediately for a device
+void source_wait (source* s);
+
+// Stop calling back; once this returns, the callback is not running
+void source_stop (source* s);
+
+// Stop the source if it is running, and release it
+void source_close (source* s);
@@ -0,0 +1,78 @@
+#include "source.h"
+
+#include <portaudio.h>
+
+#include <stdio.h>
+#include <string.h>
+
+static bool check_error (PaError error)
+{
+    if (error == paNoError) return true;
+    fprintf(stderr, "An error occured while using the portaudio stream\n");
+    fprintf(stderr, "Error number: %d\n", error);
+    fprintf(stderr, "Error message: %s\n", Pa_GetErrorText(error));
+    return false;
+}
+
+static int on_audio_sync (const void* input, void* output, unsigned long frames,
+                          const PaStreamCallbackTimeInfo* time_info, PaStreamCallbackFlags status_flags,
+                          void* user_data)
+{
+    source* s = user_data;
+    s->callback(input, frames, time_info->inputBufferAdcTime, s->context);
+    s->position += frames;
+    return paContinue;
+}
+
+static bool start_device (source* s)
+{
+    s->running = check_error(Pa_StartStream(s->stream));
+    return s->running;
+}
+
+static void stop_device (source* s)
+{
+    if (s->running) check_error(Pa_StopStream(s->stream));
+    s->running = false;
+}
+
+static void close_device (source* s)
+{
+    check_error(Pa_CloseStream(s->stream));
+    Pa_Terminate();
+}
+
+bool source_open_device (source* s, double sample_rate, size_t frames_per_buffer)
+{
+    memset(s, 0, sizeof(source));
+    s->sample_rate       = sample_rate;
+    s->frames_per_buffer = frames_per_buffer;
+    s->paced             = true;
+    s->fd                = -1;
+    s->start             = start_device;
+    s->stop              = stop_device;
+    s->close             = close_device;
+    if (!check_error(Pa_Initialize())) return false;
+
+    PaStreamParameters in;
+    in.device = Pa_GetDefaultInputDevice();
+    if (in.device == paNoDevice)
+    {
+        fprintf(stderr, "Error: No default input device.\n");
+        Pa_Terminate();
+        return false;
+    }
+    in.channelCount = 1;
+    in.sampleFormat = paFloat32;
+    in.suggestedLatency = Pa_GetDeviceInfo(in.device)->defaultLowInputLatency;
+    in.hostApiSpecificStreamInfo = NULL;
+
+    PaStream* stream;
+    if (!check_error(Pa_OpenStream(&stream, &in, NULL, sample_rate, frames_per_buffer, paClipOff, on_audio_sync, s)))
+    {
+        Pa_Terminate();
+        return false;
+    }
+    s->stream = stream;
+    return true;
+}
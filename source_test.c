@@ -0,0 +1,289 @@
+#include "source.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SAMPLE_RATE 44100.0
+#define TEST_FRAMES 10000
+
+// Everything a source called back with
+typedef struct
+{
+    float*  samples;
+    size_t  count;
+    size_t  blocks;
+    size_t  short_blocks; // Blocks smaller than frames_per_buffer
+    size_t  frames_per_buffer;
+    bool    times_match;  // Every block's time is the time of its first sample
+    double  sample_rate;
+    double  start;        // Clock time (in s) the source was started
+    bool    early;        // A paced block arrived before the clock reached its last sample
+} recording;
+
+static double now ()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec/1e9;
+}
+
+static void record (const float* block, size_t count, double time, void* context)
+{
+    recording* r = context;
+    if (fabs(time - r->count/r->sample_rate) > 1e-9) r->times_match = false;
+    if (now() - r->start < (r->count + count)/r->sample_rate) r->early = true;
+    r->samples = realloc(r->samples, sizeof(float) * (r->count + count));
+    memcpy(r->samples + r->count, block, sizeof(float) * count);
+    r->count += count;
+    ++r->blocks;
+    if (count < r->frames_per_buffer) ++r->short_blocks;
+}
+
+// Run a source to its end
+static recording run (source* s)
+{
+    recording r = {NULL, 0, 0, 0, s->frames_per_buffer, true, s->sample_rate, now(), false};
+    source_start(s, record, &r);
+    source_wait(s);
+    source_close(s);
+    return r;
+}
+
+// Test that the generator source plays the generator's signal, in blocks, for its length
+bool generator_test ()
+{
+    generator_config config;
+    generator_default(&config);
+    source s;
+    source_open_generator(&s, &config, 7, SAMPLE_RATE, 1000, 2.5, false);
+    recording r = run(&s);
+
+    generator g;
+    generator_init(&g, &config, SAMPLE_RATE, 7);
+    float* expected = malloc(sizeof(float) * r.count);
+    generator_read(&g, expected, NULL, r.count);
+    bool pass = r.count == 2.5*SAMPLE_RATE && r.blocks == 111 && r.short_blocks == 1 && r.times_match &&
+                memcmp(r.samples, expected, sizeof(float) * r.count) == 0;
+    if (!pass) fprintf(stderr, "FAILED: generator\n    Frames: %zu, blocks: %zu, short: %zu\n", r.count, r.blocks, r.short_blocks);
+    free(expected);
+    free(r.samples);
+    return pass;
+}
+
+// Test that raw PCM comes through whole, in every format
+bool pipe_test (const char* path, int format)
+{
+    FILE* f = fopen(path, "wb");
+    for (size_t i = 0; i < TEST_FRAMES; ++i)
+    {
+        int16_t value = i % 60000 - 30000;
+        if (format == INPUT_INT16) fwrite(&value, sizeof(value), 1, f);
+        else if (format == INPUT_INT24)
+        {
+            int32_t wide = value*256;
+            fwrite((char*)&wide + (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ ? 0 : 1), 3, 1, f);
+        }
+        else
+        {
+            float sample = value/32768.0f;
+            fwrite(&sample, sizeof(sample), 1, f);
+        }
+    }
+    // A trailing partial sample is dropped
+    fputc(0, f);
+    fclose(f);
+
+    source s;
+    bool pass = source_open_pipe(&s, path, format, SAMPLE_RATE, 512, false);
+    recording r = {0};
+    if (pass)
+    {
+        r = run(&s);
+        pass = r.count == TEST_FRAMES && r.blocks == (TEST_FRAMES + 511)/512 && r.times_match;
+        for (size_t i = 0; i < r.count && pass; ++i) pass = r.samples[i] == (int16_t)(i % 60000 - 30000)/32768.0f;
+    }
+    if (!pass) fprintf(stderr, "FAILED: pipe\n    Format: %d, frames: %zu, blocks: %zu\n", format, r.count, r.blocks);
+    free(r.samples);
+    unlink(path);
+    return pass;
+}
+
+static void* write_fifo (void* arg)
+{
+    FILE* f = fopen(arg, "wb");
+    float samples[1000];
+    for (size_t i = 0; i < 1000; ++i) samples[i] = i/1000.0f;
+    // Writes that don't line up with blocks or even samples
+    for (size_t done = 0; done < sizeof(samples); done += 333)
+    {
+        size_t size = done + 333 < sizeof(samples) ? 333 : sizeof(samples) - done;
+        fwrite((char*)samples + done, 1, size, f);
+        fflush(f);
+        usleep(1000);
+    }
+    fclose(f);
+    return NULL;
+}
+
+// Test that a FIFO written in small pieces is read in whole blocks
+bool fifo_test (const char* path)
+{
+    if (mkfifo(path, 0600) != 0) return false;
+    pthread_t writer;
+    pthread_create(&writer, NULL, write_fifo, (void*)path);
+    source s;
+    bool pass = source_open_pipe(&s, path, INPUT_FLOAT32, SAMPLE_RATE, 256, false);
+    recording r = {0};
+    if (pass)
+    {
+        r = run(&s);
+        pass = r.count == 1000 && r.blocks == 4 && r.short_blocks == 1;
+        for (size_t i = 0; i < r.count && pass; ++i) pass = r.samples[i] == i/1000.0f;
+    }
+    pthread_join(writer, NULL);
+    if (!pass) fprintf(stderr, "FAILED: fifo\n    Frames: %zu, blocks: %zu\n", r.count, r.blocks);
+    free(r.samples);
+    unlink(path);
+    return pass;
+}
+
+// Test that a sound file source plays what the reader reads
+bool file_test (const char* path)
+{
+    source s;
+    bool pass = source_open_file(&s, path, 4096, false);
+    recording r = {0};
+    if (pass)
+    {
+        r = run(&s);
+        wav_reader reader;
+        wav_open(&reader, path);
+        float* expected = malloc(sizeof(float) * reader.frames);
+        size_t frames = wav_read(&reader, expected, reader.frames);
+        pass = r.count == frames && frames > 0 && r.times_match && memcmp(r.samples, expected, sizeof(float) * frames) == 0;
+        free(expected);
+        wav_close(&reader);
+    }
+    if (!pass) fprintf(stderr, "FAILED: file\n    %s, frames: %zu\n", path, r.count);
+    free(r.samples);
+    return pass;
+}
+
+// Test that a paced source never delivers a block before the clock reaches its end
+bool paced_test ()
+{
+    generator_config config;
+    generator_default(&config);
+    source s;
+    source_open_generator(&s, &config, 1, SAMPLE_RATE, 64, 0.2, true);
+    recording r = run(&s);
+    double elapsed = now() - r.start;
+    bool pass = !r.early && r.count == 0.2*SAMPLE_RATE && elapsed >= 0.2;
+    if (!pass) fprintf(stderr, "FAILED: paced\n    Early: %d, elapsed: %f\n", r.early, elapsed);
+    free(r.samples);
+    return pass;
+}
+
+// Test that an endless source stops calling back once stopped
+bool stop_test ()
+{
+    generator_config config;
+    generator_default(&config);
+    source s;
+    source_open_generator(&s, &config, 1, SAMPLE_RATE, 64, 0, true);
+    recording r = {NULL, 0, 0, 0, 64, true, SAMPLE_RATE, now(), false};
+    source_start(&s, record, &r);
+    usleep(50000);
+    source_stop(&s);
+    size_t blocks = r.blocks;
+    usleep(20000);
+    bool pass = blocks > 0 && r.blocks == blocks;
+    source_close(&s);
+    if (!pass) fprintf(stderr, "FAILED: stop\n    Blocks: %zu, then %zu\n", blocks, r.blocks);
+    free(r.samples);
+    return pass;
+}
+
+// Blocks a faulty source called back with
+typedef struct
+{
+    size_t length;    // Frames the source plays
+    size_t frames;    // Frames called back
+    size_t end;       // Frame after the last block
+    size_t blocks;
+    size_t gaps;      // Blocks that don't start where the last one ended
+    size_t min_size;  // Of the blocks before the end of the signal
+    size_t max_size;
+} fault_log;
+
+static void log_block (const float* block, size_t count, double time, void* context)
+{
+    fault_log* l = context;
+    size_t first = round(time*SAMPLE_RATE);
+    if (first != l->end) ++l->gaps;
+    if (first + count < l->length)
+    {
+        if (count < l->min_size) l->min_size = count;
+        if (count > l->max_size) l->max_size = count;
+    }
+    l->frames += count;
+    l->end = first + count;
+    ++l->blocks;
+}
+
+// Test that a source with faults varies its block sizes and loses blocks, the same way for a seed
+bool faults_test ()
+{
+    generator_config config;
+    generator_default(&config);
+    fault_log logs[2];
+    size_t xruns[2];
+    for (int run = 0; run < 2; ++run)
+    {
+        source s;
+        source_open_generator(&s, &config, 7, SAMPLE_RATE, 1000, 2.5, false);
+        source_set_faults(&s, 200, 0.25, 3);
+        fault_log l = {2.5*SAMPLE_RATE, 0, 0, 0, 0, SIZE_MAX, 0};
+        source_start(&s, log_block, &l);
+        source_wait(&s);
+        xruns[run] = s.xruns;
+        logs[run] = l;
+        source_close(&s);
+    }
+    fault_log l = logs[0];
+    bool pass = l.min_size >= 800 && l.min_size < 900 && l.max_size > 1100 && l.max_size <= 1200 && xruns[0] > 0 &&
+                l.gaps > 0 && l.frames < l.length && xruns[0] == xruns[1] && memcmp(&logs[0], &logs[1], sizeof(fault_log)) == 0;
+    if (!pass)
+    {
+        fprintf(stderr, "FAILED: faults\n    Blocks: %zu, sizes %zu to %zu, xruns: %zu, then %zu, gaps: %zu\n", l.blocks,
+                l.min_size, l.max_size, xruns[0], xruns[1], l.gaps);
+    }
+    return pass;
+}
+
+int main (void)
+{
+    char path[] = "/tmp/source_test_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) return 1;
+    close(fd);
+    unlink(path);
+
+    if (!generator_test()) return 1;
+    if (!pipe_test(path, INPUT_FLOAT32)) return 1;
+    if (!pipe_test(path, INPUT_INT16)) return 1;
+    if (!pipe_test(path, INPUT_INT24)) return 1;
+    if (!fifo_test(path)) return 1;
+    if (!file_test("pitch_tests/440_sine.wav")) return 1;
+    if (!paced_test()) return 1;
+    if (!stop_test()) return 1;
+    if (!faults_test()) return 1;
+    return 0;
+}
@@ -0,0 +1,230 @@
+// Real time stress test
+//
+// Finds how many voices one machine can analyze live. For every channel count from 1 up,
+// that many threads each run their own backend on a generated voice, in FRAMES_PER_BUFFER
+// blocks at the pace of an audio callback: block k becomes available at
+// start + (k+1)*FRAMES_PER_BUFFER/SAMPLE_RATE, and misses its deadline if it is not
+// processed by the time block k+1 becomes available. Voices sing without gaps, so every
+// frame passes onset detection, the worst case.
+//
+//   stress [-c max_channels] [-d seconds] [-e ensemble_deadline]
+//
+// For every channel count, prints the deadline misses and the callback times (in
+// microseconds): the median and the worst p99 and maximum of any channel. Stops at the first
+// channel count with misses, or with an error when a channel's thread can't be started.
+// FFT_SIZE and FFT_HOP are set at build time, e.g.
+//   make stress FLAGS="-O3 -DFFT_SIZE=2048 -DFFT_HOP=512"
+#include "backend.h"
+#include "generator.h"
+#include "timing.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifndef BACKEND_THREAD_LOCAL
+#error "stress.c runs a backend per thread, build it with -DBACKEND_THREAD_LOCAL"
+#endif
+
+#define DEFAULT_MAX_CHANNELS 64
+#define DEFAULT_SECONDS      10.0
+#define BLOCK_NS             (FRAMES_PER_BUFFER/SAMPLE_RATE*1e9)
+#define WARM_UP_BLOCKS       ((size_t)(SAMPLE_RATE/FRAMES_PER_BUFFER)) // One second
+
+// Holds the channels until every backend is initialized and the clock has started
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t  changed;
+    size_t          ready;      // Channels initialized
+    bool            open;
+    bool            cancelled;  // Open because a channel failed to start; the channels return
+    double          start;      // Clock time (in ns) of the first block
+} start_gate;
+
+typedef struct
+{
+    pthread_t   thread;
+    size_t      index;
+    size_t      num_blocks;
+    long        deadline;  // Ensemble deadline (in microseconds)
+    start_gate* gate;
+    double*     times;     // Callback time (in ns) of every block
+    size_t      misses;
+} channel;
+
+static void* run_channel (void* arg)
+{
+    channel* c = arg;
+    backend_init();
+    ensemble_deadline = c->deadline;
+    generator_config config;
+    generator_default(&config);
+    config.min_gap = config.max_gap = 0;
+    generator g;
+    generator_init(&g, &config, SAMPLE_RATE, c->index);
+
+    // Create the FFT plans and touch every buffer before the clock starts, then restart
+    float block[FRAMES_PER_BUFFER];
+    for (size_t k = 0; k < WARM_UP_BLOCKS; ++k)
+    {
+        generator_read(&g, block, NULL, FRAMES_PER_BUFFER);
+        backend_push_buffer(block, FRAMES_PER_BUFFER, NULL, NULL);
+    }
+    backend_init();
+
+    start_gate* gate = c->gate;
+    pthread_mutex_lock(&gate->lock);
+    ++gate->ready;
+    pthread_cond_broadcast(&gate->changed);
+    while (!gate->open) pthread_cond_wait(&gate->changed, &gate->lock);
+    pthread_mutex_unlock(&gate->lock);
+    for (size_t k = 0; k < c->num_blocks && !gate->cancelled; ++k)
+    {
+        // A real callback gets its samples from the driver, so generating them isn't timed
+        generator_read(&g, block, NULL, FRAMES_PER_BUFFER);
+        double available = gate->start + (k+1)*BLOCK_NS;
+        timing_sleep_until(available);
+        double begin = timing_now_ns();
+        backend_push_buffer(block, FRAMES_PER_BUFFER, NULL, NULL);
+        double end = timing_now_ns();
+        c->times[k] = end - begin;
+        if (end > available + BLOCK_NS) ++c->misses;
+    }
+    backend_cleanup();
+    return NULL;
+}
+
+static int compare_doubles (const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Run a number of channels at once; return false if a channel's thread can't be started
+//   misses: output, the total number of deadline misses
+static bool run (size_t num_channels, double seconds, long deadline, size_t* misses)
+{
+    size_t num_blocks = seconds*SAMPLE_RATE/FRAMES_PER_BUFFER;
+    channel* channels = malloc(sizeof(channel) * num_channels);
+    start_gate gate = {.ready = 0, .open = false, .cancelled = false, .start = 0};
+    pthread_mutex_init(&gate.lock, NULL);
+    pthread_cond_init(&gate.changed, NULL);
+    size_t started = 0;
+    for (; started < num_channels; ++started)
+    {
+        channel* c = &channels[started];
+        c->index      = started;
+        c->num_blocks = num_blocks;
+        c->deadline   = deadline;
+        c->gate       = &gate;
+        c->times      = malloc(sizeof(double) * num_blocks);
+        c->misses     = 0;
+        if (pthread_create(&c->thread, NULL, run_channel, c) != 0)
+        {
+            free(c->times);
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&gate.lock);
+    if (started < num_channels) gate.cancelled = true;
+    else while (gate.ready < num_channels) pthread_cond_wait(&gate.changed, &gate.lock);
+    gate.start = timing_now_ns() + BLOCK_NS;
+    gate.open  = true;
+    pthread_cond_broadcast(&gate.changed);
+    pthread_mutex_unlock(&gate.lock);
+    if (gate.cancelled)
+    {
+        fprintf(stderr, "Failed to start the thread of channel %zu of %zu\n", started+1, num_channels);
+        for (size_t i = 0; i < started; ++i)
+        {
+            pthread_join(channels[i].thread, NULL);
+            free(channels[i].times);
+        }
+        pthread_cond_destroy(&gate.changed);
+        pthread_mutex_destroy(&gate.lock);
+        free(channels);
+        return false;
+    }
+
+    double* all = malloc(sizeof(double) * num_blocks * num_channels);
+    double worst_p99 = 0, worst = 0;
+    *misses = 0;
+    for (size_t i = 0; i < num_channels; ++i)
+    {
+        channel* c = &channels[i];
+        pthread_join(c->thread, NULL);
+        *misses += c->misses;
+        memcpy(all + i*num_blocks, c->times, sizeof(double) * num_blocks);
+        qsort(c->times, num_blocks, sizeof(double), compare_doubles);
+        double p99 = c->times[(size_t)(0.99*(num_blocks-1))];
+        if (p99 > worst_p99) worst_p99 = p99;
+        if (c->times[num_blocks-1] > worst) worst = c->times[num_blocks-1];
+        free(c->times);
+    }
+    qsort(all, num_blocks * num_channels, sizeof(double), compare_doubles);
+    printf("%8zu %8zu %8zu %7.3f%% %8.0f %8.0f %8.0f\n", num_channels, num_blocks * num_channels, *misses,
+           100.0 * *misses/(num_blocks * num_channels), all[num_blocks*num_channels/2]/1e3, worst_p99/1e3, worst/1e3);
+    fflush(stdout);
+
+    free(all);
+    pthread_cond_destroy(&gate.changed);
+    pthread_mutex_destroy(&gate.lock);
+    free(channels);
+    return true;
+}
+
+static void usage ()
+{
+    fprintf(stderr, "Usage: stress [-c max_channels] [-d seconds] [-e ensemble_deadline]\n");
+    fprintf(stderr, "  -c  most channels to try (default %d)\n", DEFAULT_MAX_CHANNELS);
+    fprintf(stderr, "  -d  seconds of audio per channel count (default %.0f)\n", DEFAULT_SECONDS);
+    fprintf(stderr, "  -e  microseconds the estimator ensemble may wait per frame (default %d; 0 never waits)\n", ENSEMBLE_DEADLINE);
+}
+
+int main (int argc, char** argv)
+{
+    size_t max_channels = DEFAULT_MAX_CHANNELS;
+    double seconds = DEFAULT_SECONDS;
+    long deadline = ENSEMBLE_DEADLINE;
+    int option;
+    while ((option = getopt(argc, argv, "c:d:e:")) != -1)
+    {
+        switch (option) {
+            case 'c':
+                max_channels = atoi(optarg); break;
+            case 'd':
+                seconds = atof(optarg); break;
+            case 'e':
+                deadline = atol(optarg); break;
+            default:
+                usage();
+                return 1;
+        }
+    }
+    if (max_channels == 0 || seconds*SAMPLE_RATE < FRAMES_PER_BUFFER)
+    {
+        usage();
+        return 1;
+    }
+
+    printf("FFT_SIZE %d, FFT_HOP %d, ensemble deadline %ldus, %.0fus per block\n",
+           FFT_SIZE, FFT_HOP, deadline, BLOCK_NS/1e3);
+    printf("%8s %8s %8s %8s %8s %8s %8s\n", "channels", "blocks", "misses", "rate", "p50", "p99", "max");
+    for (size_t n = 1; n <= max_channels; ++n)
+    {
+        size_t misses;
+        if (!run(n, seconds, deadline, &misses)) return 1;
+        if (misses > 0)
+        {
+            printf("Deadline misses begin at %zu channels\n", n);
+            return 0;
+        }
+    }
+    printf("No deadline misses up to %zu channels\n", max_channels);
+    return 0;
+}
@@ -0,0 +1,26 @@
+#include "timing.h"
+
+#include <time.h>
+
+double timing_now_ns ()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec*1e9 + t.tv_nsec;
+}
+
+void timing_sleep_until (double ns)
+{
+#ifdef __APPLE__
+    // No clock_nanosleep: sleep for the time left until it is reached
+    double left;
+    while ((left = ns - timing_now_ns()) > 0)
+    {
+        struct timespec t = {(time_t)(left/1e9), (long)(left - (time_t)(left/1e9)*1e9)};
+        nanosleep(&t, NULL);
+    }
+#else
+    struct timespec t = {(time_t)(ns/1e9), (long)(ns - (time_t)(ns/1e9)*1e9)};
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL) != 0);
+#endif
+}
@@ -0,0 +1,11 @@
+// Monotonic clock
+//
+// Clock times are nanoseconds on CLOCK_MONOTONIC, held in doubles so deadlines are plain
+// arithmetic; setting the wall clock moves neither them nor the sleeps that wait for them.
+
+// Return the clock time (in ns)
+double timing_now_ns ();
+
+// Sleep until the clock reaches a time, through any signals
+//   ns: the clock time (in ns) to wake at
+void timing_sleep_until (double ns);
@@ -0,0 +1,34 @@
+#include "timing.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+
+// Test that a sleep wakes once its time is reached, and not much later
+bool sleep_test ()
+{
+    double start = timing_now_ns();
+    double target = start + 5e6;
+    timing_sleep_until(target);
+    double woke = timing_now_ns();
+    bool pass = woke >= target && woke < target + 50e6;
+    if (!pass) fprintf(stderr, "FAILED: sleep\n    Woke %.3fms after the target\n", (woke - target)/1e6);
+    return pass;
+}
+
+// Test that a time already passed doesn't sleep
+bool past_test ()
+{
+    double start = timing_now_ns();
+    timing_sleep_until(start - 1e9);
+    double elapsed = timing_now_ns() - start;
+    bool pass = elapsed < 5e6;
+    if (!pass) fprintf(stderr, "FAILED: past\n    Slept %.3fms\n", elapsed/1e6);
+    return pass;
+}
+
+int main (void)
+{
+    if (!sleep_test()) return 1;
+    if (!past_test()) return 1;
+    return 0;
+}
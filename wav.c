@@ -0,0 +1,168 @@
+#include "wav.h"
+
+#include <sndfile.h>
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define FORMAT_PCM        1
+#define FORMAT_FLOAT      3
+#define FORMAT_EXTENSIBLE 0xFFFE
+
+static uint32_t read_u32 (const unsigned char* p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint16_t read_u16 (const unsigned char* p)
+{
+    return p[0] | p[1] << 8;
+}
+
+// Find the samples of a raw PCM WAV file; return false if it has to be decoded by libsndfile
+static bool parse_header (wav_reader* r, const unsigned char* file, size_t size)
+{
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+    return false;
+#endif
+    if (size < 12 || memcmp(file, "RIFF", 4) != 0 || memcmp(file + 8, "WAVE", 4) != 0) return false;
+
+    int format = 0, channels = 0, bits = 0, block_align = 0;
+    double sample_rate = 0;
+    size_t loc = 12;
+    while (loc + 8 <= size)
+    {
+        const unsigned char* chunk = file + loc;
+        size_t chunk_size = read_u32(chunk + 4);
+        loc += 8;
+        if (memcmp(chunk, "fmt ", 4) == 0 && chunk_size >= 16 && loc + chunk_size <= size)
+        {
+            format      = read_u16(chunk + 8);
+            channels    = read_u16(chunk + 10);
+            sample_rate = read_u32(chunk + 12);
+            block_align = read_u16(chunk + 20);
+            bits        = read_u16(chunk + 22);
+            // The format of an extensible file is the start of its subformat GUID
+            if (format == FORMAT_EXTENSIBLE && chunk_size >= 26) format = read_u16(chunk + 32);
+        }
+        else if (memcmp(chunk, "data", 4) == 0)
+        {
+            bool supported = (format == FORMAT_PCM && bits == 16) || (format == FORMAT_FLOAT && bits == 32);
+            if (!supported || channels < 1 || block_align != channels*bits/8) return false;
+            // Recorders that were cut off leave the size unset, so trust the file length
+            if (chunk_size > size - loc) chunk_size = size - loc;
+            r->sample_rate = sample_rate;
+            r->channels    = channels;
+            r->frames      = chunk_size/block_align;
+            r->data        = file + loc;
+            r->format      = format;
+            return true;
+        }
+        loc += chunk_size + (chunk_size & 1);
+    }
+    return false;
+}
+
+// Map a raw PCM WAV file; return false if it has to be decoded by libsndfile
+static bool map_file (wav_reader* r, const char* path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) return false;
+    struct stat status;
+    if (fstat(fd, &status) == -1 || status.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+    void* map = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return false;
+    if (!parse_header(r, map, status.st_size))
+    {
+        munmap(map, status.st_size);
+        return false;
+    }
+    madvise(map, status.st_size, MADV_SEQUENTIAL);
+    r->map      = map;
+    r->map_size = status.st_size;
+    return true;
+}
+
+bool wav_open (wav_reader* r, const char* path)
+{
+    memset(r, 0, sizeof(wav_reader));
+    if (map_file(r, path)) return true;
+
+    SF_INFO info = {0};
+    r->file = sf_open(path, SFM_READ, &info);
+    if (r->file == NULL) return false;
+    r->sample_rate = info.samplerate;
+    r->channels    = info.channels;
+    r->frames      = info.frames;
+    r->chunk       = malloc(sizeof(float) * WAV_CHUNK_FRAMES * info.channels);
+    return true;
+}
+
+size_t wav_read (wav_reader* r, float* out, size_t count)
+{
+    if (count > r->frames - r->position) count = r->frames - r->position;
+    int channels = r->channels;
+
+    if (r->map)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            float sample = 0;
+            for (int c = 0; c < channels; ++c)
+            {
+                size_t index = (r->position + i)*channels + c;
+                if (r->format == FORMAT_PCM)
+                {
+                    int16_t value;
+                    memcpy(&value, r->data + 2*index, sizeof(value));
+                    sample += value/32768.0f;
+                }
+                else
+                {
+                    float value;
+                    memcpy(&value, r->data + 4*index, sizeof(value));
+                    sample += value;
+                }
+            }
+            out[i] = sample/channels;
+        }
+        r->position += count;
+        return count;
+    }
+
+    size_t total = 0;
+    while (total < count)
+    {
+        size_t request = count - total < WAV_CHUNK_FRAMES ? count - total : WAV_CHUNK_FRAMES;
+        sf_count_t read = sf_readf_float(r->file, r->chunk, request);
+        if (read <= 0) break;
+        for (sf_count_t i = 0; i < read; ++i)
+        {
+            float sample = 0;
+            for (int c = 0; c < channels; ++c) sample += r->chunk[i*channels + c];
+            out[total + i] = sample/channels;
+        }
+        total += read;
+    }
+    r->position += total;
+    return total;
+}
+
+void wav_close (wav_reader* r)
+{
+    if (r->map)  munmap(r->map, r->map_size);
+    if (r->file) sf_close(r->file);
+    free(r->chunk);
+    memset(r, 0, sizeof(wav_reader));
+}
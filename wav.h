@@ -0,0 +1,40 @@
+// Streaming sound file reader
+//
+// Sound files are read a chunk at a time and mixed down to mono, so memory use does not
+// depend on the length of the file and the first frame is available immediately. Raw PCM
+// WAV files (16 bit integer or 32 bit float) are mapped into memory and converted straight
+// from the page cache; anything else is decoded by libsndfile.
+#include <sndfile.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#define WAV_CHUNK_FRAMES 4096 // Frames decoded per libsndfile read
+
+typedef struct
+{
+    double               sample_rate;
+    int                  channels;
+    size_t               frames;     // Length of the file
+    size_t               position;   // Frames read so far
+    SNDFILE*             file;       // NULL if the file is mapped
+    float*               chunk;      // Interleaved libsndfile output (WAV_CHUNK_FRAMES*channels)
+    void*                map;        // The mapped file, or NULL
+    size_t               map_size;
+    const unsigned char* data;       // First sample of the mapped file
+    int                  format;     // Encoding of the mapped samples
+} wav_reader;
+
+// Open a sound file for reading; return false if it can't be opened
+//   r:    the reader to be initialized
+//   path: the sound file
+bool wav_open (wav_reader* r, const char* path);
+
+// Return the number of frames read, mixed down to mono, or 0 at the end of the file
+//   r:     an open reader
+//   out:   output array of length count
+//   count: the most frames to be read
+size_t wav_read (wav_reader* r, float* out, size_t count);
+
+// Close the file and release the reader's buffers
+void wav_close (wav_reader* r);
@@ -0,0 +1,145 @@
+#include "wav.h"
+
+#include <sndfile.h>
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TEST_FRAMES 10000
+
+static void write_u32 (FILE* f, uint32_t value)
+{
+    unsigned char bytes[4] = {value, value >> 8, value >> 16, value >> 24};
+    fwrite(bytes, 1, 4, f);
+}
+
+static void write_u16 (FILE* f, uint16_t value)
+{
+    unsigned char bytes[2] = {value, value >> 8};
+    fwrite(bytes, 1, 2, f);
+}
+
+// Write a WAV file whose samples are a ramp through every channel, with an odd sized chunk
+// before the samples to be skipped
+static void write_wav (const char* path, int format, int channels, int bits, size_t frames)
+{
+    FILE* f = fopen(path, "wb");
+    size_t data_size = frames*channels*bits/8;
+    fwrite("RIFF", 1, 4, f);
+    write_u32(f, 4 + 24 + 8 + 4 + 8 + data_size);
+    fwrite("WAVE", 1, 4, f);
+    fwrite("fmt ", 1, 4, f);
+    write_u32(f, 16);
+    write_u16(f, format);
+    write_u16(f, channels);
+    write_u32(f, 44100);
+    write_u32(f, 44100*channels*bits/8);
+    write_u16(f, channels*bits/8);
+    write_u16(f, bits);
+    fwrite("LIST", 1, 4, f);
+    write_u32(f, 3);
+    fwrite("abc\0", 1, 4, f);
+    fwrite("data", 1, 4, f);
+    write_u32(f, data_size);
+    for (size_t i = 0; i < frames*channels; ++i)
+    {
+        if (bits == 16) write_u16(f, (int16_t)(i % 60000 - 30000));
+        else
+        {
+            float value = (i % 60000 - 30000.0f)/32768;
+            fwrite(&value, sizeof(value), 1, f);
+        }
+    }
+    fclose(f);
+}
+
+// Test that a file read in uneven chunks is the ramp written by write_wav, mixed to mono
+bool ramp_test (const char* name, int format, int channels, int bits)
+{
+    char path[] = "/tmp/wav_test_XXXXXX";
+    close(mkstemp(path));
+    write_wav(path, format, channels, bits, TEST_FRAMES);
+
+    bool pass = true;
+    wav_reader r;
+    if (!wav_open(&r, path))
+    {
+        fprintf(stderr, "FAILED: %s\n    Could not open file.\n", name);
+        unlink(path);
+        return false;
+    }
+    if (r.map == NULL || r.channels != channels || r.sample_rate != 44100 || r.frames != TEST_FRAMES)
+    {
+        fprintf(stderr, "FAILED: %s\n    Header: mapped %d, %d channels, %.0fHz, %zu frames\n",
+                name, r.map != NULL, r.channels, r.sample_rate, r.frames);
+        pass = false;
+    }
+
+    float out[1000];
+    size_t position = 0, count;
+    for (size_t chunk = 1; (count = wav_read(&r, out, chunk)) > 0; chunk = chunk*3 % 997 + 1)
+    {
+        for (size_t i = 0; i < count && pass; ++i, ++position)
+        {
+            double expected = 0;
+            for (int c = 0; c < channels; ++c) expected += ((position*channels + c) % 60000 - 30000.0)/32768;
+            expected /= channels;
+            if (fabs(out[i] - expected) > 1e-6)
+            {
+                fprintf(stderr, "FAILED: %s\n    Frame %zu: %f, expected %f\n", name, position, out[i], expected);
+                pass = false;
+            }
+        }
+    }
+    if (pass && position != TEST_FRAMES)
+    {
+        fprintf(stderr, "FAILED: %s\n    Read %zu frames, expected %d\n", name, position, TEST_FRAMES);
+        pass = false;
+    }
+
+    wav_close(&r);
+    unlink(path);
+    return pass;
+}
+
+// Test that a mapped file reads the same as libsndfile decodes it
+bool sndfile_test (const char* path)
+{
+    SF_INFO info = {0};
+    SNDFILE* f = sf_open(path, SFM_READ, &info);
+    wav_reader r;
+    if (f == NULL || !wav_open(&r, path))
+    {
+        fprintf(stderr, "FAILED: %s\n    File not found.\n", path);
+        if (f) sf_close(f);
+        return false;
+    }
+
+    bool pass = r.frames == (size_t)info.frames;
+    float expected[256 * info.channels], out[256];
+    size_t count;
+    while (pass && (count = wav_read(&r, out, 256)) > 0)
+    {
+        pass = sf_readf_float(f, expected, count) == (sf_count_t)count;
+        for (size_t i = 0; i < count && pass; ++i) pass = fabs(out[i] - expected[i*info.channels]) < 1e-6;
+    }
+    if (!pass) fprintf(stderr, "FAILED: %s\n    Differs from libsndfile.\n", path);
+
+    wav_close(&r);
+    sf_close(f);
+    return pass;
+}
+
+int main (void)
+{
+    if (!ramp_test("16 bit mono", 1, 1, 16)) return 1;
+    if (!ramp_test("16 bit stereo", 1, 2, 16)) return 1;
+    if (!ramp_test("float stereo", 3, 2, 32)) return 1;
+    if (!sndfile_test("pitch_tests/440_sine.wav")) return 1;
+    return 0;
+}
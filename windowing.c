@@ -28,8 +28,7 @@ void hamming_window(double* fft_mag, size_t sample_size, double* windowed)
     double N = (double)sample_size;
     for (size_t n = 0; n < sample_size; ++n)
     {
-        
-        double coeff = 0.54 + (0.46 * cos((2*PI*n)/(N-1)));
+        double coeff = 0.54 - (0.46 * cos((2*PI*n)/(N-1)));
         windowed[n] = coeff * fft_mag[n];
     }
 }